@@ -0,0 +1,199 @@
+import argparse
+import glob
+import json
+import math
+import os
+import random
+import subprocess
+import sys
+import tempfile
+import time
+
+# Benchmark suite: renders a fixed set of scenes with --stats and collects the
+# per-phase timings, ray counts, Mrays/s, BVH visit counts and peak RSS into one
+# JSON file so results can be tracked over time.
+
+MATERIAL_DIFFUSE = {
+    "ks": 0.1,
+    "kd": 0.9,
+    "specularexponent": 20,
+    "diffusecolor": [0.6, 0.6, 0.6],
+    "specularcolor": [1.0, 1.0, 1.0],
+    "isreflective": False,
+    "reflectivity": 0.0,
+    "isrefractive": False,
+    "refractiveindex": 1.0
+}
+
+
+def base_scene(width, height):
+    return {
+        "nbounces": 8,
+        "rendermode": "phong",
+        "camera": {
+            "type": "pinhole",
+            "width": width,
+            "height": height,
+            "position": [13.0, 2.0, 3.0],
+            "lookAt": [0.0, 0.0, 0.0],
+            "upVector": [0.0, 1.0, 0.0],
+            "fov": 40.0,
+            "exposure": 1
+        },
+        "scene": {
+            "backgroundcolor": [0.53, 0.80, 0.92],
+            "lightsources": [
+                {"type": "pointlight", "intensity": [1, 1, 1], "position": [0, 100, 0]}
+            ],
+            "shapes": []
+        }
+    }
+
+
+def ground():
+    # Infinite ground plane, tested outside the BVH
+    return [{"type": "plane", "point": [0, -0.5, 0], "normal": [0, 1, 0], "material": MATERIAL_DIFFUSE}]
+
+
+def clutter_scene(count, width, height, seed=1):
+    rng = random.Random(seed)
+    scene = base_scene(width, height)
+    shapes = scene["scene"]["shapes"]
+    shapes.extend(ground())
+
+    extent = max(8.0, math.sqrt(count) / 2.0)
+    for _ in range(count):
+        material = dict(MATERIAL_DIFFUSE)
+        material["diffusecolor"] = [rng.random(), rng.random(), rng.random()]
+        choice = rng.random()
+        if choice > 0.95:
+            material.update({"isrefractive": True, "refractiveindex": 1.5, "reflectivity": 0.2})
+        elif choice > 0.85:
+            material.update({"isreflective": True, "reflectivity": 0.8})
+        shapes.append({
+            "type": "sphere",
+            "center": [rng.uniform(-extent, extent), -0.3, rng.uniform(-extent, extent)],
+            "radius": 0.2,
+            "material": material
+        })
+    return scene
+
+
+def mesh_scene(subdivisions, width, height):
+    # Tessellated unit sphere made of triangles (latitude/longitude grid)
+    scene = base_scene(width, height)
+    scene["camera"]["position"] = [0.0, 1.0, 4.0]
+    scene["camera"]["lookAt"] = [0.0, 0.5, 0.0]
+    shapes = scene["scene"]["shapes"]
+    shapes.extend(ground())
+
+    rings = subdivisions
+    segments = subdivisions * 2
+
+    def point(ring, segment):
+        theta = math.pi * ring / rings
+        phi = 2.0 * math.pi * segment / segments
+        return [math.sin(theta) * math.cos(phi), 0.5 + math.cos(theta), math.sin(theta) * math.sin(phi)]
+
+    for ring in range(rings):
+        for segment in range(segments):
+            p00 = point(ring, segment)
+            p01 = point(ring, segment + 1)
+            p10 = point(ring + 1, segment)
+            p11 = point(ring + 1, segment + 1)
+            if ring > 0:
+                shapes.append({"type": "triangle", "v0": p00, "v1": p10, "v2": p01, "material": MATERIAL_DIFFUSE})
+            if ring < rings - 1:
+                shapes.append({"type": "triangle", "v0": p01, "v1": p10, "v2": p11, "material": MATERIAL_DIFFUSE})
+    return scene
+
+
+def scale_scene(scene, width, max_samples):
+    camera = scene["camera"]
+    height = max(1, int(camera["height"] * width / camera["width"]))
+    camera["width"] = width
+    camera["height"] = height
+    if scene.get("rendermode") == "pathtrace":
+        for key, default in (("pixelsample", 16), ("lightsample", 4)):
+            scene[key] = min(scene.get(key, default), max_samples)
+    return scene
+
+
+def git_revision():
+    try:
+        return subprocess.check_output(["git", "rev-parse", "HEAD"], stderr=subprocess.DEVNULL).decode().strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+def run_scene(raytracer, name, scene, workdir):
+    scene_path = os.path.join(workdir, name + ".json")
+    image_path = os.path.join(workdir, name + ".ppm")
+    stats_path = os.path.join(workdir, name + ".stats.json")
+    with open(scene_path, "w") as f:
+        json.dump(scene, f)
+
+    start = time.time()
+    result = subprocess.run([raytracer, scene_path, image_path, "--stats", stats_path],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    wall = time.time() - start
+
+    if result.returncode != 0 or not os.path.exists(stats_path):
+        print(f"  {name}: FAILED ({result.stderr.decode().strip()})")
+        return {"name": name, "error": result.stderr.decode().strip(), "wall_s": wall}
+
+    with open(stats_path) as f:
+        stats = json.load(f)
+    stats["name"] = name
+    stats["wall_s"] = wall
+    print(f"  {name:32s} {stats['phases_ms'].get('render', 0.0):10.1f} ms render "
+          f"{stats.get('mrays_per_second', 0.0):8.3f} Mrays/s {stats['peak_rss_kb'] / 1024.0:8.1f} MB")
+    return stats
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the raytracer benchmark suite")
+    parser.add_argument("--raytracer", default="./raytracer")
+    parser.add_argument("--output", default="bench_results.json")
+    parser.add_argument("--width", type=int, default=320, help="Render width (height keeps the aspect ratio)")
+    parser.add_argument("--max-samples", type=int, default=4, help="Cap for pixelsample/lightsample")
+    parser.add_argument("--clutter", default="100,1000,5000", help="Sphere counts of generated clutter scenes")
+    parser.add_argument("--mesh", default="16,64", help="Subdivisions of generated triangle mesh scenes")
+    parser.add_argument("--filter", default="", help="Only run scenes whose name contains this string")
+    args = parser.parse_args()
+
+    height = args.width * 2 // 3
+    scenes = []
+    for path in sorted(glob.glob("scenes/*.json")):
+        with open(path) as f:
+            scene = json.load(f)
+        scenes.append((os.path.splitext(os.path.basename(path))[0], scale_scene(scene, args.width, args.max_samples)))
+    for count in filter(None, args.clutter.split(",")):
+        scenes.append((f"gen_clutter_{count}", clutter_scene(int(count), args.width, height)))
+    for subdivisions in filter(None, args.mesh.split(",")):
+        scenes.append((f"gen_mesh_{subdivisions}", mesh_scene(int(subdivisions), args.width, height)))
+
+    results = []
+    with tempfile.TemporaryDirectory() as workdir:
+        for name, scene in scenes:
+            if args.filter and args.filter not in name:
+                continue
+            results.append(run_scene(args.raytracer, name, scene, workdir))
+
+    report = {
+        "timestamp": time.strftime("%Y-%m-%dT%H:%M:%S"),
+        "git_revision": git_revision(),
+        "width": args.width,
+        "max_samples": args.max_samples,
+        "results": results
+    }
+    with open(args.output, "w") as f:
+        json.dump(report, f, indent=4)
+    print(f"Benchmark results written to {args.output}")
+
+    if any("error" in result for result in results):
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
@@ -38,28 +38,9 @@ def create_rtiow_scene():
 
     # Ground plane
     shapes.append({
-        "type": "triangle",
-        "v0": [-1000, -0.5, -1000],
-        "v1": [1000, -0.5, -1000],
-        "v2": [-1000, -0.5, 1000],
-        "material": {
-            "ks": 0.0,
-            "kd": 1.0,
-            "specularexponent": 0,
-            "diffusecolor": [0.25, 0.6, 0.25],
-            "specularcolor": [0.0, 0.0, 0.0],
-            "isreflective": False,
-            "reflectivity": 0.0,
-            "isrefractive": False,
-            "refractiveindex": 1.0
-        }
-    })
-
-    shapes.append({
-        "type": "triangle",
-        "v0": [1000, -0.5, -1000],
-        "v1": [1000, -0.5, 1000],
-        "v2": [-1000, -0.5, 1000],
+        "type": "plane",
+        "point": [0, -0.5, 0],
+        "normal": [0, 1, 0],
         "material": {
             "ks": 0.0,
             "kd": 1.0,
@@ -0,0 +1,67 @@
+// AovBuffer.h
+#pragma once
+#ifndef AOVBUFFER_H
+#define AOVBUFFER_H
+
+#include "Intersectable.h"
+#include "RenderCheckpoint.h"
+#include "Vector3.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+* What the path tracer records of one sample's primary ray for the AOVs. The
+* object stays null when the ray missed, and then direct holds the background.
+*/
+struct AovSample {
+    Vector3 direct;         // Light from the lights at the first hit, or the background
+    Vector3 albedo;         // Reflectance of the first hit, white for mirrors and glass
+    Vector3 normal;         // Normal of the first hit, facing the camera
+    Real depth = 0;         // Distance to the first hit
+    const Intersectable* object = nullptr;
+};
+
+/**
+ * @brief Arbitrary output variables of a path-traced render.
+ *
+ * Sums the AovSample of every sample traced, so the passes come out of the
+ * render itself rather than separate renders; the albedo, normal and depth
+ * sums are also the features that guide the denoiser. Together with the
+ * radiance sums and sample counts of a RenderCheckpoint they are written as
+ * one OpenEXR file of float channels: the beauty image, its direct and indirect parts,
+ * albedo, normal, depth, object id and sample count. Pixel (i, j) is stored
+ * at j * width + i, row 0 at the bottom like the render buffer.
+ */
+class AovBuffer {
+public:
+    int width = 0;
+    int height = 0;
+    int regionI0 = 0, regionJ0 = 0;   // Pixels rendered: columns [regionI0, regionI1)
+    int regionI1 = 0, regionJ1 = 0;   // and rows [regionJ0, regionJ1)
+    // Summed in double like the checkpoint's radiance, so indirect = beauty -
+    // direct does not pick up the rounding of a long float sum
+    std::vector<Vec3<double>> directSum;
+    std::vector<Vec3<double>> albedoSum;   // Feature sums run over the samples that hit
+    std::vector<Vec3<double>> normalSum;
+    std::vector<double> depthSum;
+    std::vector<uint32_t> hitCount;
+    std::vector<uint32_t> sampleCount; // Samples added, whether they hit or not
+    std::vector<const Intersectable*> object; // Hit by the pixel's first sample that hit anything
+
+    // Clear the sums of a width x height frame whose region, columns [i0, i1)
+    // and rows [j0, j1), is about to be rendered
+    void reset(int width, int height, int i0, int j0, int i1, int j1);
+
+    // Add one sample of the given pixel; a pixel's samples must come from one thread
+    void add(size_t pixel, const AovSample& sample);
+
+    // Write the region as an uncompressed OpenEXR file. Radiance is the
+    // checkpoint's sum times radianceScale over the pixel's sample count, and
+    // object ids are positions in objects plus one, 0 where nothing was hit.
+    // The display window is the full frame unless cropped is set.
+    bool write(const std::string& filename, const RenderCheckpoint& checkpoint, double radianceScale,
+               const std::vector<const Intersectable*>& objects, bool cropped) const;
+};
+
+#endif // AOVBUFFER_H
@@ -4,7 +4,6 @@
 #define AREALIGHT_H
 
 #include "Light.h"
-#include <random>
 
 class AreaLight : public Light {
 public:
@@ -12,17 +11,17 @@ public:
     Vector3 normal;
     Vector3 uVec; // Local x-axis
     Vector3 vVec; // Local y-axis
-    double width;
-    double height;
+    Real width;
+    Real height;
 
     AreaLight(const Vector3& position_, const Vector3& normal_,
               const Vector3& uVec_, const Vector3& vVec_,
-              double width_, double height_, const Vector3& intensity_)
+              Real width_, Real height_, const Vector3& intensity_)
         : Light(LightType::AREA, intensity_), position(position_), normal(normal_.normalize()),
           uVec(uVec_.normalize()), vVec(vVec_.normalize()), width(width_), height(height_) {}
 
     // Sample a point on the light's surface
-    virtual Vector3 sample(const Vector3& point, Vector3& lightDir, double& distance, double& pdf) const override;
+    virtual Vector3 sample(const Vector3& point, Vector3& lightDir, Real& distance, Real& pdf) const override;
 };
 
 #endif // AREALIGHT_H
@@ -14,10 +14,12 @@ public:
     std::shared_ptr<Intersectable> left;
     std::shared_ptr<Intersectable> right;
     std::shared_ptr<Intersectable> object; // Only for leaf nodes
+    bool isLeaf; // True when the children are primitives rather than BVH nodes
 
     BVHNode();
     BVHNode(const std::vector<std::shared_ptr<Intersectable>>& objects, size_t start, size_t end);
     virtual bool intersect(const Ray& ray, HitRecord& hitRecord) const override;
+    virtual bool occluded(const Ray& ray, Real maxDistance, const Intersectable*& occluder) const override;
     virtual BoundingBox getBoundingBox() const override;
 
 };
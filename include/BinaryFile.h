@@ -0,0 +1,64 @@
+// BinaryFile.h
+#pragma once
+#ifndef BINARYFILE_H
+#define BINARYFILE_H
+
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Shared pieces of the renderer's binary files (scene cache,
+ * checkpoints, relight and incremental state).
+ *
+ * Arrays are stored as their raw elements in the host's byte order; each file
+ * format records an endian tag in its header to reject foreign files. Vectors
+ * are stored as three scalars of a type the format chooses, without the
+ * padding lane of padded builds.
+ */
+class BinaryFile {
+public:
+    template <typename T>
+    static void writeArray(std::ostream& outFile, const std::vector<T>& values) {
+        outFile.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+    }
+
+    // Fill values, which must already have the stored size
+    template <typename T>
+    static bool readArray(std::istream& inFile, std::vector<T>& values) {
+        return static_cast<bool>(inFile.read(reinterpret_cast<char*>(values.data()), values.size() * sizeof(T)));
+    }
+
+    template <typename Scalar, typename Vector>
+    static void writeVectors(std::ostream& outFile, const std::vector<Vector>& vectors) {
+        std::vector<Scalar> values;
+        values.reserve(vectors.size() * 3);
+        for (const Vector& vector : vectors) {
+            values.push_back(static_cast<Scalar>(vector.x));
+            values.push_back(static_cast<Scalar>(vector.y));
+            values.push_back(static_cast<Scalar>(vector.z));
+        }
+        writeArray(outFile, values);
+    }
+
+    template <typename Scalar, typename Vector>
+    static bool readVectors(std::istream& inFile, std::vector<Vector>& vectors) {
+        std::vector<Scalar> values(vectors.size() * 3);
+        if (!readArray(inFile, values))
+            return false;
+        for (size_t p = 0; p < vectors.size(); ++p) {
+            vectors[p] = Vector(values[3 * p], values[3 * p + 1], values[3 * p + 2]);
+        }
+        return true;
+    }
+
+    // Write the contents to filename + ".tmp" and rename it over the target,
+    // so an interruption never leaves a partial file. Errors are printed with
+    // the description ("checkpoint file", ...) and return false.
+    static bool replace(const std::string& filename, const std::string& description,
+                        const std::function<void(std::ostream&)>& writeContents);
+};
+
+#endif // BINARYFILE_H
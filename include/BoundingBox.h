@@ -15,8 +15,23 @@ public:
     BoundingBox(const Vector3& min_, const Vector3& max_);
 
     BoundingBox merge(const BoundingBox& other) const;
-    bool intersect(const Ray& ray, double& tNear, double& tFar) const;
+    bool intersect(const Ray& ray, Real& tNear, Real& tFar) const;
     Vector3 getCenter() const;
+
+    // Region inside both boxes; empty when they are disjoint
+    BoundingBox overlap(const BoundingBox& other) const;
+
+    // Surface area, zero for empty boxes
+    Real getSurfaceArea() const;
+
+    // True when min > max on some axis, as for the box returned by empty()
+    bool isEmpty() const;
+
+    // Inverted box that merging with any box leaves unchanged
+    static BoundingBox empty();
+
+    // Bounds of the part of a convex polygon (at most 10 vertices) inside clip
+    static BoundingBox ofClippedPolygon(const Vector3* vertices, int count, const BoundingBox& clip);
 };
 
 #endif // BOUNDINGBOX_H
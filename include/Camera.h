@@ -4,15 +4,15 @@
 #define CAMERA_H
 
 #include "Ray.h"
-#include <random>
+#include "Sampler.h"
 
 class Camera {
 public:
     Vector3 position;
     Vector3 lookAt;
     Vector3 up;
-    double fov; // Field of view in degrees
-    double aspectRatio;
+    Real fov; // Field of view in degrees
+    Real aspectRatio;
 
     // Precomputed basis vectors and image plane parameters
     Vector3 u, v, w;
@@ -21,26 +21,24 @@ public:
     Vector3 vertical;
 
         // New members for lens sampling
-    double aperture;      // Diameter of the lens aperture
-    double focusDist;     // Focus distance (distance to the focal plane)
-    double lensRadius;    // Radius of the lens aperture (aperture / 2)
+    Real aperture;      // Diameter of the lens aperture
+    Real focusDist;     // Focus distance (distance to the focal plane)
+    Real lensRadius;    // Radius of the lens aperture (aperture / 2)
 
 
     // Constructor
     Camera(const Vector3& position, const Vector3& lookAt, const Vector3& up,
-           double fov, double aspectRatio,
-           double aperture = 0.0, double focusDist = 1.0);
+           Real fov, Real aspectRatio,
+           Real aperture = 0.0, Real focusDist = 1.0);
 
     // Generate a ray through the pixel at (s, t)
-    Ray getRay(double s, double t, bool useLens = false) const;
+    Ray getRay(Real s, Real t, bool useLens = false) const;
 
     Vector3 randomInUnitDisk() const {
-        std::uniform_real_distribution<double> dist(-1.0, 1.0);
-        std::mt19937 rng = std::mt19937(std::random_device{}());
-        double x, y;
+        Real x, y;
         do {
-            x = dist(rng);
-            y = dist(rng);
+            x = 2.0 * Sampler::next() - 1.0;
+            y = 2.0 * Sampler::next() - 1.0;
         } while (x * x + y * y >= 1.0);
         return Vector3(x, y, 0);
     }
@@ -0,0 +1,30 @@
+// CpuDispatch.h
+#pragma once
+#ifndef CPUDISPATCH_H
+#define CPUDISPATCH_H
+
+#include <string>
+
+// Portable release builds (RT_CPU_DISPATCH, set by the Makefile when no ARCH is
+// given) compile the functions marked RT_DISPATCH once per instruction set and
+// let the loader pick the best one for the CPU. Every call to such a function
+// goes through the loader's indirect jump and cannot be inlined, so the marker
+// belongs on coarse kernels (a whole traversal), not on single box or
+// primitive tests; virtual functions cannot be multiversioned at all.
+#if defined(RT_CPU_DISPATCH) && defined(__GNUC__) && defined(__x86_64__) && defined(__linux__)
+#define RT_DISPATCH_ENABLED 1
+#define RT_DISPATCH __attribute__((target_clones("default", "avx2")))
+#else
+#define RT_DISPATCH
+#endif
+
+/**
+ * @brief Reports the instruction set the RT_DISPATCH kernels run with.
+ */
+class CpuDispatch {
+public:
+    // "avx2" or "default" when dispatching at run time, "static" when the build fixed the target
+    static std::string selectedTarget();
+};
+
+#endif // CPUDISPATCH_H
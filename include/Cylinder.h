@@ -14,20 +14,21 @@ class Cylinder : public Intersectable {
 public:
     Vector3 baseCenter; // Center of the base
     Vector3 axis;       // Axis direction (should be normalized)
-    double radius;
-    double height;
+    Real radius;
+    Real height;
     bool hasCaps;       // Whether the cylinder has top and bottom caps
     Material material;
 
     // Constructor
-    Cylinder(const Vector3& baseCenter, const Vector3& axis, double radius, double height, const Material& material, bool hasCaps = true);
+    Cylinder(const Vector3& baseCenter, const Vector3& axis, Real radius, Real height, const Material& material, bool hasCaps = true);
 
     // Intersection method
     virtual bool intersect(const Ray& ray, HitRecord& hitRecord) const override;
 
     virtual BoundingBox getBoundingBox() const override;
+    virtual const Material* getMaterial() const override { return &material; }
 
-    void getUV(const Vector3& point, double& u, double& v) const;
+    void getUV(const Vector3& point, Real& u, Real& v) const;
 };
 
 #endif // CYLINDER_H
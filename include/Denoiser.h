@@ -0,0 +1,43 @@
+// Denoiser.h
+#pragma once
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <vector>
+
+/**
+ * @brief Edge-avoiding à-trous wavelet filter for path-traced images
+ * (Dammertz et al. 2010, with the variance-guided weights of SVGF).
+ *
+ * The noisy radiance is divided by the albedo of the first hit so textures
+ * stay sharp, and the illumination left over is smoothed by repeated 5x5
+ * B3-spline passes whose taps lie 1, 2, 4, ... pixels apart. A tap counts for
+ * less the more its normal, depth and illumination differ from the centre's;
+ * the illumination tolerance follows the pixel's estimated variance, which
+ * each pass filters along, so converged pixels are left nearly as they are.
+ *
+ * Every channel is a separate float plane with pixel (i, j) at j * width + i.
+ * The passes loop over the taps outside and the pixels of a row inside, so
+ * the inner loops read contiguous memory without branches.
+ */
+class Denoiser {
+public:
+    Denoiser(int width, int height);
+
+    // Inputs, set per pixel before filter(); radiance is replaced by the result
+    std::vector<float> radiance[3];   // Mean linear radiance
+    std::vector<float> variance;      // Variance of the mean, averaged over the channels
+    std::vector<float> albedo[3];     // Reflectance of the first hit
+    std::vector<float> normal[3];     // Unit normal of the first hit, facing the camera
+    std::vector<float> depth;         // Distance to the first hit, 0 to leave the pixel as it is
+
+    // Filter the pixel window, columns [i0, i1) and rows [j0, j1); pixels
+    // with depth 0 are kept as they are
+    void filter(int i0, int j0, int i1, int j1, int iterations);
+
+private:
+    int width;
+    int height;
+};
+
+#endif // DENOISER_H
@@ -0,0 +1,52 @@
+// DistributedRenderer.h
+#pragma once
+#ifndef DISTRIBUTEDRENDERER_H
+#define DISTRIBUTEDRENDERER_H
+
+#include "RayTracer.h"
+#include "Vector3.h"
+#include <string>
+#include <vector>
+
+/**
+ * @brief Coordinator that renders a frame on a set of render servers.
+ *
+ * The frame (or its crop region) is split into jobs, either square tiles or
+ * ranges of the stratified pixel samples, and handed out to the workers from
+ * a shared queue: a worker that finishes early simply takes the next job.
+ * Workers are render servers (raytracer --serve) reached by Unix socket path
+ * or host:port, and must see the scene JSON under the same path. They return
+ * unresolved radiance sums, which are added up here and resolved with the
+ * coordinator's tone mapping, so a distributed render matches a local one
+ * rendered with the same seed. A job whose worker fails is requeued for the
+ * remaining workers.
+ */
+class DistributedRenderer {
+public:
+    enum SplitMode { SPLIT_TILES, SPLIT_SAMPLES };
+
+    DistributedRenderer(const std::vector<std::string>& workers, const std::string& scenePath);
+
+    void setSplitMode(SplitMode mode);
+
+    // Edge length in pixels of the tiles handed out in SPLIT_TILES mode
+    void setJobSize(int size);
+
+    // Render the region of rayTracer into buffer (row 0 at the bottom); false if any job could not be rendered
+    bool render(RayTracer& rayTracer, std::vector<std::vector<Vector3>>& buffer);
+
+private:
+    struct Job {
+        int x, y, width, height; // Image coordinates, origin top left
+        int firstSample, sampleCount;
+    };
+
+    std::vector<std::string> workers;
+    std::string scenePath;
+    SplitMode splitMode = SPLIT_TILES;
+    int jobSize = 64;
+
+    std::vector<Job> makeJobs(const RayTracer& rayTracer) const;
+};
+
+#endif // DISTRIBUTEDRENDERER_H
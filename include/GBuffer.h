@@ -0,0 +1,75 @@
+// GBuffer.h
+#pragma once
+#ifndef GBUFFER_H
+#define GBUFFER_H
+
+#include "Intersectable.h"
+#include "Material.h"
+#include "Vector3.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Surface attributes of the primary hit of every pixel of a frame.
+ *
+ * Written by the first stage of deferred shading and read by the second. Each
+ * attribute is a separate array, so the shading loops stream through only the
+ * channels they use. Pixel (i, j) is stored at j * width + i, row 0 at the
+ * bottom like the render buffer. materialId indexes the material table of the
+ * pixel's tile, which only lives while the tile is shaded, and is -1 where the
+ * primary ray hit nothing; object stays valid for the whole frame.
+ *
+ * Saved to a relight file, the buffer also carries what is needed to tell
+ * whether a later render may reuse it: the scene settings it was traced with,
+ * a hash of the scene geometry, the render region, and for each light whether
+ * every pixel could see it.
+ */
+class GBuffer {
+public:
+    int width = 0;
+    int height = 0;
+    std::vector<Vector3> position;
+    std::vector<Vector3> normal;
+    std::vector<Vector3> direction;   // Direction of the primary ray
+    std::vector<Real> u, v;           // Texture coordinates, 0 for shapes without any
+    std::vector<Real> depth;          // Ray parameter of the hit, infinity on a miss
+    std::vector<int32_t> materialId;
+    std::vector<const Intersectable*> object; // Primitive hit, null on a miss
+
+    // Shadow ray results, lightCount * width * height bytes stored light by
+    // light; only lights flagged in visibilityValid hold results
+    int lightCount = 0;
+    std::vector<uint8_t> visibility;
+    std::vector<uint8_t> visibilityValid;
+
+    // Provenance
+    std::string sceneSettings;        // Scene file without its shapes, as JSON text
+    uint64_t geometryHash = 0;        // SceneLoader::getGeometryHash of the scene
+    int regionI0 = 0, regionJ0 = 0;   // Pixels traced: columns [regionI0, regionI1)
+    int regionI1 = 0, regionJ1 = 0;   // and rows [regionJ0, regionJ1)
+
+    // Clear the buffer to a width x height frame of misses lit by lightCount lights
+    void reset(int width, int height, int lightCount);
+
+    size_t index(int i, int j) const { return static_cast<size_t>(j) * width + i; }
+
+    // Visibility of a light from a pixel
+    uint8_t& lightVisible(int light, size_t pixel) { return visibility[static_cast<size_t>(light) * width * height + pixel]; }
+
+    // Change the number of lights; the visibility of the first lights is kept
+    void resizeLights(int lightCount);
+
+    // Read a relight file; objects lists the scene's primitives in the order
+    // they were saved in. False (after printing an error) if the file is
+    // missing, invalid or refers to primitives the scene does not have.
+    bool load(const std::string& filename, const std::vector<const Intersectable*>& objects);
+
+    // Write a relight file, saving each primitive as its index in objects
+    bool write(const std::string& filename, const std::vector<const Intersectable*>& objects) const;
+
+    // Index of material in table, appending it if the table holds no equal material
+    static int32_t internMaterial(std::vector<Material>& table, const Material& material);
+};
+
+#endif // GBUFFER_H
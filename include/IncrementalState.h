@@ -0,0 +1,54 @@
+// IncrementalState.h
+#pragma once
+#ifndef INCREMENTALSTATE_H
+#define INCREMENTALSTATE_H
+
+#include "BoundingBox.h"
+#include "Vector3.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief What an incremental render keeps of the frame it finished.
+ *
+ * The radiance of every pixel before tone mapping, so reused pixels are
+ * finished with the next render's tone mapping and exposure. For each pixel
+ * also where its primary ray ended and whether the surface there spawns
+ * reflection or refraction rays, which is enough for the next render to work
+ * out which pixels an edited shape can reach. Shapes are recorded by a hash of their JSON and their bounds, and the
+ * scene settings as JSON text. Pixel (i, j) is stored at j * width + i, row 0
+ * at the bottom like the render buffer.
+ */
+class IncrementalState {
+public:
+    enum PixelFlags : uint8_t {
+        PIXEL_HIT = 1,          // The primary ray hit a surface at position
+        PIXEL_SECONDARY = 2     // That surface is reflective or refractive
+    };
+
+    int width = 0;
+    int height = 0;
+    int regionI0 = 0, regionJ0 = 0;   // Pixels rendered: columns [regionI0, regionI1)
+    int regionI1 = 0, regionJ1 = 0;   // and rows [regionJ0, regionJ1)
+    std::string sceneSettings;        // Scene file without its shapes, as JSON text
+    std::vector<uint64_t> shapeHashes;
+    std::vector<BoundingBox> shapeBounds;
+    std::vector<Vector3> color;       // Radiance before tone mapping and exposure
+    std::vector<Vector3> position;    // Primary hit point
+    std::vector<Real> depth;          // Ray parameter of the primary hit, infinity on a miss
+    std::vector<uint8_t> flags;       // PixelFlags
+
+    // Clear the state to a width x height frame of black misses
+    void reset(int width, int height);
+
+    size_t index(int i, int j) const { return static_cast<size_t>(j) * width + i; }
+
+    // Read a state file; false (after printing an error) if it is missing or invalid
+    bool load(const std::string& filename);
+
+    // Write to a temporary file and rename it over the target
+    bool write(const std::string& filename) const;
+};
+
+#endif // INCREMENTALSTATE_H
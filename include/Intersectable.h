@@ -9,20 +9,23 @@
 #include <functional>
 #include <limits>
 
+class Intersectable;
+
 /**
  * @brief Abstract base class for objects that can be intersected by rays.
  */
 
 struct HitRecord {
-    double t;                 // Ray parameter t at intersection
+    Real t;                 // Ray parameter t at intersection
     Vector3 point;            // Intersection point
     Vector3 normal;           // Surface normal at the intersection
     Material material;        // Material of the intersected object
-    std::function<void(const Vector3&, double&, double&)> getUV; // Function to get UV coordinates
+    const Intersectable* object; // Primitive that was hit
+    std::function<void(const Vector3&, Real&, Real&)> getUV; // Function to get UV coordinates
 
 
     HitRecord()
-        : t(0.0), point(), normal(), material() {}
+        : t(0.0), point(), normal(), material(), object(nullptr) {}
 };
 
 class Intersectable {
@@ -33,6 +36,17 @@ public:
     // Pure virtual function for ray intersection
     virtual bool intersect(const Ray& ray, HitRecord& hitRecord) const = 0;
     virtual BoundingBox getBoundingBox() const = 0;
+
+    // Bounds of the part of the object inside clip, used by spatial splits;
+    // the bounding box cut down to clip unless a shape can do better
+    virtual BoundingBox getClippedBoundingBox(const BoundingBox& clip) const;
+
+    // Material of a primitive; null for aggregates such as BVH nodes
+    virtual const Material* getMaterial() const;
+
+    // Any-hit query for shadow rays: true as soon as a hit closer than
+    // maxDistance is found, with the primitive hit stored in occluder
+    virtual bool occluded(const Ray& ray, Real maxDistance, const Intersectable*& occluder) const;
 };
 
 #endif // INTERSECTABLE_H
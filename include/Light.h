@@ -20,7 +20,7 @@ public:
     virtual ~Light() {}
 
     // For area lights
-    virtual Vector3 sample(const Vector3& point, Vector3& lightDir, double& distance, double& pdf) const;
+    virtual Vector3 sample(const Vector3& point, Vector3& lightDir, Real& distance, Real& pdf) const;
 
     // For point lights
     virtual Vector3 getPosition() const;
@@ -9,13 +9,13 @@
 
 class Material {
 public:
-    double ks;
-    double kd;
+    Real ks;
+    Real kd;
     int specularExponent;
     bool isReflective;
-    double reflectivity;
+    Real reflectivity;
     bool isRefractive;
-    double refractiveIndex;
+    Real refractiveIndex;
     Vector3 diffuseColor;
     Vector3 specularColor;
     
@@ -23,13 +23,13 @@ public:
     std::string texturePath;
     int textureWidth;
     int textureHeight;
-    std::shared_ptr<std::vector<Vector3>> textureData;
+    std::shared_ptr<const Vector3> textureData; // textureWidth * textureHeight texels
 
     // Constructor
     Material();
-    Material(double ks_, double kd_, int specularExponent_,
-             bool isReflective_, double reflectivity_,
-             bool isRefractive_, double refractiveIndex_,
+    Material(Real ks_, Real kd_, int specularExponent_,
+             bool isReflective_, Real reflectivity_,
+             bool isRefractive_, Real refractiveIndex_,
              const Vector3& diffuseColor_, const Vector3& specularColor_,
              bool hasTexture_ = false, const std::string& texturePath_ = "")
         : ks(ks_), kd(kd_), specularExponent(specularExponent_),
@@ -39,16 +39,13 @@ public:
           hasTexture(hasTexture_), texturePath(texturePath_),
           textureWidth(0), textureHeight(0) {
             if (hasTexture) {
-              std::cout << "Loading texture from file: " << texturePath << std::endl;
               loadTexture();
-              std::cout << "Texture loaded successfully." << std::endl;
-
             }
           }
 
-    // Load texture from file
+    // Load texture from file; files shared by several materials are decoded once
     void loadTexture();
-    Vector3 getTextureColor(double u, double v) const;
+    Vector3 getTextureColor(Real u, Real v) const;
 };
 
 #endif // MATERIAL_H
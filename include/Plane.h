@@ -0,0 +1,37 @@
+// Plane.h
+#pragma once
+#ifndef PLANE_H
+#define PLANE_H
+
+#include "Intersectable.h"
+
+/**
+ * @brief An infinite plane through a point, facing along its normal.
+ *
+ * Its bounding box is unbounded, so the scene keeps it out of the BVH and
+ * tests it on its own. Texture coordinates are the position in a tangent frame
+ * of the plane, in tiles of tileSize world units, so a texture repeats over it.
+ */
+class Plane : public Intersectable {
+public:
+    Vector3 point;
+    Vector3 normal;
+    Real tileSize;
+    Material material;
+
+    // Constructor
+    Plane(const Vector3& point, const Vector3& normal, const Material& material, Real tileSize = 1);
+
+    // Ray-plane intersection
+    virtual bool intersect(const Ray& ray, HitRecord& hitRecord) const override;
+    virtual BoundingBox getBoundingBox() const override;
+    virtual const Material* getMaterial() const override { return &material; }
+
+    void getUV(const Vector3& point, Real& u, Real& v) const;
+
+private:
+    Vector3 tangent;    // Direction of increasing u
+    Vector3 bitangent;  // Direction of increasing v
+};
+
+#endif // PLANE_H
@@ -0,0 +1,93 @@
+// Profiler.h
+#pragma once
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Hot-path zones timed by the profiler.
+ *
+ * Zones are aggregated (call count, inclusive and self time) per thread rather
+ * than logged individually, so they can wrap functions called millions of times.
+ */
+enum class ProfileZone {
+    SceneIntersect,
+    ShadowRay,
+    Shading,
+    TextureLookup,
+    Count
+};
+
+/**
+ * @brief Built-in instrumentation, compiled in with -DRT_PROFILE (make PROFILE=1).
+ *
+ * Each thread records into its own buffer; buffers are merged when exporting.
+ * Coarse scopes (phases, rows, tiles) are also kept as trace events and can be
+ * exported in the Chrome trace-event format (chrome://tracing, Perfetto).
+ */
+class Profiler {
+public:
+    // True when the profiler was compiled in
+    static bool enabled();
+
+    // Nanoseconds since the profiler epoch
+    static uint64_t now();
+
+    // Record a trace event on the calling thread's timeline
+    static void recordEvent(const std::string& name, uint64_t startNs, uint64_t durationNs);
+
+    // Export the merged trace events and zone totals
+    static bool writeChromeTrace(const std::string& filename);
+
+    // Print per-zone totals and what the render appears to be bound by
+    static void printSummary();
+};
+
+/**
+ * @brief Times a hot-path zone, excluding time spent in nested zones from its self time.
+ */
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileZone zone);
+    ~ProfileScope();
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    ProfileZone zone;
+    uint64_t start;
+    uint64_t childNs;
+    ProfileScope* parent;
+};
+
+/**
+ * @brief Records a named trace event covering its lifetime.
+ */
+class TraceScope {
+public:
+    explicit TraceScope(const char* name);
+    ~TraceScope();
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name;
+    uint64_t start;
+};
+
+#define RT_PROFILE_CONCAT_INNER(a, b) a##b
+#define RT_PROFILE_CONCAT(a, b) RT_PROFILE_CONCAT_INNER(a, b)
+
+#ifdef RT_PROFILE
+#define RT_PROFILE_ZONE(zone) ProfileScope RT_PROFILE_CONCAT(profileZone, __LINE__)(zone)
+#define RT_PROFILE_TRACE(name) TraceScope RT_PROFILE_CONCAT(profileTrace, __LINE__)(name)
+#else
+#define RT_PROFILE_ZONE(zone) ((void)0)
+#define RT_PROFILE_TRACE(name) ((void)0)
+#endif
+
+#endif // PROFILER_H
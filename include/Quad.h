@@ -0,0 +1,43 @@
+// Quad.h
+#pragma once
+#ifndef QUAD_H
+#define QUAD_H
+
+#include "Intersectable.h"
+
+/**
+ * @brief A parallelogram spanned by two edges from a corner.
+ *
+ * The hit is found on the quad's plane and accepted when both of its
+ * coordinates along the edges lie in [0, 1], which also serve as texture
+ * coordinates: one texture across the quad, or tiles of tileSize world units
+ * when tileSize is positive. With the position, directions and size of an
+ * area light it gives the light's emitting rectangle.
+ */
+class Quad : public Intersectable {
+public:
+    Vector3 corner;
+    Vector3 edgeU;
+    Vector3 edgeV;
+    Vector3 normal;     // Normalised edgeU x edgeV, unless flipped by the constructor
+    Real tileSize;      // 0 stretches the texture over the whole quad
+    Material material;
+
+    // Constructor; facing is flipped when it points away from normalize(edgeU x edgeV)
+    Quad(const Vector3& corner, const Vector3& edgeU, const Vector3& edgeV, const Material& material,
+         Real tileSize = 0, const Vector3& facing = Vector3(0, 0, 0));
+
+    // Ray-quad intersection
+    virtual bool intersect(const Ray& ray, HitRecord& hitRecord) const override;
+    virtual BoundingBox getBoundingBox() const override;
+    virtual const Material* getMaterial() const override { return &material; }
+    virtual BoundingBox getClippedBoundingBox(const BoundingBox& clip) const override;
+
+    // Texture coordinates of the point at edge coordinates alpha and beta
+    void uvFromEdgeCoordinates(Real alpha, Real beta, Real& u, Real& v) const;
+
+private:
+    Vector3 planeScale; // (edgeU x edgeV) / |edgeU x edgeV|^2, turns cross products into edge coordinates
+};
+
+#endif // QUAD_H
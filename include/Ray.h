@@ -7,17 +7,29 @@
 
 /**
  * @brief A class representing a ray with an origin and direction.
+ *
+ * Besides the ray itself it keeps the per-ray setup of the watertight triangle
+ * test: the axes are permuted so the dominant direction component becomes z,
+ * and shear maps the direction onto +z.
  */
 class Ray {
 public:
     Vector3 origin;
     Vector3 direction;
+    int kx, ky, kz;    // Permuted axes, kz the largest direction component
+    Vector3 shear;     // (-d[kx] / d[kz], -d[ky] / d[kz], 1 / d[kz])
 
     // Constructor
     Ray(const Vector3& origin, const Vector3& direction);
 
     // Compute a point along the ray at parameter t
-    Vector3 at(double t) const;
+    Vector3 at(Real t) const;
 };
 
+// Origin for a ray leaving a surface point on the side the normal points to. The
+// point is moved a fixed number of units in the last place of each coordinate,
+// so the offset grows with the distance from the world origin and covers the
+// rounding error of the hit point at any scene scale.
+Vector3 offsetRayOrigin(const Vector3& point, const Vector3& normal);
+
 #endif // RAY_H
@@ -0,0 +1,34 @@
+// RayBatch.h
+#pragma once
+#ifndef RAYBATCH_H
+#define RAYBATCH_H
+
+#include "Ray.h"
+#include "BoundingBox.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief A ray queued for batched (wavefront) tracing.
+ *
+ * Instead of recursing, shading a batch ray pushes its child rays with the
+ * accumulated weight, and the contribution is added to `pixel` directly.
+ */
+struct BatchRay {
+    Ray ray;
+    Vector3 weight;   // Throughput carried from the primary ray
+    int pixel;        // Index into the tile's colour buffer
+    int depth;        // Recursion depth of this ray
+    uint64_t key;     // Sort key (direction octant + Morton code of origin)
+
+    BatchRay(const Ray& ray_, const Vector3& weight_, int pixel_, int depth_)
+        : ray(ray_), weight(weight_), pixel(pixel_), depth(depth_), key(0) {}
+};
+
+// Compute the coherence key of a ray relative to the scene bounds
+uint64_t rayMortonKey(const Ray& ray, const BoundingBox& bounds);
+
+// Sort a batch of rays by origin cell and direction octant
+void sortRayBatch(std::vector<BatchRay>& rays, const BoundingBox& bounds);
+
+#endif // RAYBATCH_H
@@ -5,6 +5,13 @@
 
 #include "Scene.h"
 #include "Camera.h"
+#include "RayBatch.h"
+#include "RenderCheckpoint.h"
+#include "GBuffer.h"
+#include "IncrementalState.h"
+#include "AovBuffer.h"
+#include <cstdint>
+#include <functional>
 #include <random>
 
 /**
@@ -14,6 +21,12 @@ class RayTracer {
 public:
     enum RenderMode { PHONG, BINARY, PATH_TRACE};
     enum ToneMapping { NONE, REINHARD, WARD, UNCHARTED2 };
+    enum CostMetric { COST_NODES, COST_TESTS, COST_RAYS, COST_TIME };
+
+    // Receives a finished tile: position and size in image coordinates (origin
+    // top left) and its pixels row by row, top row first. Pixels are doubles so
+    // radiance sums keep the precision the coordinator merges them in.
+    using TileCallback = std::function<void(int x, int y, int width, int height, const std::vector<Vec3<double>>& pixels)>;
 
     // Constructor
     RayTracer(Scene* scene, Camera* camera, int imageWidth, int imageHeight);
@@ -22,14 +35,91 @@ public:
     void render(const std::string& filename);
     void renderPathTrace(const std::string& filename);
     void writeImageToPPM(const std::string& filename, const std::vector<std::vector<Vector3>>& buffer);
+
+    // Render the region in tiles of setTileSize, streaming each one to the callback;
+    // with radiance set, tiles hold linear radiance sums of the selected samples
+    void renderTiles(const TileCallback& onTile, bool radiance = false);
+
+    // Finished color of a pixel from the sum of all of its samples' radiance
+    Vector3 resolvePixel(const Vec3<double>& radianceSum) const;
     void setExposure(double e);
     void setMaxDepth(int depth);
     void setRenderMode(RenderMode mode);
     void setToneMap(ToneMapping map);
     void setPixelSample(int n);
     void setLightSample(int n);
+    void setRaySorting(bool enabled);
+
+    // Test the primitive that last blocked a light first when tracing its shadow rays
+    void setOccluderCache(bool enabled);
+
+    // Phong and binary renders: trace each tile's primary hits into a G-buffer,
+    // then shade them grouped by material and light
+    void setDeferredShading(bool enabled);
+
+    // Render deferred and keep the G-buffer in a relight file. A later render
+    // of the same camera and geometry re-shades it with the current lights and
+    // materials instead of tracing primary rays, and reuses the shadow results
+    // of lights whose placement is unchanged. sceneSettings is the scene JSON
+    // without shapes and geometryHash SceneLoader::getGeometryHash.
+    void setRelight(const std::string& filename, const std::string& sceneSettings, uint64_t geometryHash);
+
+    // Render deferred and keep the finished frame in an incremental state file.
+    // A later render with the same settings re-renders only the tiles that the
+    // shapes added, removed or edited since can affect and copies the rest.
+    // shapeHashes and shapeBounds describe the scene's shapes, one entry each.
+    void setIncremental(const std::string& filename, const std::string& sceneSettings,
+                        const std::vector<uint64_t>& shapeHashes, const std::vector<BoundingBox>& shapeBounds);
+    void setTileSize(int size);
+
+    // Filter path-traced renders with this many à-trous passes, guided by the
+    // albedo, normal and depth of the first hits; 0 leaves them unfiltered
+    void setDenoise(int iterations);
+
+    // Write the AOVs of path-traced renders (direct and indirect light, albedo,
+    // normal, depth, object id and sample count) with the beauty image to an
+    // OpenEXR file; checkpointed renders do not record them
+    void setAovs(const std::string& filename);
+
+    // Restrict rendering to a pixel window in image coordinates (origin top left);
+    // a zero width or height selects the whole frame
+    void setRegion(int x, int y, int width, int height);
+
+    // Whether a window has a positive size and overlaps the frame, as a crop must
+    bool isValidRegion(int x, int y, int width, int height) const;
+
+    // Write only the region instead of a full frame with the rest left black
+    void setCropOutput(bool crop);
+
+    // Clipped render region in image coordinates
+    void getRegion(int& x, int& y, int& width, int& height) const;
+
+    // Stratified sample indices traced per pixel by renderTiles in radiance mode;
+    // a negative count means all remaining samples
+    void setSampleRange(int first, int count);
+
+    // Seed of the per-pixel sample sequences; equal seeds give identical renders
+    void setSeed(uint64_t seed);
+
+    // Path trace in progressive passes, saving the accumulation to a checkpoint
+    // file (and the image so far) at most every intervalSeconds and at the end.
+    // sceneHash (see RenderCheckpoint::hashScene) is stored with the sums.
+    void setCheckpoint(const std::string& filename, double intervalSeconds, uint64_t sceneHash);
+
+    // Continue the render stored in a checkpoint; false if it cannot be used
+    // for this frame or was rendered from another scene hash
+    bool resumeFrom(const std::string& filename);
+
+    // Write a per-pixel cost image alongside the render
+    void setHeatmap(const std::string& filename, CostMetric metric);
     int getPixelSamples() const { return pixelSamples; }
     int getLightSamples() const { return lightSamples; }
+    int getImageWidth() const { return imageWidth; }
+    int getImageHeight() const { return imageHeight; }
+    uint64_t getSeed() const { return frameSeed; }
+
+    // Samples actually traced per pixel (the stratified grid is square)
+    int getStratifiedSamples() const;
 
 private:
     Scene* scene;
@@ -38,20 +128,87 @@ private:
     int imageHeight;
     double exposure = 1.0;
     int maxDepth = 5;
-    double shadowBias = 1e-4;
     RenderMode renderMode = PHONG; // Default to PHONG
     ToneMapping toneMapping = NONE; // Default to NONE
-    std::mt19937 rng;
-    std::uniform_real_distribution<double> dist;
+    uint64_t frameSeed; // Seeds Sampler per pixel sample
     int pixelSamples;
     int lightSamples;
-    
+    bool raySorting = false; // Trace secondary rays in sorted per-tile batches
+    bool occluderCache = true;
+    bool deferredShading = false;
+    GBuffer gBuffer; // Primary hits of the last deferred render
+    std::string relightFilename;
+    std::string relightSettings;
+    uint64_t relightGeometryHash = 0;
+    std::string incrementalFilename;
+    IncrementalState incremental; // Shapes and settings of this render, then its frame
+    std::vector<uint8_t> dirtyTiles; // Tiles renderDeferred renders; empty for all
+    int denoiseIterations = 0;
+    std::string aovFilename;
+    AovBuffer aovs; // Sums of the last path-traced render when it writes AOVs or is denoised
+    uint64_t occluderCacheId; // Tells this tracer's entries in the per-thread caches from stale ones
+    int tileSize = 16;
+    int regionX = 0;
+    int regionY = 0;
+    int regionWidth = 0;
+    int regionHeight = 0;
+    bool cropOutput = false;
+    int sampleRangeFirst = 0;
+    int sampleRangeCount = -1;
+    std::string checkpointFilename;
+    double checkpointInterval = 60.0;
+    uint64_t checkpointSceneHash = 0;
+    bool resumed = false;
+    RenderCheckpoint checkpoint;
+    BoundingBox sceneBounds;
+    std::string heatmapFilename;
+    CostMetric costMetric = COST_TIME;
+    std::vector<std::vector<double>> costBuffer;
 
     Vector3 traceRay(const Ray& ray,  int depth);
-    Vector3 traceRayPath(const Ray& ray, int depth);
+    Vector3 traceRayPath(const Ray& ray, int depth, AovSample* aov = nullptr);
     Vector3 computeShadingPhong(const HitRecord& hitRecord, const Ray& ray, int depth);
+    Vector3 computeLocalPhong(const HitRecord& hitRecord, const Ray& ray);
+    Vector3 computeIndirectPhong(const Vector3& point, const Vector3& surfaceNormal, const Material& material,
+                                 const Vector3& direction, int depth, Vector3 localColor);
     Vector3 computeShadingBin();
     Vector3 estimateDirectLight(const HitRecord& hitRecord, const Vector3& viewDir);
+    bool isShadowed(const Ray& shadowRay, Real lightDistance, size_t lightIndex);
+    Vector3 finishPixel(Vector3 color, bool gammaCorrect) const;
+    Vec3<double> samplePixel(int i, int j, int firstSample, int sampleCount, Vec3<double>* squaredSum = nullptr,
+                             bool recordAovs = false);
+    Ray sampleRay(int i, int j, int s, int grid) const;
+    int getSampleGrid() const;
+    void renderProgressive(std::vector<std::vector<Vector3>>& buffer, const std::string& filename);
+    void resolveCheckpoint(std::vector<std::vector<Vector3>>& buffer) const;
+    void denoiseImage(std::vector<std::vector<Vector3>>& buffer);
+    void writeAovs();
+    Vector3 renderPixel(int i, int j);
+    void getRegionBounds(int& i0, int& j0, int& i1, int& j1) const;
+
+    // Per-pixel cost heatmap
+    double sampleCost() const;
+    void resetCostBuffer();
+    void recordPixelCost(int i, int j, double cost);
+    void writeHeatmap();
+
+    // Batched (ray sorting) rendering
+    void renderBatched(std::vector<std::vector<Vector3>>& buffer, bool gammaCorrect);
+    void traceTileBatched(int x0, int y0, int x1, int y1, std::vector<Vector3>& tileColors);
+    void shadeBatchRay(const BatchRay& batchRay, std::vector<BatchRay>& next, std::vector<Vector3>& tileColors);
+    void shadeBatchRayPath(const BatchRay& batchRay, std::vector<BatchRay>& next, std::vector<Vector3>& tileColors);
+
+    // Deferred shading
+    void renderDeferred(std::vector<std::vector<Vector3>>& buffer);
+    void fillGBufferTile(int x0, int y0, int x1, int y1, std::vector<Material>& tileMaterials);
+    void gatherGBufferMaterials(int x0, int y0, int x1, int y1, std::vector<Material>& tileMaterials);
+    bool loadRelight(const std::vector<const Intersectable*>& objects, int i0, int j0, int i1, int j1);
+    void shadeGBufferTile(int x0, int y0, int x1, int y1, const std::vector<Material>& tileMaterials, std::vector<Vector3>& tileColors);
+
+    // Incremental rendering
+    void renderIncremental(std::vector<std::vector<Vector3>>& buffer);
+    bool findDirtyTiles(const IncrementalState& previous, int i0, int j0, int i1, int j1);
+    bool isPixelDirty(const IncrementalState& previous, size_t pixel, int i, int j, const std::vector<BoundingBox>& changed) const;
 };
 
 #endif // RAYTRACER_H
\ No newline at end of file
@@ -0,0 +1,53 @@
+// RenderCheckpoint.h
+#pragma once
+#ifndef RENDERCHECKPOINT_H
+#define RENDERCHECKPOINT_H
+
+#include "Vector3.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Accumulation state of a progressive path-traced render.
+ *
+ * Holds, for every pixel, the number of samples traced so far and the sum and
+ * sum of squares of their radiance, which is enough to resume the render,
+ * resolve the image at any point and estimate its per-pixel variance. The
+ * sample grid and frame seed are kept as well, so resumed passes continue the
+ * same sample sequence, along with a hash of the scene the sums belong to. Pixel (i, j) is stored at j * width + i, row 0 at the
+ * bottom like the render buffer.
+ */
+class RenderCheckpoint {
+public:
+    int width = 0;
+    int height = 0;
+    int sampleGrid = 1;    // Stratification grid edge; sample s covers cell (s % grid, (s / grid) % grid)
+    uint64_t seed = 0;
+    uint64_t sceneHash = 0;  // See hashScene
+    std::vector<uint32_t> sampleCount;
+    // Sums are kept in double whatever the precision of Vector3, so the
+    // variance of a long render is not lost to cancellation
+    std::vector<Vec3<double>> radianceSum;
+    std::vector<Vec3<double>> radianceSquaredSum;
+
+    // Start an empty accumulation for a width x height frame
+    void reset(int width, int height, int sampleGrid, uint64_t seed, uint64_t sceneHash);
+
+    // Read a checkpoint file; false (after printing an error) if it is missing or invalid
+    bool load(const std::string& filename);
+
+    // Write to a temporary file and rename it over the target
+    bool write(const std::string& filename) const;
+
+    // Smallest sample count of the given pixel window, columns [i0, i1) and rows [j0, j1)
+    uint32_t minSampleCount(int i0, int j0, int i1, int j1) const;
+
+    // Variance of the mean of a pixel, averaged over its color channels
+    double meanVariance(size_t pixel) const;
+
+    // FNV-1a hash identifying a scene: its settings text and the hash of its shapes
+    static uint64_t hashScene(const std::string& settings, uint64_t shapesHash);
+};
+
+#endif // RENDERCHECKPOINT_H
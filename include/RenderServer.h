@@ -0,0 +1,61 @@
+// RenderServer.h
+#pragma once
+#ifndef RENDERSERVER_H
+#define RENDERSERVER_H
+
+#include "nlohmann/json.hpp"
+#include "Socket.h"
+#include <map>
+#include <memory>
+#include <string>
+
+using json = nlohmann::json;
+
+/**
+ * @brief Long-running render server listening on a Unix domain socket or TCP port.
+ *
+ * Scenes stay resident between jobs, including their primitives, textures and
+ * BVH. A scene is reloaded only when its JSON file changes. Clients send one
+ * JSON request per line:
+ *
+ *   {"scene": "scenes/final.json", "width": 320, "height": 240,
+ *    "camera": {"position": [0, 1, 5]}, "pixelsample": 4, "lightsample": 2,
+ *    "region": [x, y, width, height], "tilesize": 32, "tonemap": "reinhard",
+ *    "seed": 7, "samples": [first, count], "format": "rgb8" | "radiance"}
+ *   {"command": "status"} | {"command": "unload", "scene": ...} | {"command": "shutdown"}
+ *
+ * Every field except "scene" is optional. "camera" is merged into the
+ * scene's camera. Replies are JSON lines as well. A render job answers with
+ * "begin", then one "tile" line per finished tile, then "done". Each tile
+ * line is followed by "bytes" bytes of 8-bit RGB, rows top to bottom. With
+ * "format": "radiance" a tile instead carries three native-endian doubles per
+ * pixel: the unresolved sum over the job's sample range, which a coordinator
+ * adds up across workers (see DistributedRenderer).
+ * Failures are reported as {"type": "error", "message": ...}.
+ */
+class RenderServer {
+public:
+    // Address is a Unix domain socket path or a TCP host:port; ":port" listens
+    // on loopback only, other interfaces need an explicit host such as 0.0.0.0
+    explicit RenderServer(const std::string& address);
+    ~RenderServer();
+
+    // Serve connections until a shutdown request; false if the socket could not be opened
+    bool run();
+
+private:
+    struct ResidentScene;
+
+    std::string address;
+    bool running;
+    std::map<std::string, std::unique_ptr<ResidentScene>> scenes;
+
+    // Loaded scene for a JSON path, (re)loading it if needed; nullptr and an error message on failure
+    ResidentScene* getScene(const std::string& path, std::string& error);
+
+    void serveConnection(SocketConnection& connection);
+    void handleRequest(SocketConnection& connection, const json& request);
+    void renderJob(SocketConnection& connection, const json& job);
+};
+
+#endif // RENDERSERVER_H
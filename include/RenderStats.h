@@ -0,0 +1,87 @@
+// RenderStats.h
+#pragma once
+#ifndef RENDERSTATS_H
+#define RENDERSTATS_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Ray and traversal counters gathered while rendering.
+ *
+ * Each thread increments its own copy (see RenderStats::local) so the hot
+ * paths never share a cache line; the copies are summed by RenderStats::total.
+ * The increments are compiled in with -DRT_STATS (make STATS=1) and the
+ * counters stay zero otherwise.
+ */
+struct RenderCounters {
+    uint64_t primaryRays = 0;
+    uint64_t secondaryRays = 0;
+    uint64_t shadowRays = 0;
+    uint64_t shadowCacheHits = 0;   // Shadow rays answered by the light's cached occluder
+    uint64_t bvhNodeVisits = 0;
+    uint64_t bvhLeafVisits = 0;
+    uint64_t primitiveTests = 0;
+
+    RenderCounters& operator+=(const RenderCounters& other);
+    uint64_t totalRays() const { return primaryRays + secondaryRays + shadowRays; }
+};
+
+/**
+ * @brief Process wide render statistics: per-thread counters and phase timings.
+ */
+class RenderStats {
+public:
+    // True when the counters were compiled in
+    static bool enabled();
+
+    // Counters of the calling thread
+    static RenderCounters& local();
+
+    // Sum of the counters of all threads, including threads that have exited
+    static RenderCounters total();
+
+    // Record the duration of a named phase (parse, bvh, render, ...)
+    static void addPhase(const std::string& name, double milliseconds);
+    static double getPhase(const std::string& name);
+    static const std::vector<std::pair<std::string, double>>& getPhases();
+
+    // Peak resident set size of the process in kilobytes (0 if unavailable)
+    static long peakRSSKilobytes();
+
+    // Write counters, phases and derived rates as JSON
+    static bool writeJSON(const std::string& filename, const std::string& sceneName);
+
+    // Print a short summary to stdout
+    static void printSummary();
+};
+
+/**
+ * @brief Records the time between construction and stop() (or destruction) as a phase.
+ */
+class PhaseTimer {
+public:
+    explicit PhaseTimer(const std::string& name);
+    ~PhaseTimer();
+
+    // Stop the timer and record the phase; returns the elapsed milliseconds
+    double stop();
+
+private:
+    std::string name;
+    std::chrono::high_resolution_clock::time_point start;
+    uint64_t traceStart;
+    bool stopped;
+};
+
+// Counter increments for the hot paths; without RT_STATS they compile to nothing
+#ifdef RT_STATS
+#define RT_STAT(counter) (RenderStats::local().counter++)
+#else
+#define RT_STAT(counter) ((void)0)
+#endif
+
+#endif // RENDERSTATS_H
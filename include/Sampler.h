@@ -0,0 +1,43 @@
+// Sampler.h
+#pragma once
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <cstdint>
+
+/**
+ * @brief Per-thread random numbers for the renderer.
+ *
+ * The state is reseeded from (frame seed, pixel, sample) before each camera
+ * sample, so the random sequence of a sample does not depend on which thread
+ * or process renders it. Rendering a frame in tiles or sample ranges, on one
+ * machine or several, therefore gives the same result as rendering it in one go.
+ */
+class Sampler {
+public:
+    static void seed(uint64_t frameSeed, uint64_t pixel, uint64_t sample) {
+        state() = mix(mix(frameSeed + pixel * 0x9E3779B97F4A7C15ULL) + sample * 0xD1B54A32D192ED03ULL);
+    }
+
+    // Uniform random number in [0, 1)
+    static double next() {
+        uint64_t& value = state();
+        value += 0x9E3779B97F4A7C15ULL;
+        return static_cast<double>(mix(value) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+private:
+    static uint64_t& state() {
+        thread_local uint64_t value = 0x853C49E6748FEA9BULL;
+        return value;
+    }
+
+    // SplitMix64 finaliser
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+};
+
+#endif // SAMPLER_H
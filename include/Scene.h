@@ -15,23 +15,40 @@
 class Scene {
 public:
     Vector3 backgroundColor;
-    std::vector<std::shared_ptr<Intersectable>> objects;
+    std::vector<std::shared_ptr<Intersectable>> objects;          // Bounded objects, the ones in the BVH
+    std::vector<std::shared_ptr<Intersectable>> unboundedObjects; // Infinite planes, tested after the BVH
     // std::vector<Light> lights;
     std::vector<std::shared_ptr<Light>> lights;
     std::shared_ptr<BVHNode> bvhRoot;
+    std::shared_ptr<Intersectable> wideBVH; // bvhRoot collapsed to bvhWidth children per node
+    int bvhWidth = 8;                        // 2 traverses bvhRoot itself, 4 or 8 a WideBVH
+    int bvhQuantization = 0;                 // Bits per WideBVH child bound: 0 (uncompressed), 8 or 16
+    bool bvhSpatialSplits = false;           // Build bvhRoot with SpatialSplitBVH instead of median splits
+    Real bvhSplitBudget = 0.3;               // References spatial splits may add, as a fraction of the objects
+    size_t bvhSplitReferences = 0;           // References the spatial splits of the last buildBVH added
 
     // Constructor
     Scene(const Vector3& backgroundColor);
 
-    // Add objects and lights to the scene
+    // Add objects and lights to the scene; objects with an infinite bounding box go to unboundedObjects
     void addObject(std::shared_ptr<Intersectable> object);
     void addLight(std::shared_ptr<Light> light);
 
     // Find the closest intersection of a ray with the scene
     bool intersect(const Ray& ray, HitRecord& hitRecord) const;
 
+    // Whether anything lies on the ray closer than maxDistance; the primitive
+    // found is stored in occluder. Stops at the first hit, for shadow rays.
+    bool occluded(const Ray& ray, Real maxDistance, const Intersectable*& occluder) const;
+
     // Build the BVH
     void buildBVH();
+
+    // Collapse bvhRoot into the wide BVH used for traversal
+    void collapseBVH();
+
+    // Bounding box enclosing every object in the scene
+    BoundingBox getBounds() const;
 };
 
 
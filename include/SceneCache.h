@@ -0,0 +1,63 @@
+// SceneCache.h
+#pragma once
+#ifndef SCENECACHE_H
+#define SCENECACHE_H
+
+#include "Scene.h"
+#include "nlohmann/json.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+using json = nlohmann::json;
+
+struct MappedFile;
+struct CacheHeader;
+
+/**
+ * @brief Binary scene cache holding everything that is slow to rebuild from JSON.
+ *
+ * The cache stores the parsed primitives, the material table, texture texels,
+ * the flattened BVH and the scene settings (the JSON minus its shapes), along
+ * with the canonical path, size and modification time of the scene file it was
+ * built from. The file is versioned and every section is 64-byte aligned. It
+ * is memory-mapped and texels are used in place. Primitives and BVH nodes are
+ * re-linked straight from the mapped arrays, with no parsing, sorting or
+ * bounds computation.
+ */
+class SceneCache {
+public:
+    SceneCache();
+
+    // Map a cache file and validate it; false if it is missing, from another
+    // format version, corrupt, or one of its textures has changed since
+    bool open(const std::string& filename);
+
+    // True when the cache was built from this scene file, compared by canonical path
+    bool isBuiltFrom(const std::string& sourceFilename) const;
+
+    // True when the cache was built from this scene file and the file still
+    // has the size and modification time it had then
+    bool matchesSource(const std::string& sourceFilename) const;
+
+    // Hash of the shapes array the cache was built from (see SceneLoader)
+    uint64_t getShapesHash() const;
+
+    // Scene JSON stored with the cache, with an empty "shapes" array
+    json getSettings() const;
+
+    // Add the cached primitives to the scene and attach the cached BVH, if any
+    void populate(Scene& scene) const;
+
+    // Serialise the scene's objects and BVH, recording the scene file they came
+    // from; written to a temporary file and renamed
+    static bool write(const std::string& filename, const Scene& scene, const json& settings, uint64_t shapesHash,
+                      const std::string& sourceFilename);
+
+private:
+    std::string filename;
+    std::shared_ptr<MappedFile> file;
+    const CacheHeader* header;
+};
+
+#endif // SCENECACHE_H
@@ -0,0 +1,76 @@
+// SceneLoader.h
+#pragma once
+#ifndef SCENELOADER_H
+#define SCENELOADER_H
+
+#include "Scene.h"
+#include "Camera.h"
+#include "Intersectable.h"
+#include "Material.h"
+#include "RayTracer.h"
+#include "nlohmann/json.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using json = nlohmann::json;
+
+/**
+ * @brief Streaming scene loader.
+ *
+ * The scene file is read with a SAX parser. Everything except the shapes
+ * array is built into a small settings DOM. The shapes never become JSON:
+ * the keys of each shape and of its material are recorded straight from the
+ * parser's events as flat fields of numbers, flags and strings, and handed
+ * off in chunks to OpenMP tasks, which construct the primitives while the
+ * parser keeps reading. Only the fields of a chunk are alive at a time, so
+ * memory no longer grows with the size of the file.
+ */
+class SceneLoader {
+public:
+    SceneLoader();
+
+    // Parse the scene file; returns false (after printing an error) on failure
+    bool load(const std::string& filename);
+
+    // Skip the shapes array entirely (settings, camera and lights only)
+    void setSkipShapes(bool skip);
+
+    // Number of shapes handed to each construction task
+    void setChunkSize(size_t size);
+
+    // The scene JSON with an empty "shapes" array
+    const json& getSettings() const;
+
+    // Constructed primitives, in file order
+    const std::vector<std::shared_ptr<Intersectable>>& getObjects() const;
+
+    // Hash of the shapes array content, also computed when the shapes are skipped
+    uint64_t getShapesHash() const;
+
+    // Hash of the shapes array without their materials; equal when only materials changed
+    uint64_t getGeometryHash() const;
+
+    // Hash of each constructed primitive's shape JSON, in the order of getObjects();
+    // empty when the shapes are skipped
+    const std::vector<uint64_t>& getShapeHashes() const;
+
+private:
+    json settings;
+    std::vector<std::shared_ptr<Intersectable>> objects;
+    bool skipShapes;
+    size_t chunkSize;
+    uint64_t shapesHash;
+    uint64_t geometryHash;
+    std::vector<uint64_t> shapeHashes;
+};
+
+Scene parseSceneSettings(const json& sceneJson, int& maxDepth, std::string& renderMode, Vector3& backgroundColor);
+Camera parseCamera(const json& cameraJson, int& imageWidth, int& imageHeight, double& exposure);
+void parseLights(const json& lightsJson, Scene& scene);
+// Throws std::invalid_argument for a malformed crop or one outside the frame
+RayTracer::RenderMode configureRayTracer(RayTracer& rayTracer, const json& sceneJson, const std::string& renderMode, int maxDepth, double exposure);
+RayTracer::ToneMapping parseToneMapping(const std::string& name);
+
+#endif // SCENELOADER_H
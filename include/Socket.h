@@ -0,0 +1,63 @@
+// Socket.h
+#pragma once
+#ifndef SOCKET_H
+#define SOCKET_H
+
+#include "nlohmann/json.hpp"
+#include <memory>
+#include <string>
+
+using json = nlohmann::json;
+
+/**
+ * @brief Connected stream socket carrying newline-delimited JSON messages.
+ *
+ * Addresses are either a filesystem path (Unix domain socket) or host:port
+ * (TCP). Binary payloads can follow a message and are read with readExact.
+ */
+class SocketConnection {
+public:
+    explicit SocketConnection(int fd);
+    ~SocketConnection();
+
+    SocketConnection(const SocketConnection&) = delete;
+    SocketConnection& operator=(const SocketConnection&) = delete;
+
+    // Connect to a server; nullptr (after printing an error) on failure
+    static std::unique_ptr<SocketConnection> connect(const std::string& address);
+
+    // Each returns false once the peer has gone away
+    bool sendAll(const char* data, size_t size);
+    bool sendLine(const json& message);
+    bool readLine(std::string& line);
+    bool readExact(char* data, size_t size);
+
+private:
+    int fd;
+    std::string pending; // Received bytes not consumed yet
+};
+
+/**
+ * @brief Listening socket on a Unix domain path or a TCP host:port.
+ */
+class SocketListener {
+public:
+    SocketListener();
+    ~SocketListener();
+
+    // Bind and listen; false (after printing an error) on failure. A TCP
+    // address with an empty host (":port") listens on loopback only.
+    bool open(const std::string& address);
+
+    // Wait for the next client; nullptr if the listener failed
+    std::unique_ptr<SocketConnection> accept();
+
+private:
+    int fd;
+    std::string unixPath; // Removed again when the listener closes
+};
+
+// True for host:port addresses, false for Unix domain socket paths
+bool isTcpAddress(const std::string& address);
+
+#endif // SOCKET_H
@@ -0,0 +1,58 @@
+// SpatialSplitBVH.h
+#pragma once
+#ifndef SPATIALSPLITBVH_H
+#define SPATIALSPLITBVH_H
+
+#include "BVHNode.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Builder of a spatial-split BVH (SBVH, Stich, Friedrich and Dietrich 2009).
+ *
+ * Every node is split where the surface area heuristic is lowest, either by
+ * partitioning its objects (a sweep over their sorted centroids) or by a plane
+ * that cuts the objects straddling it into one reference on each side. The
+ * spatial split is only tried where the children of the best object split
+ * overlap, and only while the references added by splitting stay within the
+ * duplication budget, a fraction of the object count. The result is a plain
+ * BVHNode tree with one reference per leaf, bounded by the clipped box of its
+ * part of the object, so a huge or long thin primitive no longer widens every
+ * node it passes through.
+ */
+class SpatialSplitBVH {
+public:
+    SpatialSplitBVH(const std::vector<std::shared_ptr<Intersectable>>& objects, Real duplicationBudget);
+
+    std::shared_ptr<BVHNode> build();
+
+    // References in the leaves of the last build; the object count plus the duplicates
+    size_t getReferenceCount() const { return referenceCount; }
+
+private:
+    struct Reference {
+        uint32_t object;
+        BoundingBox box;    // Bounds of the part of the object this reference covers
+    };
+
+    struct Split {
+        Real cost;
+        int axis;
+        size_t index;       // Object split: references [0, index) go left once sorted on axis
+        Real position;      // Spatial split: plane on axis
+        bool spatial;
+    };
+
+    const std::vector<std::shared_ptr<Intersectable>>& objects;
+    size_t remainingDuplicates;
+    size_t referenceCount = 0;
+
+    std::shared_ptr<BVHNode> buildNode(std::vector<Reference>& references, int depth);
+    Split findObjectSplit(std::vector<Reference>& references, BoundingBox& leftBox, BoundingBox& rightBox) const;
+    Split findSpatialSplit(const std::vector<Reference>& references, const BoundingBox& bounds) const;
+    void splitObjects(std::vector<Reference>& references, const Split& split, std::vector<Reference>& left, std::vector<Reference>& right) const;
+    void splitSpatially(std::vector<Reference>& references, const Split& split, std::vector<Reference>& left, std::vector<Reference>& right);
+};
+
+#endif // SPATIALSPLITBVH_H
@@ -11,17 +11,18 @@
 class Sphere : public Intersectable {
 public:
     Vector3 center;
-    double radius;
+    Real radius;
     Material material;
 
     // Constructor
-    Sphere(const Vector3& center, double radius, const Material& material);
+    Sphere(const Vector3& center, Real radius, const Material& material);
 
     // Ray-sphere intersection
     virtual bool intersect(const Ray& ray, HitRecord& hitRecord) const override;
     virtual BoundingBox getBoundingBox() const override;
+    virtual const Material* getMaterial() const override { return &material; }
     
-    void getUV(const Vector3& point, double& u, double& v) const;
+    void getUV(const Vector3& point, Real& u, Real& v) const;
 };
 
 #endif // SPHERE_H
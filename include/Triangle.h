@@ -7,6 +7,10 @@
 
 /**
  * @brief A class representing a triangle in the scene.
+ *
+ * The watertight test only needs the vertices; its ray-dependent axis order
+ * and shear are computed once per ray. A hit keeps its barycentric
+ * coordinates, from which getUV answers without any geometry.
  */
 class Triangle : public Intersectable {
 public:
@@ -19,8 +23,13 @@ public:
     // Ray-triangle intersection
     virtual bool intersect(const Ray& ray, HitRecord& hitRecord) const override;
     virtual BoundingBox getBoundingBox() const override;
+    virtual const Material* getMaterial() const override { return &material; }
+    virtual BoundingBox getClippedBoundingBox(const BoundingBox& clip) const override;
 
-    void getUV(const Vector3& point, double& u, double& v) const;
+    void getUV(const Vector3& point, Real& u, Real& v) const;
+
+    // Texture coordinates of the point with barycentric weights b1 (v1) and b2 (v2)
+    static void uvFromBarycentrics(Real b1, Real b2, Real& u, Real& v);
 
 private:
     Vector3 normal;
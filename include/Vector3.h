@@ -3,89 +3,220 @@
 #ifndef VECTOR3_H
 #define VECTOR3_H
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 
+// Scalar type of geometry, traversal and shading. Single precision halves the
+// size of rays, boxes and primitives; build with make PRECISION=double
+// (RT_DOUBLE_PRECISION) for the double-precision renderer.
+#ifdef RT_DOUBLE_PRECISION
+using Real = double;
+#else
+using Real = float;
+#endif
+
+// The vector math is called from every intersection test, so it is inlined
+// even in unoptimised builds rather than left to the optimiser's judgement
+#if defined(_MSC_VER)
+#define RT_INLINE __forceinline
+#else
+#define RT_INLINE inline __attribute__((always_inline))
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define RT_HAS_SSE 1
+#include <emmintrin.h>
+#endif
+
+// make VECTOR=padded (RT_PADDED_VECTOR) pads vectors to four aligned lanes, so
+// single-precision vectors are loaded and stored as one SSE register
+#if defined(RT_PADDED_VECTOR) && defined(RT_HAS_SSE)
+#define RT_VECTOR_SSE 1
+#endif
+
+#ifdef RT_PADDED_VECTOR
+#define RT_VECTOR_ALIGN(T) alignas(4 * sizeof(T))
+#else
+#define RT_VECTOR_ALIGN(T)
+#endif
+
 /**
- * @brief A class representing a 3D vector or point.
+ * @brief A class representing a 3D vector or point with components of type T.
+ *
+ * Everything is defined here so that the arithmetic inlines into the hot loops
+ * of the intersection tests. With RT_PADDED_VECTOR a fourth, unused lane pads
+ * the vector to 16 (float) or 32 (double) aligned bytes.
  */
-class Vector3 {
+template <typename T>
+class RT_VECTOR_ALIGN(T) Vec3 {
 public:
-    double x, y, z;
+    T x, y, z;
+#ifdef RT_PADDED_VECTOR
+    T w; // Padding lane, not part of the value
+#endif
 
     // Constructors
-    Vector3();
-    Vector3(double scalar);
-    Vector3(double x, double y, double z);
+#ifdef RT_PADDED_VECTOR
+    constexpr Vec3() : x(0), y(0), z(0), w(0) {}
+    constexpr Vec3(T scalar) : x(scalar), y(scalar), z(scalar), w(0) {}
+    constexpr Vec3(T x, T y, T z) : x(x), y(y), z(z), w(0) {}
+#else
+    constexpr Vec3() : x(0), y(0), z(0) {}
+    constexpr Vec3(T scalar) : x(scalar), y(scalar), z(scalar) {}
+    constexpr Vec3(T x, T y, T z) : x(x), y(y), z(z) {}
+#endif
+
+    // Conversion between precisions
+    template <typename U>
+    constexpr explicit Vec3(const Vec3<U>& v) : Vec3(static_cast<T>(v.x), static_cast<T>(v.y), static_cast<T>(v.z)) {}
 
     // Vector operations
-    Vector3 operator+(const Vector3& v) const;
-    Vector3 operator-(const Vector3& v) const;
-    Vector3 operator*(const Vector3& v) const;
-    Vector3 operator/(const Vector3& v) const;
-    Vector3 operator+(double scalar) const;
-    Vector3 operator-(double scalar) const;
-    Vector3 operator*(double scalar) const;
-    Vector3 operator/(double scalar) const;
-
-
-    Vector3 operator-() const;
-    Vector3& operator+=(const Vector3& v) {
+    RT_INLINE constexpr Vec3 operator+(const Vec3& v) const { return Vec3(x + v.x, y + v.y, z + v.z); }
+    RT_INLINE constexpr Vec3 operator-(const Vec3& v) const { return Vec3(x - v.x, y - v.y, z - v.z); }
+    RT_INLINE constexpr Vec3 operator*(const Vec3& v) const { return Vec3(x * v.x, y * v.y, z * v.z); }
+    RT_INLINE constexpr Vec3 operator/(const Vec3& v) const { return Vec3(x / v.x, y / v.y, z / v.z); }
+    RT_INLINE constexpr Vec3 operator+(T scalar) const { return Vec3(x + scalar, y + scalar, z + scalar); }
+    RT_INLINE constexpr Vec3 operator-(T scalar) const { return Vec3(x - scalar, y - scalar, z - scalar); }
+    RT_INLINE constexpr Vec3 operator*(T scalar) const { return Vec3(x * scalar, y * scalar, z * scalar); }
+    RT_INLINE constexpr Vec3 operator/(T scalar) const { return Vec3(x / scalar, y / scalar, z / scalar); }
+
+    RT_INLINE constexpr Vec3 operator-() const { return Vec3(-x, -y, -z); }
+    RT_INLINE constexpr Vec3& operator+=(const Vec3& v) {
         x += v.x;
         y += v.y;
         z += v.z;
         return *this;
-    };
-    Vector3& operator-=(const Vector3& v) {
+    }
+    RT_INLINE constexpr Vec3& operator-=(const Vec3& v) {
         x -= v.x;
         y -= v.y;
         z -= v.z;
         return *this;
-    };
-    Vector3& operator*=(double scalar) {
+    }
+    RT_INLINE constexpr Vec3& operator*=(T scalar) {
         x *= scalar;
         y *= scalar;
         z *= scalar;
         return *this;
-    };
-    Vector3& operator/=(double scalar) {
+    }
+    RT_INLINE constexpr Vec3& operator/=(T scalar) {
         x /= scalar;
         y /= scalar;
         z /= scalar;
         return *this;
-    };
-    Vector3& operator*=(const Vector3& v) {
+    }
+    RT_INLINE constexpr Vec3& operator*=(const Vec3& v) {
         x *= v.x;
         y *= v.y;
         z *= v.z;
         return *this;
-    };
-    Vector3& operator/=(const Vector3& v) {
+    }
+    RT_INLINE constexpr Vec3& operator/=(const Vec3& v) {
         x /= v.x;
         y /= v.y;
         z /= v.z;
         return *this;
-    };
+    }
 
     // Comparison
-    bool operator==(const Vector3& v) const;
-    bool operator!=(const Vector3& v) const;
+    RT_INLINE constexpr bool operator==(const Vec3& v) const { return x == v.x && y == v.y && z == v.z; }
+    RT_INLINE constexpr bool operator!=(const Vec3& v) const { return !(*this == v); }
 
     // Indexing
-    double& operator[](int index);
-    const double& operator[](int index) const;
-
+    RT_INLINE constexpr T& operator[](int index) { return index == 0 ? x : (index == 1 ? y : z); }
+    RT_INLINE constexpr const T& operator[](int index) const { return index == 0 ? x : (index == 1 ? y : z); }
 
     // Dot and cross products
-    double dot(const Vector3& v) const;
-    Vector3 cross(const Vector3& v) const;
+    RT_INLINE constexpr T dot(const Vec3& v) const { return x * v.x + y * v.y + z * v.z; }
+    RT_INLINE constexpr Vec3 cross(const Vec3& v) const {
+        return Vec3(
+            y * v.z - z * v.y,
+            z * v.x - x * v.z,
+            x * v.y - y * v.x
+        );
+    }
 
     // Magnitude and normalization
-    double length() const;
-    Vector3 normalize() const;
+    RT_INLINE constexpr T lengthSquared() const { return x * x + y * y + z * z; }
+    RT_INLINE T length() const { return std::sqrt(lengthSquared()); }
+    RT_INLINE Vec3 normalize() const {
+        T len = length();
+        return Vec3(x / len, y / len, z / len);
+    }
+
+    // Normalize with one reciprocal square root and three multiplies; for
+    // directions that need not round exactly like normalize()
+    RT_INLINE Vec3 normalizeFast() const;
 
-    // Utility
-    friend std::ostream& operator<<(std::ostream& os, const Vector3& v);
+    // Component-wise helpers
+    RT_INLINE constexpr T maxComponent() const { return std::max(x, std::max(y, z)); }
+    RT_INLINE constexpr T minComponent() const { return std::min(x, std::min(y, z)); }
+    RT_INLINE static constexpr Vec3 min(const Vec3& a, const Vec3& b) {
+        return Vec3(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z));
+    }
+    RT_INLINE static constexpr Vec3 max(const Vec3& a, const Vec3& b) {
+        return Vec3(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z));
+    }
 };
 
+template <typename T>
+RT_INLINE Vec3<T> Vec3<T>::normalizeFast() const {
+    return *this * (T(1) / std::sqrt(lengthSquared()));
+}
+
+#ifdef RT_VECTOR_SSE
+// Padded single-precision vectors: the arithmetic runs on all four lanes at
+// once. The padding lane holds whatever the operation leaves there.
+template <>
+RT_INLINE Vec3<float> Vec3<float>::operator+(const Vec3<float>& v) const {
+    Vec3<float> result;
+    _mm_store_ps(&result.x, _mm_add_ps(_mm_load_ps(&x), _mm_load_ps(&v.x)));
+    return result;
+}
+
+template <>
+RT_INLINE Vec3<float> Vec3<float>::operator-(const Vec3<float>& v) const {
+    Vec3<float> result;
+    _mm_store_ps(&result.x, _mm_sub_ps(_mm_load_ps(&x), _mm_load_ps(&v.x)));
+    return result;
+}
+
+template <>
+RT_INLINE Vec3<float> Vec3<float>::operator*(const Vec3<float>& v) const {
+    Vec3<float> result;
+    _mm_store_ps(&result.x, _mm_mul_ps(_mm_load_ps(&x), _mm_load_ps(&v.x)));
+    return result;
+}
+
+template <>
+RT_INLINE Vec3<float> Vec3<float>::operator*(float scalar) const {
+    Vec3<float> result;
+    _mm_store_ps(&result.x, _mm_mul_ps(_mm_load_ps(&x), _mm_set1_ps(scalar)));
+    return result;
+}
+
+#endif
+
+#ifdef RT_HAS_SSE
+// Reciprocal square root estimate refined by one Newton-Raphson step (~23 bits)
+template <>
+RT_INLINE Vec3<float> Vec3<float>::normalizeFast() const {
+    __m128 lengthSquaredLane = _mm_set_ss(lengthSquared());
+    __m128 estimate = _mm_rsqrt_ss(lengthSquaredLane);
+    __m128 refined = _mm_mul_ss(_mm_mul_ss(_mm_set_ss(0.5f), estimate),
+                                _mm_sub_ss(_mm_set_ss(3.0f), _mm_mul_ss(_mm_mul_ss(lengthSquaredLane, estimate), estimate)));
+    return *this * _mm_cvtss_f32(refined);
+}
+#endif
+
+template <typename T>
+inline std::ostream& operator<<(std::ostream& os, const Vec3<T>& v) {
+    os << '(' << v.x << ", " << v.y << ", " << v.z << ')';
+    return os;
+}
+
+// The renderer's vector type
+using Vector3 = Vec3<Real>;
+
 #endif // VECTOR3_H
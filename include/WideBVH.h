@@ -0,0 +1,78 @@
+// WideBVH.h
+#pragma once
+#ifndef WIDEBVH_H
+#define WIDEBVH_H
+
+#include "BVHNode.h"
+#include "Intersectable.h"
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief A BVH with up to Width children per node, collapsed from the binary BVHNode tree.
+ *
+ * Every node keeps the bounds of its children in structure-of-arrays lanes, so
+ * one pass over the lanes (vectorised by the compiler) tests the ray against
+ * all children at once. Children that are hit are visited nearest first, and
+ * any child whose entry distance is already beyond the closest hit is
+ * skipped. A child is either another node or a primitive of the scene. The
+ * tree is at most maxDepth nodes deep, which bounds the traversal stack;
+ * anything deeper stays a binary BVHNode subtree, held as a primitive.
+ *
+ * With QuantizationBits of 8 or 16 the child bounds are stored compressed
+ * relative to the node's own box: a float origin, a power-of-two scale per
+ * axis and integer offsets rounded outwards, so the decoded boxes always
+ * contain the exact ones. A 4-wide node with 8-bit bounds fills exactly one
+ * 64-byte cache line, against two lines for float bounds.
+ */
+template <int Width, int QuantizationBits = 0>
+class WideBVH : public Intersectable {
+public:
+    // Collapse the binary tree under root; the primitives stay shared with it
+    explicit WideBVH(const BVHNode& root);
+
+    virtual bool intersect(const Ray& ray, HitRecord& hitRecord) const override;
+    virtual bool occluded(const Ray& ray, Real maxDistance, const Intersectable*& occluder) const override;
+    virtual BoundingBox getBoundingBox() const override;
+
+    size_t getNodeCount() const { return nodes.size(); }
+
+private:
+    static constexpr int32_t emptyChild = INT32_MIN;
+    static constexpr int maxDepth = 64;
+    // Siblings left on the stack at each level above the deepest node, plus its children
+    static constexpr int stackSize = maxDepth * (Width - 1) + 1;
+
+    struct alignas(64) Node {
+        Real minX[Width], minY[Width], minZ[Width];
+        Real maxX[Width], maxY[Width], maxZ[Width];
+        int32_t child[Width];  // Node index, ~primitive index when negative, or emptyChild
+        bool hasPrimitives;
+    };
+
+    using Quantum = std::conditional_t<QuantizationBits == 16, uint16_t, uint8_t>;
+
+    // Child box lane = origin + quantized offset * 2^exponent, per axis
+    struct alignas(64) QuantizedNode {
+        float origin[3];
+        int8_t exponent[3];
+        bool hasPrimitives;
+        Quantum minX[Width], minY[Width], minZ[Width];
+        Quantum maxX[Width], maxY[Width], maxZ[Width];
+        int32_t child[Width];
+    };
+
+    using StoredNode = std::conditional_t<QuantizationBits == 0, Node, QuantizedNode>;
+
+    std::vector<StoredNode> nodes;
+    std::vector<std::shared_ptr<Intersectable>> primitives;
+    BoundingBox bounds;
+
+    int32_t collapse(const BVHNode& node, std::vector<Node>& built, int depth);
+    static QuantizedNode quantize(const Node& node);
+    bool traverse(const Ray& ray, HitRecord& hitRecord, Real maxDistance, const Intersectable** occluder) const;
+};
+
+#endif // WIDEBVH_H
@@ -0,0 +1,118 @@
+import argparse
+import json
+import socket
+import sys
+import time
+
+# Client for the render server (raytracer --serve socket_path|host:port): sends one
+# render job, assembles the streamed tiles and writes the frame as a PPM.
+
+
+class ServerConnection:
+    def __init__(self, address):
+        host, _, port = address.rpartition(":")
+        if "/" not in address and port.isdigit():
+            self.sock = socket.create_connection((host or "localhost", int(port)))
+            self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        else:
+            self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self.sock.connect(address)
+        self.pending = b""
+
+    def send(self, request):
+        self.sock.sendall((json.dumps(request) + "\n").encode())
+
+    def read_exact(self, size):
+        while len(self.pending) < size:
+            chunk = self.sock.recv(65536)
+            if not chunk:
+                raise ConnectionError("server closed the connection")
+            self.pending += chunk
+        data, self.pending = self.pending[:size], self.pending[size:]
+        return data
+
+    def read_message(self):
+        while b"\n" not in self.pending:
+            chunk = self.sock.recv(65536)
+            if not chunk:
+                raise ConnectionError("server closed the connection")
+            self.pending += chunk
+        line, self.pending = self.pending.split(b"\n", 1)
+        return json.loads(line)
+
+
+def write_ppm(filename, width, height, pixels):
+    with open(filename, "w") as out:
+        out.write("P3\n%d %d\n255\n" % (width, height))
+        for offset in range(0, len(pixels), 3):
+            out.write("%d %d %d\n" % (pixels[offset], pixels[offset + 1], pixels[offset + 2]))
+
+
+def render(connection, job, output):
+    connection.send(job)
+    frame = None
+    width = height = 0
+    while True:
+        message = connection.read_message()
+        kind = message["type"]
+        if kind == "error":
+            print("Error: " + message["message"], file=sys.stderr)
+            return False
+        if kind == "begin":
+            width, height = message["width"], message["height"]
+            frame = bytearray(width * height * 3)
+        elif kind == "tile":
+            data = connection.read_exact(message["bytes"])
+            row_bytes = message["width"] * 3
+            for row in range(message["height"]):
+                start = ((message["y"] + row) * width + message["x"]) * 3
+                frame[start:start + row_bytes] = data[row * row_bytes:(row + 1) * row_bytes]
+        elif kind == "done":
+            print("Rendered %d tiles (load %.1f ms, render %.1f ms)" %
+                  (message["tiles"], message["load_ms"], message["render_ms"]))
+            write_ppm(output, width, height, frame)
+            return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Send a render job to a running raytracer server")
+    parser.add_argument("--socket", default="/tmp/raytracer.sock", help="Unix socket path or host:port")
+    parser.add_argument("--command", choices=["render", "status", "shutdown"], default="render")
+    parser.add_argument("scene", nargs="?", help="Scene JSON path, as seen by the server")
+    parser.add_argument("output", nargs="?", default="output.ppm")
+    parser.add_argument("--width", type=int)
+    parser.add_argument("--height", type=int)
+    parser.add_argument("--pixelsample", type=int)
+    parser.add_argument("--lightsample", type=int)
+    parser.add_argument("--tilesize", type=int)
+    parser.add_argument("--tonemap")
+    parser.add_argument("--region", help="x,y,width,height in pixels, origin top left")
+    parser.add_argument("--camera", help="JSON object merged into the scene camera")
+    parser.add_argument("--seed", type=int)
+    args = parser.parse_args()
+
+    connection = ServerConnection(args.socket)
+    if args.command != "render":
+        connection.send({"command": args.command})
+        print(json.dumps(connection.read_message(), indent=4))
+        return 0
+    if not args.scene:
+        parser.error("a scene is required for render jobs")
+
+    job = {"scene": args.scene}
+    for key in ("width", "height", "pixelsample", "lightsample", "tilesize", "tonemap", "seed"):
+        if getattr(args, key) is not None:
+            job[key] = getattr(args, key)
+    if args.region:
+        job["region"] = [int(value) for value in args.region.split(",")]
+    if args.camera:
+        job["camera"] = json.loads(args.camera)
+
+    start = time.time()
+    ok = render(connection, job, args.output)
+    print("Round trip: %.1f ms" % ((time.time() - start) * 1000.0))
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,203 @@
+// AovBuffer.cpp
+#include "AovBuffer.h"
+#include "BinaryFile.h"
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+
+const uint32_t exrMagic = 20000630;
+const uint32_t exrVersion = 2;         // Single-part scanline file, no flags
+const uint32_t exrUint = 0;            // Pixel types of the channel list
+const uint32_t exrFloat = 2;
+
+/*
+* Channels of an AOV file, in the sorted order OpenEXR requires of the channel
+* list. Each scanline holds the channels one after another in this order.
+*/
+struct AovChannel {
+    const char* name;
+    uint32_t type;
+};
+
+const AovChannel aovChannels[] = {
+    {"B", exrFloat}, {"G", exrFloat}, {"R", exrFloat}, {"Z", exrFloat},
+    {"albedo.B", exrFloat}, {"albedo.G", exrFloat}, {"albedo.R", exrFloat},
+    {"direct.B", exrFloat}, {"direct.G", exrFloat}, {"direct.R", exrFloat},
+    {"indirect.B", exrFloat}, {"indirect.G", exrFloat}, {"indirect.R", exrFloat},
+    {"normal.X", exrFloat}, {"normal.Y", exrFloat}, {"normal.Z", exrFloat},
+    {"objectId", exrUint}, {"sampleCount", exrUint}
+};
+const size_t aovChannelCount = sizeof(aovChannels) / sizeof(aovChannels[0]);
+
+// OpenEXR files are little-endian whatever the host
+void put32(std::string& bytes, uint32_t value) {
+    for (int k = 0; k < 4; ++k) {
+        bytes.push_back(static_cast<char>((value >> (8 * k)) & 0xff));
+    }
+}
+
+void put64(std::string& bytes, uint64_t value) {
+    put32(bytes, static_cast<uint32_t>(value));
+    put32(bytes, static_cast<uint32_t>(value >> 32));
+}
+
+uint32_t floatBits(double value) {
+    float single = static_cast<float>(value);
+    uint32_t bits;
+    std::memcpy(&bits, &single, sizeof(bits));
+    return bits;
+}
+
+void putAttribute(std::string& header, const char* name, const char* type, const std::string& value) {
+    header += name;
+    header.push_back('\0');
+    header += type;
+    header.push_back('\0');
+    put32(header, static_cast<uint32_t>(value.size()));
+    header += value;
+}
+
+std::string box2i(int xMin, int yMin, int xMax, int yMax) {
+    std::string value;
+    put32(value, static_cast<uint32_t>(xMin));
+    put32(value, static_cast<uint32_t>(yMin));
+    put32(value, static_cast<uint32_t>(xMax));
+    put32(value, static_cast<uint32_t>(yMax));
+    return value;
+}
+
+}
+
+void AovBuffer::reset(int width, int height, int i0, int j0, int i1, int j1) {
+    this->width = width;
+    this->height = height;
+    regionI0 = i0;
+    regionJ0 = j0;
+    regionI1 = i1;
+    regionJ1 = j1;
+    size_t pixels = static_cast<size_t>(width) * height;
+    directSum.assign(pixels, Vec3<double>(0, 0, 0));
+    albedoSum.assign(pixels, Vec3<double>(0, 0, 0));
+    normalSum.assign(pixels, Vec3<double>(0, 0, 0));
+    depthSum.assign(pixels, 0);
+    hitCount.assign(pixels, 0);
+    sampleCount.assign(pixels, 0);
+    object.assign(pixels, nullptr);
+}
+
+void AovBuffer::add(size_t pixel, const AovSample& sample) {
+    directSum[pixel] += Vec3<double>(sample.direct);
+    sampleCount[pixel]++;
+    if (!sample.object)
+        return;
+    albedoSum[pixel] += Vec3<double>(sample.albedo);
+    normalSum[pixel] += Vec3<double>(sample.normal);
+    depthSum[pixel] += sample.depth;
+    hitCount[pixel]++;
+    if (!object[pixel])
+        object[pixel] = sample.object;
+}
+
+bool AovBuffer::write(const std::string& filename, const RenderCheckpoint& checkpoint, double radianceScale,
+                      const std::vector<const Intersectable*>& objects, bool cropped) const {
+    int regionWidth = regionI1 - regionI0;
+    int regionHeight = regionJ1 - regionJ0;
+    if (regionWidth <= 0 || regionHeight <= 0) {
+        std::cerr << "Error: No pixels to write to AOV file " << filename << std::endl;
+        return false;
+    }
+
+    std::unordered_map<const Intersectable*, uint32_t> idOf;
+    idOf.reserve(objects.size());
+    for (size_t k = 0; k < objects.size(); ++k) {
+        idOf[objects[k]] = static_cast<uint32_t>(k + 1);
+    }
+
+    // EXR rows run top to bottom, so pixel row j is line height - 1 - j
+    std::string header;
+    put32(header, exrMagic);
+    put32(header, exrVersion);
+
+    std::string channelList;
+    for (const AovChannel& channel : aovChannels) {
+        channelList += channel.name;
+        channelList.push_back('\0');
+        put32(channelList, channel.type);
+        put32(channelList, 0);     // pLinear and three reserved bytes
+        put32(channelList, 1);     // x and y sampling
+        put32(channelList, 1);
+    }
+    channelList.push_back('\0');
+
+    std::string dataWindow = box2i(regionI0, height - regionJ1, regionI1 - 1, height - 1 - regionJ0);
+    std::string one, center;
+    put32(one, floatBits(1.0));
+    put32(center, floatBits(0.0));
+    put32(center, floatBits(0.0));
+
+    putAttribute(header, "channels", "chlist", channelList);
+    putAttribute(header, "compression", "compression", std::string(1, '\0'));
+    putAttribute(header, "dataWindow", "box2i", dataWindow);
+    putAttribute(header, "displayWindow", "box2i", cropped ? dataWindow : box2i(0, 0, width - 1, height - 1));
+    putAttribute(header, "lineOrder", "lineOrder", std::string(1, '\0'));
+    putAttribute(header, "pixelAspectRatio", "float", one);
+    putAttribute(header, "screenWindowCenter", "v2f", center);
+    putAttribute(header, "screenWindowWidth", "float", one);
+    header.push_back('\0');
+
+    // One uncompressed scanline per chunk, each chunk found through the offset table
+    uint64_t lineBytes = static_cast<uint64_t>(regionWidth) * aovChannelCount * 4;
+    uint64_t chunkBytes = 8 + lineBytes;
+    uint64_t firstChunk = header.size() + static_cast<uint64_t>(regionHeight) * 8;
+    for (int line = 0; line < regionHeight; ++line) {
+        put64(header, firstChunk + line * chunkBytes);
+    }
+
+    return BinaryFile::replace(filename, "AOV file", [&](std::ostream& outFile) {
+        outFile.write(header.data(), header.size());
+
+        std::vector<uint32_t> values(aovChannelCount * regionWidth);
+        std::string chunk;
+        for (int j = regionJ1 - 1; j >= regionJ0; --j) {
+            for (int i = regionI0; i < regionI1; ++i) {
+                size_t pixel = static_cast<size_t>(j) * width + i;
+                uint32_t count = checkpoint.sampleCount[pixel];
+                double scale = count > 0 ? radianceScale / count : 0.0;
+                Vec3<double> beauty = checkpoint.radianceSum[pixel] * scale;
+                Vec3<double> direct = directSum[pixel] * scale;
+                Vec3<double> indirect = beauty - direct;
+
+                uint32_t hits = hitCount[pixel];
+                Vec3<double> albedo = hits > 0 ? albedoSum[pixel] / double(hits) : Vec3<double>(0, 0, 0);
+                Vec3<double> normal = normalSum[pixel];
+                double normalLength = normal.length();
+                if (normalLength > 0)
+                    normal /= normalLength;
+                double depth = hits > 0 ? depthSum[pixel] / hits : 0;
+                uint32_t objectId = object[pixel] ? idOf.at(object[pixel]) : 0;
+
+                uint32_t pixelValues[aovChannelCount] = {
+                    floatBits(beauty.z), floatBits(beauty.y), floatBits(beauty.x), floatBits(depth),
+                    floatBits(albedo.z), floatBits(albedo.y), floatBits(albedo.x),
+                    floatBits(direct.z), floatBits(direct.y), floatBits(direct.x),
+                    floatBits(indirect.z), floatBits(indirect.y), floatBits(indirect.x),
+                    floatBits(normal.x), floatBits(normal.y), floatBits(normal.z),
+                    objectId, count
+                };
+                for (size_t c = 0; c < aovChannelCount; ++c) {
+                    values[c * regionWidth + (i - regionI0)] = pixelValues[c];
+                }
+            }
+
+            chunk.clear();
+            put32(chunk, static_cast<uint32_t>(height - 1 - j));
+            put32(chunk, static_cast<uint32_t>(lineBytes));
+            for (uint32_t value : values) {
+                put32(chunk, value);
+            }
+            outFile.write(chunk.data(), chunk.size());
+        }
+    });
+}
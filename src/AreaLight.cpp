@@ -1,10 +1,9 @@
 #include "AreaLight.h"
+#include "Sampler.h"
 
-Vector3 AreaLight::sample(const Vector3& point, Vector3& lightDir, double& distance, double& pdf) const {
-    std::mt19937 rng(std::random_device{}());
-    std::uniform_real_distribution<double> dist(-0.5, 0.5);
-    double u = dist(rng) * width;
-    double v = dist(rng) * height;
+Vector3 AreaLight::sample(const Vector3& point, Vector3& lightDir, Real& distance, Real& pdf) const {
+    Real u = (Sampler::next() - 0.5) * width;
+    Real v = (Sampler::next() - 0.5) * height;
     Vector3 samplePoint = position + uVec * u + vVec * v;
 
     lightDir = (samplePoint - point);
@@ -12,8 +11,8 @@ Vector3 AreaLight::sample(const Vector3& point, Vector3& lightDir, double& dista
     lightDir = lightDir / distance;
 
 
-    double area = width * height;
-    double cosine = std::max(0.0, normal.dot(-lightDir));
+    Real area = width * height;
+    Real cosine = std::max(Real(0), normal.dot(-lightDir));
     pdf = (distance * distance) / (area * cosine);
 
     return intensity;
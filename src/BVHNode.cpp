@@ -1,8 +1,9 @@
 // BVHNode.cpp
 #include "BVHNode.h"
+#include "RenderStats.h"
 #include <algorithm>
 
-BVHNode::BVHNode() : left(nullptr), right(nullptr), object(nullptr) {}
+BVHNode::BVHNode() : left(nullptr), right(nullptr), object(nullptr), isLeaf(false) {}
 
 BVHNode::BVHNode(const std::vector<std::shared_ptr<Intersectable>>& objects, size_t start, size_t end) {
     // Compute bounding box that contains all objects in this node
@@ -13,6 +14,7 @@ BVHNode::BVHNode(const std::vector<std::shared_ptr<Intersectable>>& objects, siz
     boundingBox = bbox;
 
     size_t objectSpan = end - start;
+    isLeaf = objectSpan <= 2;
 
     if (objectSpan == 1) {
         // Leaf node
@@ -45,7 +47,11 @@ BVHNode::BVHNode(const std::vector<std::shared_ptr<Intersectable>>& objects, siz
 }
 
 bool BVHNode::intersect(const Ray& ray, HitRecord& hitRecord) const {
-    double tNear, tFar;
+    RT_STAT(bvhNodeVisits);
+    if (isLeaf)
+        RT_STAT(bvhLeafVisits);
+
+    Real tNear, tFar;
     if (!boundingBox.intersect(ray, tNear, tFar))
         return false;
 
@@ -80,6 +86,25 @@ bool BVHNode::intersect(const Ray& ray, HitRecord& hitRecord) const {
     }
 }
 
+/*
+* Function to find any hit closer than maxDistance; unlike intersect it stops
+* at the first one and skips nodes the ray only enters beyond maxDistance.
+*/
+bool BVHNode::occluded(const Ray& ray, Real maxDistance, const Intersectable*& occluder) const {
+    RT_STAT(bvhNodeVisits);
+    if (isLeaf)
+        RT_STAT(bvhLeafVisits);
+
+    Real tNear, tFar;
+    if (!boundingBox.intersect(ray, tNear, tFar) || tNear > maxDistance)
+        return false;
+
+    if (object)
+        return object->occluded(ray, maxDistance, occluder);
+    return (left && left->occluded(ray, maxDistance, occluder)) ||
+           (right && right->occluded(ray, maxDistance, occluder));
+}
+
 BoundingBox BVHNode::getBoundingBox() const {
     return boundingBox;
 }
\ No newline at end of file
@@ -0,0 +1,30 @@
+// BinaryFile.cpp
+#include "BinaryFile.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+bool BinaryFile::replace(const std::string& filename, const std::string& description,
+                         const std::function<void(std::ostream&)>& writeContents) {
+    std::string tempFilename = filename + ".tmp";
+    {
+        std::ofstream outFile(tempFilename, std::ios::binary);
+        if (!outFile.is_open()) {
+            std::cerr << "Error: Could not open " << description << " " << tempFilename << std::endl;
+            return false;
+        }
+        writeContents(outFile);
+        if (!outFile) {
+            std::cerr << "Error: Could not write " << description << " " << tempFilename << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tempFilename, filename, error);
+    if (error) {
+        std::cerr << "Error: Could not replace " << description << " " << filename << ": " << error.message() << std::endl;
+        std::filesystem::remove(tempFilename, error);
+        return false;
+    }
+    return true;
+}
@@ -1,6 +1,8 @@
 // BoundingBox.cpp
 #include "BoundingBox.h"
 #include <algorithm>
+#include <cmath>
+#include <limits>
 
 BoundingBox::BoundingBox() : min(Vector3()), max(Vector3()) {}
 
@@ -8,27 +10,17 @@ BoundingBox::BoundingBox(const Vector3& min_, const Vector3& max_)
     : min(min_), max(max_) {}
 
 BoundingBox BoundingBox::merge(const BoundingBox& other) const {
-    Vector3 newMin(
-        std::min(min.x, other.min.x),
-        std::min(min.y, other.min.y),
-        std::min(min.z, other.min.z)
-    );
-    Vector3 newMax(
-        std::max(max.x, other.max.x),
-        std::max(max.y, other.max.y),
-        std::max(max.z, other.max.z)
-    );
-    return BoundingBox(newMin, newMax);
+    return BoundingBox(Vector3::min(min, other.min), Vector3::max(max, other.max));
 }
 
-bool BoundingBox::intersect(const Ray& ray, double& tNear, double& tFar) const {
-    double tmin = (min.x - ray.origin.x) / ray.direction.x;
-    double tmax = (max.x - ray.origin.x) / ray.direction.x;
+bool BoundingBox::intersect(const Ray& ray, Real& tNear, Real& tFar) const {
+    Real tmin = (min.x - ray.origin.x) / ray.direction.x;
+    Real tmax = (max.x - ray.origin.x) / ray.direction.x;
 
     if (tmin > tmax) std::swap(tmin, tmax);
 
-    double tymin = (min.y - ray.origin.y) / ray.direction.y;
-    double tymax = (max.y - ray.origin.y) / ray.direction.y;
+    Real tymin = (min.y - ray.origin.y) / ray.direction.y;
+    Real tymax = (max.y - ray.origin.y) / ray.direction.y;
 
     if (tymin > tymax) std::swap(tymin, tymax);
 
@@ -41,8 +33,8 @@ bool BoundingBox::intersect(const Ray& ray, double& tNear, double& tFar) const {
     if (tymax < tmax)
         tmax = tymax;
 
-    double tzmin = (min.z - ray.origin.z) / ray.direction.z;
-    double tzmax = (max.z - ray.origin.z) / ray.direction.z;
+    Real tzmin = (min.z - ray.origin.z) / ray.direction.z;
+    Real tzmax = (max.z - ray.origin.z) / ray.direction.z;
 
     if (tzmin > tzmax) std::swap(tzmin, tzmax);
 
@@ -64,3 +56,73 @@ bool BoundingBox::intersect(const Ray& ray, double& tNear, double& tFar) const {
 Vector3 BoundingBox::getCenter() const {
     return (min + max) * 0.5;
 }
+
+BoundingBox BoundingBox::overlap(const BoundingBox& other) const {
+    return BoundingBox(Vector3::max(min, other.min), Vector3::min(max, other.max));
+}
+
+Real BoundingBox::getSurfaceArea() const {
+    if (isEmpty())
+        return 0;
+    Vector3 extent = max - min;
+    return 2 * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+bool BoundingBox::isEmpty() const {
+    return min.x > max.x || min.y > max.y || min.z > max.z;
+}
+
+BoundingBox BoundingBox::empty() {
+    Real infinity = std::numeric_limits<Real>::infinity();
+    return BoundingBox(Vector3(infinity), Vector3(-infinity));
+}
+
+/*
+* Function to bound the part of a convex polygon inside a box. The polygon is
+* clipped against the six planes of the box (Sutherland-Hodgman) and the
+* remainder is bounded, padded by a few ulps for the rounding of the clipped
+* vertices.
+*/
+BoundingBox BoundingBox::ofClippedPolygon(const Vector3* vertices, int count, const BoundingBox& clip) {
+    // Every plane adds at most one vertex to the convex polygon
+    Vector3 polygon[16];
+    Vector3 clipped[16];
+    std::copy(vertices, vertices + count, polygon);
+
+    for (int axis = 0; axis < 3; ++axis) {
+        for (int side = 0; side < 2; ++side) {
+            Real plane = side == 0 ? clip.min[axis] : clip.max[axis];
+            int kept = 0;
+            for (int i = 0; i < count; ++i) {
+                const Vector3& a = polygon[i];
+                const Vector3& b = polygon[(i + 1) % count];
+                // Signed distances, positive inside
+                Real da = side == 0 ? a[axis] - plane : plane - a[axis];
+                Real db = side == 0 ? b[axis] - plane : plane - b[axis];
+                if (da >= 0)
+                    clipped[kept++] = a;
+                if ((da >= 0) != (db >= 0)) {
+                    Vector3 crossing = a + (b - a) * (da / (da - db));
+                    crossing[axis] = plane;
+                    clipped[kept++] = crossing;
+                }
+            }
+            count = kept;
+            if (count == 0)
+                return empty();
+            std::copy(clipped, clipped + count, polygon);
+        }
+    }
+
+    BoundingBox bounds(polygon[0], polygon[0]);
+    for (int i = 1; i < count; ++i) {
+        bounds.min = Vector3::min(bounds.min, polygon[i]);
+        bounds.max = Vector3::max(bounds.max, polygon[i]);
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+        Real pad = 4 * std::numeric_limits<Real>::epsilon() * (std::abs(bounds.min[axis]) + std::abs(bounds.max[axis]));
+        bounds.min[axis] -= pad;
+        bounds.max[axis] += pad;
+    }
+    return bounds.overlap(clip);
+}
@@ -7,8 +7,8 @@
 #endif
 
 Camera::Camera(const Vector3& position, const Vector3& lookAt, const Vector3& up,
-               double fov, double aspectRatio,
-               double aperture, double focusDist)
+               Real fov, Real aspectRatio,
+               Real aperture, Real focusDist)
     : position(position), lookAt(lookAt), up(up), fov(fov),
       aspectRatio(aspectRatio), aperture(aperture), focusDist(focusDist) {
 
@@ -20,9 +20,9 @@ Camera::Camera(const Vector3& position, const Vector3& lookAt, const Vector3& up
     v = w.cross(u);
 
     // Convert FOV from degrees to radians
-    double theta = fov * M_PI / 180.0;
-    double halfHeight = tan(theta / 2.0);
-    double halfWidth = aspectRatio * halfHeight;
+    Real theta = fov * M_PI / 180.0;
+    Real halfHeight = tan(theta / 2.0);
+    Real halfWidth = aspectRatio * halfHeight;
 
     // Adjust the lower left corner and spans based on focus distance
     lowerLeftCorner = position - u * halfWidth * focusDist - v * halfHeight * focusDist - w * focusDist;
@@ -30,7 +30,7 @@ Camera::Camera(const Vector3& position, const Vector3& lookAt, const Vector3& up
     vertical = v * 2.0 * halfHeight * focusDist;
 }
 
-Ray Camera::getRay(double s, double t, bool useLens) const {
+Ray Camera::getRay(Real s, Real t, bool useLens) const {
     // Compute the point on the image plane (focal plane)
     Vector3 rd(0, 0, 0);
     Vector3 offset(0, 0, 0);
@@ -0,0 +1,17 @@
+// CpuDispatch.cpp
+#include "CpuDispatch.h"
+
+/*
+* Function to name the clone the loader selects, using the same checks as the
+* target_clones resolver.
+*/
+std::string CpuDispatch::selectedTarget() {
+#ifdef RT_DISPATCH_ENABLED
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return "avx2";
+    return "default";
+#else
+    return "static";
+#endif
+}
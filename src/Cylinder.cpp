@@ -1,5 +1,6 @@
 // Cylinder.cpp
 #include "Cylinder.h"
+#include "RenderStats.h"
 #include <cmath>
 #include <algorithm>
 
@@ -7,10 +8,11 @@
 #define M_PI 3.14159265358979323846
 #endif
 
-Cylinder::Cylinder(const Vector3& baseCenter, const Vector3& axis, double radius, double height, const Material& material, bool hasCaps)
+Cylinder::Cylinder(const Vector3& baseCenter, const Vector3& axis, Real radius, Real height, const Material& material, bool hasCaps)
     : baseCenter(baseCenter), axis(axis.normalize()), radius(radius), height(height), material(material), hasCaps(hasCaps) {}
 
 bool Cylinder::intersect(const Ray& ray, HitRecord& hitRecord) const {
+    RT_STAT(primitiveTests);
     // Compute the vector from the ray origin to the base center
     Vector3 oc = ray.origin - baseCenter;
 
@@ -19,42 +21,36 @@ bool Cylinder::intersect(const Ray& ray, HitRecord& hitRecord) const {
     Vector3 d = ray.direction - axis * ray.direction.dot(axis);
     Vector3 oc_proj = oc - axis * oc.dot(axis);
 
-    double a = d.dot(d);
-    double b = 2.0 * d.dot(oc_proj);
-    double c = oc_proj.dot(oc_proj) - radius * radius;
+    Real a = d.dot(d);
+    Real halfB = d.dot(oc_proj);
+    Real c = oc_proj.dot(oc_proj) - radius * radius;
 
-    double discriminant = b * b - 4 * a * c;
+    Real discriminant = halfB * halfB - a * c;
 
-    double t = INFINITY;
+    Real t = INFINITY;
     Vector3 normal;
+    Vector3 point;
     bool hit = false;
 
     // Check intersection with the cylindrical surface
-    if (discriminant >= 0) {
-        double sqrtDisc = std::sqrt(discriminant);
-        double t0 = (-b - sqrtDisc) / (2 * a);
-        double t1 = (-b + sqrtDisc) / (2 * a);
+    if (discriminant >= 0 && a > 0) {
+        // Stable roots, as in Sphere::intersect
+        Real q = -halfB - std::copysign(std::sqrt(discriminant), halfB);
+        Real t0 = c / q;
+        Real t1 = q / a;
 
         // Swap if necessary
         if (t0 > t1) std::swap(t0, t1);
 
-        // Check t0
-        double y0 = (ray.origin + ray.direction * t0 - baseCenter).dot(axis);
-        if (t0 >= 0 && y0 >= 0 && y0 <= height) {
-            t = t0;
-            Vector3 p = ray.at(t);
-            Vector3 n = (p - baseCenter - axis * y0).normalize();
-            normal = n;
-            hit = true;
-        } else {
-            // Check t1
-            double y1 = (ray.origin + ray.direction * t1 - baseCenter).dot(axis);
-            if (t1 >= 0 && y1 >= 0 && y1 <= height) {
-                t = t1;
-                Vector3 p = ray.at(t);
-                Vector3 n = (p - baseCenter - axis * y1).normalize();
-                normal = n;
+        for (Real root : {t0, t1}) {
+            Real y = (ray.origin + ray.direction * root - baseCenter).dot(axis);
+            if (root >= 0 && y >= 0 && y <= height) {
+                // Project the hit back onto the surface, so its error does not grow with t
+                t = root;
+                normal = (ray.at(t) - baseCenter - axis * y).normalize();
+                point = baseCenter + axis * y + normal * radius;
                 hit = true;
+                break;
             }
         }
     }
@@ -62,7 +58,7 @@ bool Cylinder::intersect(const Ray& ray, HitRecord& hitRecord) const {
     // Check intersection with the caps if necessary
     if (hasCaps) {
         // Bottom cap
-        double t_cap_bottom = (baseCenter - ray.origin).dot(axis) / ray.direction.dot(axis);
+        Real t_cap_bottom = (baseCenter - ray.origin).dot(axis) / ray.direction.dot(axis);
         if (t_cap_bottom >= 0) {
             Vector3 p = ray.at(t_cap_bottom);
             Vector3 d = p - baseCenter;
@@ -70,6 +66,7 @@ bool Cylinder::intersect(const Ray& ray, HitRecord& hitRecord) const {
                 if (t_cap_bottom < t) {
                     t = t_cap_bottom;
                     normal = -axis;
+                    point = p - axis * d.dot(axis);
                     hit = true;
                 }
             }
@@ -77,7 +74,7 @@ bool Cylinder::intersect(const Ray& ray, HitRecord& hitRecord) const {
 
         // Top cap
         Vector3 topCenter = baseCenter + axis * height;
-        double t_cap_top = (topCenter - ray.origin).dot(axis) / ray.direction.dot(axis);
+        Real t_cap_top = (topCenter - ray.origin).dot(axis) / ray.direction.dot(axis);
         if (t_cap_top >= 0) {
             Vector3 p = ray.at(t_cap_top);
             Vector3 d = p - topCenter;
@@ -85,6 +82,7 @@ bool Cylinder::intersect(const Ray& ray, HitRecord& hitRecord) const {
                 if (t_cap_top < t) {
                     t = t_cap_top;
                     normal = axis;
+                    point = p - axis * d.dot(axis);
                     hit = true;
                 }
             }
@@ -93,11 +91,12 @@ bool Cylinder::intersect(const Ray& ray, HitRecord& hitRecord) const {
 
     if (hit) {
         hitRecord.t = t;
-        hitRecord.point = ray.at(t);
+        hitRecord.point = point;
         hitRecord.normal = normal;
         hitRecord.material = material;
+        hitRecord.object = this;
         // Set the getUV function
-        hitRecord.getUV = [this](const Vector3& point, double& u, double& v) {
+        hitRecord.getUV = [this](const Vector3& point, Real& u, Real& v) {
             this->getUV(point, u, v);
         };
         return true;
@@ -106,17 +105,17 @@ bool Cylinder::intersect(const Ray& ray, HitRecord& hitRecord) const {
     return false;
 }
 
-void Cylinder::getUV(const Vector3& point, double& u, double& v) const {
+void Cylinder::getUV(const Vector3& point, Real& u, Real& v) const {
     // Compute the vector from the base center to the point
     Vector3 p = point - baseCenter;
 
     // Project p onto the plane perpendicular to the axis
-    double y = p.dot(axis);
+    Real y = p.dot(axis);
 
     Vector3 p_proj = p - axis * y;
 
     // Compute the angle around the cylinder axis
-    double theta = atan2(p_proj.z, p_proj.x);
+    Real theta = atan2(p_proj.z, p_proj.x);
     if (theta < 0)
         theta += 2 * M_PI;
 
@@ -125,13 +124,15 @@ void Cylinder::getUV(const Vector3& point, double& u, double& v) const {
     v = y / height;
 
     // Ensure V is between 0 and 1
-    v = std::clamp(v, 0.0, 1.0);
+    v = std::clamp(v, Real(0), Real(1));
 }
 
 BoundingBox Cylinder::getBoundingBox() const {
-    Vector3 radiusVec(radius, radius, radius);
-    Vector3 heightVec(0, height, 0);
-    Vector3 minVec = baseCenter - radiusVec;
-    Vector3 maxVec = baseCenter + radiusVec + heightVec;
-    return BoundingBox(minVec, maxVec);
-}
\ No newline at end of file
+    // The rims are circles around the axis; along each world axis they reach
+    // radius * sqrt(1 - axis_i^2) beyond the end points of the axis
+    Vector3 topCenter = baseCenter + axis * height;
+    Vector3 rimExtent(radius * std::sqrt(std::max(Real(0), 1 - axis.x * axis.x)),
+                      radius * std::sqrt(std::max(Real(0), 1 - axis.y * axis.y)),
+                      radius * std::sqrt(std::max(Real(0), 1 - axis.z * axis.z)));
+    return BoundingBox(Vector3::min(baseCenter, topCenter) - rimExtent, Vector3::max(baseCenter, topCenter) + rimExtent);
+}
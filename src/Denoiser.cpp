@@ -0,0 +1,199 @@
+// Denoiser.cpp
+#include "Denoiser.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// B3-spline coefficients of the five taps along each axis
+const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+
+// Edge-stopping sensitivities of SVGF: the normal weight is the cosine to the
+// power 128, depth differences are measured against the local depth slope
+// and illumination differences against four standard deviations. Albedo
+// differences stop the filter too, since the specular part of the radiance
+// does not scale with the albedo divided out and would leak across texture
+// edges.
+const float sigmaDepth = 1.0f;
+const float sigmaLuminance = 4.0f;
+const float sigmaAlbedo = 0.2f;
+
+// Darker albedo is not divided out, which would only amplify the noise
+const float minAlbedo = 0.01f;
+
+inline float luminance(float r, float g, float b) {
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+// Cosine to the power 128 by repeated squaring, cheaper than pow and vectorisable
+inline float normalWeight(float cosine) {
+    float weight = std::max(0.0f, cosine);
+    for (int k = 0; k < 7; ++k) {
+        weight *= weight;
+    }
+    return weight;
+}
+
+}
+
+Denoiser::Denoiser(int width, int height) : width(width), height(height) {
+    size_t pixels = static_cast<size_t>(width) * height;
+    for (int c = 0; c < 3; ++c) {
+        radiance[c].assign(pixels, 0.0f);
+        albedo[c].assign(pixels, 1.0f);
+        normal[c].assign(pixels, 0.0f);
+    }
+    variance.assign(pixels, 0.0f);
+    depth.assign(pixels, 0.0f);
+}
+
+void Denoiser::filter(int i0, int j0, int i1, int j1, int iterations) {
+    size_t pixels = static_cast<size_t>(width) * height;
+    int rowLength = i1 - i0;
+    std::vector<float> illumination[3], filtered[3];
+    for (int c = 0; c < 3; ++c) {
+        illumination[c].assign(pixels, 0.0f);
+        filtered[c].assign(pixels, 0.0f);
+    }
+    std::vector<float> hit(pixels, 0.0f);
+    std::vector<float> illuminationVariance(pixels, 0.0f), filteredVariance(pixels, 0.0f);
+    std::vector<float> lum(pixels, 0.0f), tolerance(pixels, 1.0f), slope(pixels, 0.0f);
+
+    // Divide the albedo out of the radiance and its variance
+    #pragma omp parallel for
+    for (int j = j0; j < j1; ++j) {
+        for (int i = i0; i < i1; ++i) {
+            size_t p = static_cast<size_t>(j) * width + i;
+            hit[p] = depth[p] > 0 ? 1.0f : 0.0f;
+            float meanAlbedo = 0.0f;
+            for (int c = 0; c < 3; ++c) {
+                float a = hit[p] > 0 ? std::max(albedo[c][p], minAlbedo) : 1.0f;
+                illumination[c][p] = radiance[c][p] / a;
+                meanAlbedo += a / 3;
+            }
+            illuminationVariance[p] = variance[p] / (meanAlbedo * meanAlbedo);
+        }
+    }
+
+    // Depth change per pixel, from central differences between hits
+    #pragma omp parallel for
+    for (int j = j0; j < j1; ++j) {
+        for (int i = i0; i < i1; ++i) {
+            size_t p = static_cast<size_t>(j) * width + i;
+            if (hit[p] == 0)
+                continue;
+            float change = 0.0f;
+            if (i > i0 && i + 1 < i1 && hit[p - 1] > 0 && hit[p + 1] > 0)
+                change = std::max(change, std::abs(depth[p + 1] - depth[p - 1]) / 2);
+            if (j > j0 && j + 1 < j1 && hit[p - width] > 0 && hit[p + width] > 0)
+                change = std::max(change, std::abs(depth[p + width] - depth[p - width]) / 2);
+            slope[p] = change;
+        }
+    }
+
+    for (int iteration = 0; iteration < iterations; ++iteration) {
+        int step = 1 << iteration;
+
+        // Each hit's illumination tolerance, from its variance blurred over 3x3 hits
+        #pragma omp parallel for
+        for (int j = j0; j < j1; ++j) {
+            for (int i = i0; i < i1; ++i) {
+                size_t p = static_cast<size_t>(j) * width + i;
+                lum[p] = luminance(illumination[0][p], illumination[1][p], illumination[2][p]);
+                if (hit[p] == 0)
+                    continue;
+                float blurred = 0.0f, weightSum = 0.0f;
+                for (int dy = -1; dy <= 1; ++dy) {
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        int qi = i + dx, qj = j + dy;
+                        if (qi < i0 || qi >= i1 || qj < j0 || qj >= j1)
+                            continue;
+                        size_t q = static_cast<size_t>(qj) * width + qi;
+                        float weight = hit[q] * kernel[dx + 2] * kernel[dy + 2];
+                        blurred += weight * illuminationVariance[q];
+                        weightSum += weight;
+                    }
+                }
+                tolerance[p] = sigmaLuminance * std::sqrt(std::max(0.0f, blurred / weightSum)) + 1e-4f;
+            }
+        }
+
+        #pragma omp parallel
+        {
+            std::vector<float> sum[3], weightSum, varianceSum;
+            for (int c = 0; c < 3; ++c) {
+                sum[c].resize(rowLength);
+            }
+            weightSum.resize(rowLength);
+            varianceSum.resize(rowLength);
+
+            #pragma omp for schedule(dynamic)
+            for (int j = j0; j < j1; ++j) {
+                for (int c = 0; c < 3; ++c) {
+                    std::fill(sum[c].begin(), sum[c].end(), 0.0f);
+                }
+                std::fill(weightSum.begin(), weightSum.end(), 0.0f);
+                std::fill(varianceSum.begin(), varianceSum.end(), 0.0f);
+                size_t row = static_cast<size_t>(j) * width;
+
+                for (int dy = -2; dy <= 2; ++dy) {
+                    int qj = j + dy * step;
+                    if (qj < j0 || qj >= j1)
+                        continue;
+                    for (int dx = -2; dx <= 2; ++dx) {
+                        int offset = dx * step;
+                        int start = std::max(i0, i0 - offset);
+                        int end = std::min(i1, i1 - offset);
+                        float tapWeight = kernel[dx + 2] * kernel[dy + 2];
+                        float distance = step * std::sqrt(static_cast<float>(dx * dx + dy * dy));
+                        size_t qRow = static_cast<size_t>(qj) * width;
+
+                        for (int i = start; i < end; ++i) {
+                            size_t p = row + i, q = qRow + i + offset;
+                            float cosine = normal[0][p] * normal[0][q] + normal[1][p] * normal[1][q] + normal[2][p] * normal[2][q];
+                            float depthTerm = std::abs(depth[p] - depth[q]) / (sigmaDepth * slope[p] * distance + 1e-3f * depth[p] + 1e-6f);
+                            float lumTerm = std::abs(lum[p] - lum[q]) / tolerance[p];
+                            float albedoTerm = (std::abs(albedo[0][p] - albedo[0][q]) + std::abs(albedo[1][p] - albedo[1][q]) +
+                                                std::abs(albedo[2][p] - albedo[2][q])) / sigmaAlbedo;
+                            float weight = tapWeight * normalWeight(cosine) * std::exp(-(depthTerm + lumTerm + albedoTerm)) * hit[q];
+                            int k = i - i0;
+                            sum[0][k] += weight * illumination[0][q];
+                            sum[1][k] += weight * illumination[1][q];
+                            sum[2][k] += weight * illumination[2][q];
+                            weightSum[k] += weight;
+                            varianceSum[k] += weight * weight * illuminationVariance[q];
+                        }
+                    }
+                }
+
+                for (int i = i0; i < i1; ++i) {
+                    size_t p = row + i;
+                    int k = i - i0;
+                    // The centre tap always contributes, so a hit's weight sum is positive
+                    bool keep = hit[p] == 0 || weightSum[k] <= 0;
+                    for (int c = 0; c < 3; ++c) {
+                        filtered[c][p] = keep ? illumination[c][p] : sum[c][k] / weightSum[k];
+                    }
+                    filteredVariance[p] = keep ? illuminationVariance[p] : varianceSum[k] / (weightSum[k] * weightSum[k]);
+                }
+            }
+        }
+
+        for (int c = 0; c < 3; ++c) {
+            illumination[c].swap(filtered[c]);
+        }
+        illuminationVariance.swap(filteredVariance);
+    }
+
+    // Multiply the albedo back in
+    #pragma omp parallel for
+    for (int j = j0; j < j1; ++j) {
+        for (int i = i0; i < i1; ++i) {
+            size_t p = static_cast<size_t>(j) * width + i;
+            for (int c = 0; c < 3; ++c) {
+                float a = hit[p] > 0 ? std::max(albedo[c][p], minAlbedo) : 1.0f;
+                radiance[c][p] = illumination[c][p] * a;
+            }
+        }
+    }
+}
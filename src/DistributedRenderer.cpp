@@ -0,0 +1,200 @@
+// DistributedRenderer.cpp
+#include "DistributedRenderer.h"
+#include "RenderStats.h"
+#include "Socket.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+DistributedRenderer::DistributedRenderer(const std::vector<std::string>& workers, const std::string& scenePath)
+    : workers(workers), scenePath(scenePath) {}
+
+void DistributedRenderer::setSplitMode(SplitMode mode) {
+    splitMode = mode;
+}
+
+void DistributedRenderer::setJobSize(int size) {
+    jobSize = std::max(1, size);
+}
+
+/*
+* Function to split the render region into tiles, or its samples into contiguous ranges.
+*/
+std::vector<DistributedRenderer::Job> DistributedRenderer::makeJobs(const RayTracer& rayTracer) const {
+    int regionX, regionY, regionWidth, regionHeight;
+    rayTracer.getRegion(regionX, regionY, regionWidth, regionHeight);
+    int samples = rayTracer.getStratifiedSamples();
+
+    std::vector<Job> jobs;
+    if (splitMode == SPLIT_SAMPLES) {
+        // A few ranges per worker keep them busy when some are faster than others
+        int ranges = std::min(samples, static_cast<int>(workers.size()) * 4);
+        for (int r = 0; r < ranges; ++r) {
+            int first = samples * r / ranges;
+            int last = samples * (r + 1) / ranges;
+            jobs.push_back({regionX, regionY, regionWidth, regionHeight, first, last - first});
+        }
+        return jobs;
+    }
+
+    for (int y = regionY; y < regionY + regionHeight; y += jobSize) {
+        for (int x = regionX; x < regionX + regionWidth; x += jobSize) {
+            jobs.push_back({x, y, std::min(jobSize, regionX + regionWidth - x),
+                            std::min(jobSize, regionY + regionHeight - y), 0, samples});
+        }
+    }
+    return jobs;
+}
+
+namespace {
+
+/*
+* A tile of radiance sums received for a job, kept until the whole job has arrived.
+*/
+struct ReceivedTile {
+    int x, y, width, height;
+    std::vector<double> radiance;
+};
+
+/*
+* Function to send one job to a worker and collect its tiles; false if the worker failed.
+*/
+bool runJob(SocketConnection& connection, const json& request, std::vector<ReceivedTile>& tiles, std::string& error) {
+    if (!connection.sendLine(request)) {
+        error = "connection lost";
+        return false;
+    }
+
+    std::string line;
+    while (connection.readLine(line)) {
+        json message = json::parse(line, nullptr, false);
+        std::string type = message.is_object() ? message.value("type", "") : "";
+        if (type == "error") {
+            error = message.value("message", "unknown error");
+            return false;
+        }
+        if (type == "done")
+            return true;
+        if (type != "tile")
+            continue;
+
+        ReceivedTile tile;
+        tile.x = message.value("x", 0);
+        tile.y = message.value("y", 0);
+        tile.width = message.value("width", 0);
+        tile.height = message.value("height", 0);
+        size_t bytes = message.value("bytes", size_t(0));
+        if (bytes != static_cast<size_t>(tile.width) * tile.height * 3 * sizeof(double)) {
+            error = "unexpected tile size";
+            return false;
+        }
+        tile.radiance.resize(bytes / sizeof(double));
+        if (!connection.readExact(reinterpret_cast<char*>(tile.radiance.data()), bytes))
+            break;
+        tiles.push_back(std::move(tile));
+    }
+    error = "connection lost";
+    return false;
+}
+
+}
+
+/*
+* Function to render the frame on the workers and merge their results into buffer.
+*/
+bool DistributedRenderer::render(RayTracer& rayTracer, std::vector<std::vector<Vector3>>& buffer) {
+    PhaseTimer renderTimer("render");
+    int imageWidth = rayTracer.getImageWidth();
+    int imageHeight = rayTracer.getImageHeight();
+
+    std::vector<Job> jobs = makeJobs(rayTracer);
+    std::deque<size_t> queue;
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        queue.push_back(j);
+    }
+    size_t remaining = jobs.size();
+    std::mutex mutex;
+    std::condition_variable changed;
+
+    // Radiance sums of all jobs, row 0 at the bottom like the render buffer
+    std::vector<std::vector<Vec3<double>>> sums(imageHeight, std::vector<Vec3<double>>(imageWidth, Vec3<double>(0, 0, 0)));
+
+    auto serveWorker = [&](const std::string& address) {
+        std::unique_ptr<SocketConnection> connection = SocketConnection::connect(address);
+        while (connection) {
+            size_t index;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [&] { return !queue.empty() || remaining == 0; });
+                if (queue.empty())
+                    break;
+                index = queue.front();
+                queue.pop_front();
+            }
+
+            const Job& job = jobs[index];
+            json request = {
+                {"scene", scenePath},
+                {"seed", rayTracer.getSeed()},
+                {"region", {job.x, job.y, job.width, job.height}},
+                {"samples", {job.firstSample, job.sampleCount}},
+                {"format", "radiance"}
+            };
+            std::vector<ReceivedTile> tiles;
+            std::string error;
+            bool ok = runJob(*connection, request, tiles, error);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!ok) {
+                // Hand the job to the other workers and stop using this one
+                std::cerr << "\nError: Worker " << address << " failed: " << error << std::endl;
+                queue.push_back(index);
+                connection.reset();
+                changed.notify_all();
+                break;
+            }
+            for (const ReceivedTile& tile : tiles) {
+                for (int row = 0; row < tile.height; ++row) {
+                    std::vector<Vec3<double>>& sumRow = sums[imageHeight - 1 - (tile.y + row)];
+                    const double* radiance = tile.radiance.data() + 3 * row * tile.width;
+                    for (int column = 0; column < tile.width; ++column, radiance += 3) {
+                        sumRow[tile.x + column] += Vec3<double>(radiance[0], radiance[1], radiance[2]);
+                    }
+                }
+            }
+            --remaining;
+            int progress = static_cast<int>(((jobs.size() - remaining) * 100) / jobs.size());
+            std::cout << "\rRendering: " << progress << "% completed" << std::flush;
+            changed.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (const std::string& address : workers) {
+        threads.emplace_back(serveWorker, address);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    std::cout << std::endl;
+
+    // Jobs are only left over once every worker has failed
+    if (remaining > 0) {
+        std::cerr << "Error: " << remaining << " of " << jobs.size() << " jobs could not be rendered" << std::endl;
+        return false;
+    }
+
+    int regionX, regionY, regionWidth, regionHeight;
+    rayTracer.getRegion(regionX, regionY, regionWidth, regionHeight);
+    int i0 = regionX;
+    int j0 = imageHeight - (regionY + regionHeight);
+    for (int j = j0; j < j0 + regionHeight; ++j) {
+        for (int i = i0; i < i0 + regionWidth; ++i) {
+            buffer[j][i] = rayTracer.resolvePixel(sums[j][i]);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,174 @@
+// GBuffer.cpp
+#include "GBuffer.h"
+#include "BinaryFile.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+const char relightMagic[8] = {'R', 'T', 'R', 'E', 'L', 'I', 'T', '\0'};
+const uint32_t relightVersion = 1;
+const uint32_t relightEndianTag = 0x01020304;
+
+/*
+* Fixed-size header of a relight file. It is followed by the scene settings
+* text, the per-pixel channels (position, normal, direction, u, v and depth as
+* Real, then the primitive index as int32, -1 on a miss) and the visibility
+* bytes with one validity byte per light in front.
+*/
+struct RelightHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t realSize;     // sizeof(Real); channels are stored in the precision they were traced in
+    uint32_t width;
+    uint32_t height;
+    uint32_t lightCount;
+    int32_t region[4];     // regionI0, regionJ0, regionI1, regionJ1
+    uint64_t settingsLength;
+    uint64_t geometryHash;
+};
+
+// Materials shade alike when their coefficients, colors and texture match; the
+// texture path is not compared since equal paths share their decoded texels
+bool sameMaterial(const Material& a, const Material& b) {
+    return a.ks == b.ks && a.kd == b.kd && a.specularExponent == b.specularExponent &&
+           a.isReflective == b.isReflective && a.reflectivity == b.reflectivity &&
+           a.isRefractive == b.isRefractive && a.refractiveIndex == b.refractiveIndex &&
+           a.diffuseColor == b.diffuseColor && a.specularColor == b.specularColor &&
+           a.hasTexture == b.hasTexture && a.textureData == b.textureData &&
+           a.textureWidth == b.textureWidth && a.textureHeight == b.textureHeight;
+}
+
+}
+
+void GBuffer::reset(int width, int height, int lightCount) {
+    this->width = width;
+    this->height = height;
+    size_t pixels = static_cast<size_t>(width) * height;
+    position.assign(pixels, Vector3(0, 0, 0));
+    normal.assign(pixels, Vector3(0, 0, 0));
+    direction.assign(pixels, Vector3(0, 0, 0));
+    u.assign(pixels, 0);
+    v.assign(pixels, 0);
+    depth.assign(pixels, std::numeric_limits<Real>::infinity());
+    materialId.assign(pixels, -1);
+    object.assign(pixels, nullptr);
+    this->lightCount = lightCount;
+    visibility.assign(pixels * lightCount, 0);
+    visibilityValid.assign(lightCount, 0);
+}
+
+void GBuffer::resizeLights(int lightCount) {
+    this->lightCount = lightCount;
+    visibility.resize(static_cast<size_t>(width) * height * lightCount, 0);
+    visibilityValid.resize(lightCount, 0);
+}
+
+bool GBuffer::load(const std::string& filename, const std::vector<const Intersectable*>& objects) {
+    std::ifstream inFile(filename, std::ios::binary);
+    if (!inFile.is_open()) {
+        std::cerr << "Error: Could not open relight file " << filename << std::endl;
+        return false;
+    }
+
+    RelightHeader header;
+    if (!inFile.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, relightMagic, sizeof(relightMagic)) != 0 ||
+        header.version != relightVersion || header.endianTag != relightEndianTag ||
+        header.width == 0 || header.height == 0 ||
+        static_cast<uint64_t>(header.width) * header.height > std::numeric_limits<int>::max() ||
+        header.lightCount > static_cast<uint32_t>(std::numeric_limits<int>::max()) ||
+        header.settingsLength > (uint64_t(1) << 32)) {
+        std::cerr << "Error: " << filename << " is not a relight file written by this version" << std::endl;
+        return false;
+    }
+    if (header.realSize != sizeof(Real)) {
+        std::cerr << "Error: Relight file " << filename << " was written by a build of another precision" << std::endl;
+        return false;
+    }
+
+    reset(static_cast<int>(header.width), static_cast<int>(header.height), static_cast<int>(header.lightCount));
+    regionI0 = header.region[0];
+    regionJ0 = header.region[1];
+    regionI1 = header.region[2];
+    regionJ1 = header.region[3];
+    geometryHash = header.geometryHash;
+    sceneSettings.assign(header.settingsLength, '\0');
+
+    std::vector<int32_t> objectIndex(object.size());
+    if (!inFile.read(&sceneSettings[0], sceneSettings.size()) ||
+        !BinaryFile::readVectors<Real>(inFile, position) || !BinaryFile::readVectors<Real>(inFile, normal) ||
+        !BinaryFile::readVectors<Real>(inFile, direction) ||
+        !BinaryFile::readArray(inFile, u) || !BinaryFile::readArray(inFile, v) || !BinaryFile::readArray(inFile, depth) ||
+        !BinaryFile::readArray(inFile, objectIndex) || !BinaryFile::readArray(inFile, visibilityValid) ||
+        !BinaryFile::readArray(inFile, visibility)) {
+        std::cerr << "Error: Relight file " << filename << " is truncated" << std::endl;
+        return false;
+    }
+
+    for (size_t p = 0; p < objectIndex.size(); ++p) {
+        int32_t index = objectIndex[p];
+        if (index >= static_cast<int64_t>(objects.size())) {
+            std::cerr << "Error: Relight file " << filename << " refers to shapes the scene does not have" << std::endl;
+            return false;
+        }
+        object[p] = index >= 0 ? objects[index] : nullptr;
+    }
+    return true;
+}
+
+bool GBuffer::write(const std::string& filename, const std::vector<const Intersectable*>& objects) const {
+    RelightHeader header = {};
+    std::memcpy(header.magic, relightMagic, sizeof(relightMagic));
+    header.version = relightVersion;
+    header.endianTag = relightEndianTag;
+    header.realSize = sizeof(Real);
+    header.width = static_cast<uint32_t>(width);
+    header.height = static_cast<uint32_t>(height);
+    header.lightCount = static_cast<uint32_t>(lightCount);
+    header.region[0] = regionI0;
+    header.region[1] = regionJ0;
+    header.region[2] = regionI1;
+    header.region[3] = regionJ1;
+    header.settingsLength = sceneSettings.size();
+    header.geometryHash = geometryHash;
+
+    std::unordered_map<const Intersectable*, int32_t> indexOf;
+    indexOf.reserve(objects.size());
+    for (size_t k = 0; k < objects.size(); ++k) {
+        indexOf[objects[k]] = static_cast<int32_t>(k);
+    }
+    std::vector<int32_t> objectIndex(object.size(), -1);
+    for (size_t p = 0; p < object.size(); ++p) {
+        if (object[p])
+            objectIndex[p] = indexOf.at(object[p]);
+    }
+
+    return BinaryFile::replace(filename, "relight file", [&](std::ostream& outFile) {
+        outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        outFile.write(sceneSettings.data(), sceneSettings.size());
+        BinaryFile::writeVectors<Real>(outFile, position);
+        BinaryFile::writeVectors<Real>(outFile, normal);
+        BinaryFile::writeVectors<Real>(outFile, direction);
+        BinaryFile::writeArray(outFile, u);
+        BinaryFile::writeArray(outFile, v);
+        BinaryFile::writeArray(outFile, depth);
+        BinaryFile::writeArray(outFile, objectIndex);
+        BinaryFile::writeArray(outFile, visibilityValid);
+        BinaryFile::writeArray(outFile, visibility);
+    });
+}
+
+int32_t GBuffer::internMaterial(std::vector<Material>& table, const Material& material) {
+    // Neighbouring pixels mostly hit the same material, so search from the end
+    for (size_t k = table.size(); k-- > 0;) {
+        if (sameMaterial(table[k], material))
+            return static_cast<int32_t>(k);
+    }
+    table.push_back(material);
+    return static_cast<int32_t>(table.size() - 1);
+}
@@ -0,0 +1,124 @@
+// IncrementalState.cpp
+#include "IncrementalState.h"
+#include "BinaryFile.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+const char incrementalMagic[8] = {'R', 'T', 'I', 'N', 'C', 'R', '\0', '\0'};
+const uint32_t incrementalVersion = 2;
+const uint32_t incrementalEndianTag = 0x01020304;
+
+/*
+* Fixed-size header of an incremental state file. It is followed by the scene
+* settings text, the shape hashes (uint64) and bounds (min and max as six
+* Reals), then the per-pixel radiance, position and depth as Reals and the flag
+* bytes.
+*/
+struct IncrementalHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t realSize;     // sizeof(Real); pixels are kept in the precision they were rendered in
+    uint32_t width;
+    uint32_t height;
+    int32_t region[4];     // regionI0, regionJ0, regionI1, regionJ1
+    uint32_t reserved;
+    uint64_t settingsLength;
+    uint64_t shapeCount;
+};
+
+}
+
+void IncrementalState::reset(int width, int height) {
+    this->width = width;
+    this->height = height;
+    size_t pixels = static_cast<size_t>(width) * height;
+    color.assign(pixels, Vector3(0, 0, 0));
+    position.assign(pixels, Vector3(0, 0, 0));
+    depth.assign(pixels, std::numeric_limits<Real>::infinity());
+    flags.assign(pixels, 0);
+}
+
+bool IncrementalState::load(const std::string& filename) {
+    std::ifstream inFile(filename, std::ios::binary);
+    if (!inFile.is_open()) {
+        std::cerr << "Error: Could not open incremental state file " << filename << std::endl;
+        return false;
+    }
+
+    IncrementalHeader header;
+    if (!inFile.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, incrementalMagic, sizeof(incrementalMagic)) != 0 ||
+        header.version != incrementalVersion || header.endianTag != incrementalEndianTag ||
+        header.width == 0 || header.height == 0 ||
+        static_cast<uint64_t>(header.width) * header.height > std::numeric_limits<int>::max() ||
+        header.settingsLength > (uint64_t(1) << 32) || header.shapeCount > (uint64_t(1) << 32)) {
+        std::cerr << "Error: " << filename << " is not an incremental state file written by this version" << std::endl;
+        return false;
+    }
+    if (header.realSize != sizeof(Real)) {
+        std::cerr << "Error: Incremental state file " << filename << " was written by a build of another precision" << std::endl;
+        return false;
+    }
+
+    reset(static_cast<int>(header.width), static_cast<int>(header.height));
+    regionI0 = header.region[0];
+    regionJ0 = header.region[1];
+    regionI1 = header.region[2];
+    regionJ1 = header.region[3];
+    sceneSettings.assign(header.settingsLength, '\0');
+    shapeHashes.resize(header.shapeCount);
+
+    std::vector<Real> bounds(header.shapeCount * 6);
+    if (!inFile.read(&sceneSettings[0], sceneSettings.size()) ||
+        !BinaryFile::readArray(inFile, shapeHashes) || !BinaryFile::readArray(inFile, bounds) ||
+        !BinaryFile::readVectors<Real>(inFile, color) || !BinaryFile::readVectors<Real>(inFile, position) ||
+        !BinaryFile::readArray(inFile, depth) || !BinaryFile::readArray(inFile, flags)) {
+        std::cerr << "Error: Incremental state file " << filename << " is truncated" << std::endl;
+        return false;
+    }
+
+    shapeBounds.resize(header.shapeCount);
+    for (size_t k = 0; k < shapeBounds.size(); ++k) {
+        const Real* box = &bounds[6 * k];
+        shapeBounds[k] = BoundingBox(Vector3(box[0], box[1], box[2]), Vector3(box[3], box[4], box[5]));
+    }
+    return true;
+}
+
+bool IncrementalState::write(const std::string& filename) const {
+    IncrementalHeader header = {};
+    std::memcpy(header.magic, incrementalMagic, sizeof(incrementalMagic));
+    header.version = incrementalVersion;
+    header.endianTag = incrementalEndianTag;
+    header.realSize = sizeof(Real);
+    header.width = static_cast<uint32_t>(width);
+    header.height = static_cast<uint32_t>(height);
+    header.region[0] = regionI0;
+    header.region[1] = regionJ0;
+    header.region[2] = regionI1;
+    header.region[3] = regionJ1;
+    header.settingsLength = sceneSettings.size();
+    header.shapeCount = shapeHashes.size();
+
+    std::vector<Real> bounds;
+    bounds.reserve(shapeBounds.size() * 6);
+    for (const BoundingBox& box : shapeBounds) {
+        bounds.insert(bounds.end(), {box.min.x, box.min.y, box.min.z, box.max.x, box.max.y, box.max.z});
+    }
+
+    return BinaryFile::replace(filename, "incremental state file", [&](std::ostream& outFile) {
+        outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        outFile.write(sceneSettings.data(), sceneSettings.size());
+        BinaryFile::writeArray(outFile, shapeHashes);
+        BinaryFile::writeArray(outFile, bounds);
+        BinaryFile::writeVectors<Real>(outFile, color);
+        BinaryFile::writeVectors<Real>(outFile, position);
+        BinaryFile::writeArray(outFile, depth);
+        BinaryFile::writeArray(outFile, flags);
+    });
+}
@@ -3,3 +3,20 @@
 
 // Initialize intersectable with material
 Intersectable::Intersectable(){}
+
+BoundingBox Intersectable::getClippedBoundingBox(const BoundingBox& clip) const {
+    return getBoundingBox().overlap(clip);
+}
+
+const Material* Intersectable::getMaterial() const {
+    return nullptr;
+}
+
+bool Intersectable::occluded(const Ray& ray, Real maxDistance, const Intersectable*& occluder) const {
+    HitRecord hitRecord;
+    if (intersect(ray, hitRecord) && hitRecord.t < maxDistance) {
+        occluder = this;
+        return true;
+    }
+    return false;
+}
@@ -2,7 +2,7 @@
 #include "Light.h"
 #include <random>
 
-Vector3 Light::sample(const Vector3& point, Vector3& lightDir, double& distance, double& pdf) const {
+Vector3 Light::sample(const Vector3& point, Vector3& lightDir, Real& distance, Real& pdf) const {
     return Vector3(0, 0, 0);
 }
 
@@ -1,16 +1,35 @@
 // Material.cpp
 #include "Material.h"
+#include "RenderStats.h"
+#include "Profiler.h"
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <cmath>
 #include <algorithm>
+#include <map>
+#include <mutex>
+
+namespace {
+
+struct CachedTexture {
+    int width = 0;
+    int height = 0;
+    std::shared_ptr<const Vector3> data;
+};
+
+// Materials are built in parallel by the scene loader, so the cache is locked
+std::mutex textureCacheMutex;
+std::map<std::string, CachedTexture> textureCache;
+
+}
 
 Material::Material()
     : ks(0.0), kd(0.0), specularExponent(0.0),
       isReflective(false), reflectivity(0.0),
       isRefractive(false), refractiveIndex(1.0),
-      diffuseColor(0.0, 0.0, 0.0), specularColor(0.0, 0.0, 0.0){}
+      diffuseColor(0.0, 0.0, 0.0), specularColor(0.0, 0.0, 0.0),
+      hasTexture(false), textureWidth(0), textureHeight(0) {}
 
 
 
@@ -20,6 +39,21 @@ void Material::loadTexture() {
         return;
     }
 
+    std::lock_guard<std::mutex> lock(textureCacheMutex);
+    auto cached = textureCache.find(texturePath);
+    if (cached != textureCache.end()) {
+        textureWidth = cached->second.width;
+        textureHeight = cached->second.height;
+        textureData = cached->second.data;
+        hasTexture = textureData != nullptr;
+        return;
+    }
+    // Failed loads are cached too, so a missing file is only reported once
+    CachedTexture& entry = textureCache[texturePath];
+
+    PhaseTimer textureTimer("textures");
+    std::cout << "Loading texture from file: " << texturePath << std::endl;
+
     std::ifstream file(texturePath, std::ios::binary);
     if (!file.is_open()) {
         std::cerr << "Error: Could not open texture file " << texturePath << std::endl;
@@ -52,7 +86,7 @@ void Material::loadTexture() {
 
     // Read pixel data
     int numPixels = textureWidth * textureHeight;
-    textureData = std::make_shared<std::vector<Vector3>>(numPixels);
+    auto texels = std::make_shared<std::vector<Vector3>>(numPixels);
 
     for (int i = 0; i < numPixels; ++i) {
         unsigned char r, g, b;
@@ -60,14 +94,19 @@ void Material::loadTexture() {
         file.read(reinterpret_cast<char*>(&g), 1);
         file.read(reinterpret_cast<char*>(&b), 1);
 
-        (*textureData)[i] = Vector3(r / 255.0, g / 255.0, b / 255.0);
+        (*texels)[i] = Vector3(r / 255.0, g / 255.0, b / 255.0);
     }
+    textureData = std::shared_ptr<const Vector3>(texels, texels->data());
 
     file.close();
+    entry = {textureWidth, textureHeight, textureData};
+    std::cout << "Texture loaded successfully." << std::endl;
 }
 
-Vector3 Material::getTextureColor(double u, double v) const {
-    if (!hasTexture || textureData->empty()) {
+Vector3 Material::getTextureColor(Real u, Real v) const {
+    RT_PROFILE_ZONE(ProfileZone::TextureLookup);
+
+    if (!hasTexture || !textureData) {
         return diffuseColor;
     }
 
@@ -82,5 +121,5 @@ Vector3 Material::getTextureColor(double u, double v) const {
     y = std::clamp(y, 0, textureHeight - 1);
 
     int index = y * textureWidth + x;
-    return (*textureData)[index];
+    return textureData.get()[index];
 }
\ No newline at end of file
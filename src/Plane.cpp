@@ -0,0 +1,49 @@
+// Plane.cpp
+#include "Plane.h"
+#include "RenderStats.h"
+#include <cmath>
+#include <limits>
+
+// Initialize plane with a point on it, its normal and material
+Plane::Plane(const Vector3& point, const Vector3& normal, const Material& material, Real tileSize)
+    : point(point), normal(normal.normalize()), tileSize(tileSize), material(material) {
+    // Any axis not parallel to the normal spans the tangent frame; for the
+    // ground (normal +y) u runs along x and v along -z
+    Vector3 helper = std::abs(this->normal.x) < 0.9 ? Vector3(1, 0, 0) : Vector3(0, 1, 0);
+    bitangent = this->normal.cross(helper).normalize();
+    tangent = bitangent.cross(this->normal);
+}
+
+bool Plane::intersect(const Ray& ray, HitRecord& hitRecord) const {
+    RT_STAT(primitiveTests);
+    Real denominator = normal.dot(ray.direction);
+    if (denominator == 0)
+        return false;
+
+    Real t = normal.dot(point - ray.origin) / denominator;
+    if (!(t > 0) || std::isinf(t))
+        return false;
+
+    hitRecord.t = t;
+    // Project the hit back onto the plane, so its error does not grow with t
+    Vector3 hit = ray.at(t);
+    hitRecord.point = hit - normal * normal.dot(hit - point);
+    hitRecord.normal = normal;
+    hitRecord.material = material;
+    hitRecord.object = this;
+    hitRecord.getUV = [this](const Vector3& point, Real& u, Real& v) {
+        getUV(point, u, v);
+    };
+    return true;
+}
+
+void Plane::getUV(const Vector3& point, Real& u, Real& v) const {
+    Vector3 offset = point - this->point;
+    u = offset.dot(tangent) / tileSize;
+    v = offset.dot(bitangent) / tileSize;
+}
+
+BoundingBox Plane::getBoundingBox() const {
+    Real infinity = std::numeric_limits<Real>::infinity();
+    return BoundingBox(Vector3(-infinity), Vector3(infinity));
+}
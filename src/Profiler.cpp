@@ -0,0 +1,247 @@
+// Profiler.cpp
+#include "Profiler.h"
+#include "RenderStats.h"
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace {
+
+const char* zoneNames[] = {
+    "Scene::intersect",
+    "shadow rays",
+    "shading",
+    "texture lookups"
+};
+
+struct ZoneTotals {
+    uint64_t calls = 0;
+    uint64_t inclusiveNs = 0;
+    uint64_t selfNs = 0;
+
+    ZoneTotals& operator+=(const ZoneTotals& other) {
+        calls += other.calls;
+        inclusiveNs += other.inclusiveNs;
+        selfNs += other.selfNs;
+        return *this;
+    }
+};
+
+struct TraceEvent {
+    std::string name;
+    uint64_t startNs;
+    uint64_t durationNs;
+    int threadId;
+};
+
+struct ThreadProfile;
+
+std::mutex registryMutex;
+std::vector<ThreadProfile*> registry;
+ZoneTotals retiredZones[static_cast<int>(ProfileZone::Count)];
+std::vector<TraceEvent> retiredEvents;
+int nextThreadId = 0;
+
+const auto epoch = std::chrono::steady_clock::now();
+
+/*
+* Per-thread profile buffer, merged into the retired totals when the thread exits.
+*/
+struct ThreadProfile {
+    ZoneTotals zones[static_cast<int>(ProfileZone::Count)];
+    std::vector<TraceEvent> events;
+    ProfileScope* current = nullptr;
+    int threadId;
+
+    ThreadProfile() {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        threadId = nextThreadId++;
+        registry.push_back(this);
+    }
+
+    ~ThreadProfile() {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (int i = 0; i < static_cast<int>(ProfileZone::Count); ++i) {
+            retiredZones[i] += zones[i];
+        }
+        retiredEvents.insert(retiredEvents.end(), events.begin(), events.end());
+        registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+    }
+};
+
+ThreadProfile& threadProfile() {
+    thread_local ThreadProfile profile;
+    return profile;
+}
+
+/*
+* Merge the zone totals and events of all threads.
+*/
+void mergeProfiles(ZoneTotals* zones, std::vector<TraceEvent>* events) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (int i = 0; i < static_cast<int>(ProfileZone::Count); ++i) {
+        zones[i] = retiredZones[i];
+        for (const ThreadProfile* profile : registry) {
+            zones[i] += profile->zones[i];
+        }
+    }
+    if (events) {
+        *events = retiredEvents;
+        for (const ThreadProfile* profile : registry) {
+            events->insert(events->end(), profile->events.begin(), profile->events.end());
+        }
+    }
+}
+
+}
+
+bool Profiler::enabled() {
+#ifdef RT_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t Profiler::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::recordEvent(const std::string& name, uint64_t startNs, uint64_t durationNs) {
+    ThreadProfile& profile = threadProfile();
+    profile.events.push_back({name, startNs, durationNs, profile.threadId});
+}
+
+bool Profiler::writeChromeTrace(const std::string& filename) {
+    ZoneTotals zones[static_cast<int>(ProfileZone::Count)];
+    std::vector<TraceEvent> events;
+    mergeProfiles(zones, &events);
+
+    json traceEvents = json::array();
+    int threadCount = 0;
+    for (const auto& event : events) {
+        traceEvents.push_back({
+            {"name", event.name},
+            {"ph", "X"},
+            {"ts", event.startNs / 1000.0},
+            {"dur", event.durationNs / 1000.0},
+            {"pid", 1},
+            {"tid", event.threadId}
+        });
+        threadCount = std::max(threadCount, event.threadId + 1);
+    }
+    for (int tid = 0; tid < threadCount; ++tid) {
+        traceEvents.push_back({
+            {"name", "thread_name"},
+            {"ph", "M"},
+            {"pid", 1},
+            {"tid", tid},
+            {"args", {{"name", tid == 0 ? std::string("main") : "worker " + std::to_string(tid)}}}
+        });
+    }
+
+    // Zone totals and counters do not fit the timeline, so they go in the metadata
+    json zoneJson = json::object();
+    for (int i = 0; i < static_cast<int>(ProfileZone::Count); ++i) {
+        zoneJson[zoneNames[i]] = {
+            {"calls", zones[i].calls},
+            {"inclusive_ms", zones[i].inclusiveNs / 1e6},
+            {"self_ms", zones[i].selfNs / 1e6}
+        };
+    }
+    RenderCounters counters = RenderStats::total();
+
+    json trace;
+    trace["traceEvents"] = traceEvents;
+    trace["displayTimeUnit"] = "ms";
+    trace["otherData"] = {
+        {"zones", zoneJson},
+        {"bvh_node_visits", counters.bvhNodeVisits},
+        {"bvh_leaf_visits", counters.bvhLeafVisits},
+        {"primitive_tests", counters.primitiveTests},
+        {"shadow_rays", counters.shadowRays}
+    };
+
+    std::ofstream outFile(filename);
+    if (!outFile.is_open()) {
+        std::cerr << "Error: Could not open trace file " << filename << std::endl;
+        return false;
+    }
+    outFile << trace.dump() << std::endl;
+    return true;
+}
+
+void Profiler::printSummary() {
+    ZoneTotals zones[static_cast<int>(ProfileZone::Count)];
+    mergeProfiles(zones, nullptr);
+
+    std::cout << "Profile summary:" << std::endl;
+    std::cout << "  " << std::left << std::setw(20) << "zone" << std::right
+              << std::setw(14) << "calls" << std::setw(14) << "incl ms"
+              << std::setw(14) << "self ms" << std::setw(12) << "avg ns" << std::endl;
+    for (int i = 0; i < static_cast<int>(ProfileZone::Count); ++i) {
+        const ZoneTotals& zone = zones[i];
+        double average = zone.calls > 0 ? static_cast<double>(zone.inclusiveNs) / zone.calls : 0.0;
+        std::cout << "  " << std::left << std::setw(20) << zoneNames[i] << std::right
+                  << std::setw(14) << zone.calls
+                  << std::setw(14) << std::fixed << std::setprecision(2) << zone.inclusiveNs / 1e6
+                  << std::setw(14) << zone.selfNs / 1e6
+                  << std::setw(12) << std::setprecision(1) << average << std::endl;
+    }
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+
+    RenderCounters counters = RenderStats::total();
+    std::cout << "  BVH node visits: " << counters.bvhNodeVisits << ", leaf visits: " << counters.bvhLeafVisits
+              << ", primitive tests: " << counters.primitiveTests << std::endl;
+
+    // Attribute time to traversal, shading or I/O to tell which one dominates
+    double traversalMs = zones[static_cast<int>(ProfileZone::SceneIntersect)].inclusiveNs / 1e6;
+    double shadingMs = (zones[static_cast<int>(ProfileZone::Shading)].selfNs +
+                        zones[static_cast<int>(ProfileZone::TextureLookup)].selfNs) / 1e6;
+    double ioMs = RenderStats::getPhase("parse") + RenderStats::getPhase("textures") + RenderStats::getPhase("write");
+
+    const char* bound = "traversal";
+    double boundMs = traversalMs;
+    if (shadingMs > boundMs) {
+        bound = "shading";
+        boundMs = shadingMs;
+    }
+    if (ioMs > boundMs) {
+        bound = "I/O";
+    }
+    std::cout << "  Traversal: " << traversalMs << " ms, shading: " << shadingMs
+              << " ms, I/O: " << ioMs << " ms (thread time) -> bound by " << bound << std::endl;
+}
+
+ProfileScope::ProfileScope(ProfileZone zone) : zone(zone), start(Profiler::now()), childNs(0) {
+    ThreadProfile& profile = threadProfile();
+    parent = profile.current;
+    profile.current = this;
+}
+
+ProfileScope::~ProfileScope() {
+    uint64_t elapsed = Profiler::now() - start;
+    ThreadProfile& profile = threadProfile();
+    profile.current = parent;
+    if (parent)
+        parent->childNs += elapsed;
+
+    ZoneTotals& totals = profile.zones[static_cast<int>(zone)];
+    totals.calls++;
+    totals.inclusiveNs += elapsed;
+    totals.selfNs += elapsed - std::min(elapsed, childNs);
+}
+
+TraceScope::TraceScope(const char* name) : name(name), start(Profiler::now()) {}
+
+TraceScope::~TraceScope() {
+    Profiler::recordEvent(name, start, Profiler::now() - start);
+}
@@ -0,0 +1,64 @@
+// Quad.cpp
+#include "Quad.h"
+#include "RenderStats.h"
+
+// Initialize quad with a corner, its two edges and material
+Quad::Quad(const Vector3& corner, const Vector3& edgeU, const Vector3& edgeV, const Material& material,
+           Real tileSize, const Vector3& facing)
+    : corner(corner), edgeU(edgeU), edgeV(edgeV), tileSize(tileSize), material(material) {
+    Vector3 n = edgeU.cross(edgeV);
+    planeScale = n / n.dot(n);
+    normal = n.normalize();
+    if (normal.dot(facing) < 0)
+        normal = -normal;
+}
+
+bool Quad::intersect(const Ray& ray, HitRecord& hitRecord) const {
+    RT_STAT(primitiveTests);
+    Real denominator = normal.dot(ray.direction);
+    if (denominator == 0)
+        return false;
+
+    Real t = normal.dot(corner - ray.origin) / denominator;
+    if (!(t > 0))
+        return false;
+
+    // Coordinates of the hit along the two edges
+    Vector3 offset = ray.at(t) - corner;
+    Real alpha = planeScale.dot(offset.cross(edgeV));
+    Real beta = planeScale.dot(edgeU.cross(offset));
+    if (alpha < 0 || alpha > 1 || beta < 0 || beta > 1)
+        return false;
+
+    hitRecord.t = t;
+    // Rebuilding the point from the edges keeps it on the quad
+    hitRecord.point = corner + edgeU * alpha + edgeV * beta;
+    hitRecord.normal = normal;
+    hitRecord.material = material;
+    hitRecord.object = this;
+    hitRecord.getUV = [this, alpha, beta](const Vector3&, Real& u, Real& v) {
+        uvFromEdgeCoordinates(alpha, beta, u, v);
+    };
+    return true;
+}
+
+void Quad::uvFromEdgeCoordinates(Real alpha, Real beta, Real& u, Real& v) const {
+    u = alpha;
+    v = beta;
+    if (tileSize > 0) {
+        u *= edgeU.length() / tileSize;
+        v *= edgeV.length() / tileSize;
+    }
+}
+
+BoundingBox Quad::getBoundingBox() const {
+    Vector3 opposite = corner + edgeU + edgeV;
+    BoundingBox box(Vector3::min(corner, opposite), Vector3::max(corner, opposite));
+    box = box.merge(BoundingBox(corner + edgeU, corner + edgeU));
+    return box.merge(BoundingBox(corner + edgeV, corner + edgeV));
+}
+
+BoundingBox Quad::getClippedBoundingBox(const BoundingBox& clip) const {
+    Vector3 vertices[4] = {corner, corner + edgeU, corner + edgeU + edgeV, corner + edgeV};
+    return BoundingBox::ofClippedPolygon(vertices, 4, clip);
+}
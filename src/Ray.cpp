@@ -1,11 +1,74 @@
 // Ray.cpp
 #include "Ray.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+/*
+* Offset magnitudes for offsetRayOrigin (Wächter and Binder, "A Fast and Robust
+* Method for Avoiding Self-Intersection"). Coordinates closer to zero than
+* origin get the absolute offset floatScale, all others move by intScale units
+* in the last place. The double-precision values keep the same relative size.
+*/
+template <typename T>
+struct OffsetScale;
+
+template <>
+struct OffsetScale<float> {
+    using Bits = int32_t;
+    static constexpr float origin = 1.0f / 32.0f;
+    static constexpr float floatScale = 1.0f / 65536.0f;
+    static constexpr float intScale = 256.0f;
+};
+
+template <>
+struct OffsetScale<double> {
+    using Bits = int64_t;
+    static constexpr double origin = 1.0 / 32.0;
+    static constexpr double floatScale = 1.0 / 65536.0 / (1 << 29);
+    static constexpr double intScale = 256.0 * (1 << 29);
+};
+
+}
 
 // Initialize ray with origin and direction
 Ray::Ray(const Vector3& origin, const Vector3& direction)
-    : origin(origin), direction(direction.normalize()) {}
+    : origin(origin), direction(direction.normalize()) {
+    Vector3 absDirection(std::abs(this->direction.x), std::abs(this->direction.y), std::abs(this->direction.z));
+    kz = absDirection.x > absDirection.y ? (absDirection.x > absDirection.z ? 0 : 2) : (absDirection.y > absDirection.z ? 1 : 2);
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+
+    // Swapping keeps the winding of the projected triangles
+    if (this->direction[kz] < 0)
+        std::swap(kx, ky);
+
+    shear = Vector3(-this->direction[kx] / this->direction[kz], -this->direction[ky] / this->direction[kz], Real(1) / this->direction[kz]);
+}
 
 // Compute point along the ray at parameter t
-Vector3 Ray::at(double t) const {
+Vector3 Ray::at(Real t) const {
     return origin + direction * t;
 }
+
+Vector3 offsetRayOrigin(const Vector3& point, const Vector3& normal) {
+    using Scale = OffsetScale<Real>;
+    using Bits = Scale::Bits;
+    Vector3 offset;
+    for (int axis = 0; axis < 3; ++axis) {
+        Real p = point[axis];
+        if (std::abs(p) < Scale::origin) {
+            offset[axis] = p + Scale::floatScale * normal[axis];
+            continue;
+        }
+        Bits ulps = static_cast<Bits>(Scale::intScale * normal[axis]);
+        Bits bits;
+        std::memcpy(&bits, &p, sizeof(p));
+        bits += p < 0 ? -ulps : ulps;
+        std::memcpy(&offset[axis], &bits, sizeof(p));
+    }
+    return offset;
+}
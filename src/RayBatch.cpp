@@ -0,0 +1,50 @@
+// RayBatch.cpp
+#include "RayBatch.h"
+#include <algorithm>
+
+/*
+* Spread the lower 16 bits of x so that there are two zero bits between each.
+*/
+static uint64_t expandBits(uint64_t x) {
+    x &= 0xFFFF;
+    x = (x | (x << 16)) & 0x0000FF0000FFull;
+    x = (x | (x << 8))  & 0x00F00F00F00Full;
+    x = (x | (x << 4))  & 0x0C30C30C30C3ull;
+    x = (x | (x << 2))  & 0x249249249249ull;
+    return x;
+}
+
+/*
+* Quantize one coordinate of the origin to a 16 bit cell index.
+*/
+static uint64_t quantize(double value, double min, double extent) {
+    if (extent <= 0.0)
+        return 0;
+    double t = (value - min) / extent;
+    t = std::clamp(t, 0.0, 1.0);
+    return static_cast<uint64_t>(t * 65535.0);
+}
+
+uint64_t rayMortonKey(const Ray& ray, const BoundingBox& bounds) {
+    Vector3 extent = bounds.max - bounds.min;
+    uint64_t x = quantize(ray.origin.x, bounds.min.x, extent.x);
+    uint64_t y = quantize(ray.origin.y, bounds.min.y, extent.y);
+    uint64_t z = quantize(ray.origin.z, bounds.min.z, extent.z);
+    uint64_t morton = (expandBits(x) << 2) | (expandBits(y) << 1) | expandBits(z);
+
+    // Direction octant goes in the top bits so rays heading the same way
+    // are traced together; within an octant rays are ordered by origin cell.
+    uint64_t octant = (ray.direction.x < 0 ? 4 : 0) |
+                      (ray.direction.y < 0 ? 2 : 0) |
+                      (ray.direction.z < 0 ? 1 : 0);
+    return (octant << 48) | morton;
+}
+
+void sortRayBatch(std::vector<BatchRay>& rays, const BoundingBox& bounds) {
+    for (auto& batchRay : rays) {
+        batchRay.key = rayMortonKey(batchRay.ray, bounds);
+    }
+    std::sort(rays.begin(), rays.end(), [](const BatchRay& a, const BatchRay& b) {
+        return a.key < b.key;
+    });
+}
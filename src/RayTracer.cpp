@@ -2,20 +2,30 @@
 #include "Camera.h"
 #include "Scene.h"
 #include "RayTracer.h"
-#include "Sphere.h"
-#include "Triangle.h"
-#include "Cylinder.h"
+#include "SceneLoader.h"
+#include "SceneCache.h"
+#include "RenderServer.h"
+#include "DistributedRenderer.h"
 #include "Light.h"
 #include "AreaLight.h"
 #include "PointLight.h"
+#include "RenderStats.h"
+#include "Profiler.h"
+#include "Sampler.h"
+#include "Denoiser.h"
 #include "nlohmann/json.hpp"
 #include <iostream>
 #include <memory>
 #include <fstream>
+#include <sstream>
 #include <cmath>
 #include <limits>
 #include <algorithm>
 #include <random>
+#include <atomic>
+#include <filesystem>
+#include <unordered_map>
+#include <cstdlib>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -23,16 +33,11 @@
 
 using json = nlohmann::json;
 
-Scene parseSceneSettings(const json& sceneJson, int& maxDepth, std::string& renderMode, Vector3& backgroundColor);
-Camera parseCamera(const json& cameraJson, int& imageWidth, int& imageHeight, double& exposure);
-void parseLights(const json& lightsJson, Scene& scene);
-void parseShapes(const json& shapesJson, Scene& scene, std::vector<std::shared_ptr<Intersectable>>& objects);
-Material parseMaterial(const json& materialJson);
-
 RayTracer::RayTracer(Scene* scene, Camera* camera, int imageWidth, int imageHeight)
     : scene(scene), camera(camera), imageWidth(imageWidth), imageHeight(imageHeight) {
-        rng.seed(std::random_device()());
-        dist = std::uniform_real_distribution<double>(0.0, 1.0);
+        frameSeed = std::random_device()();
+        static std::atomic<uint64_t> tracerCount(0);
+        occluderCacheId = ++tracerCount;
     }
 
 
@@ -44,23 +49,155 @@ int main(int argc, char* argv[]) {
     auto start = std::chrono::high_resolution_clock::now();
 
     // Check command-line arguments
-    if (!(argc==3 || argc==4)) {
-        std::cerr << "Usage: raytracer.exe path_to_JSON output_filename.ppm <optional-tonemapping>"<< std::endl;
+    std::vector<std::string> positionalArgs;
+    std::string statsFilename;
+    std::string traceFilename;
+    std::string heatmapFilename;
+    std::string heatmapMetric = "time";
+    std::string cacheFilename;
+    std::string socketPath;
+    std::string cropWindow;
+    std::string cropOutput;
+    std::string seed;
+    std::string workerList;
+    std::string splitMode = "tiles";
+    int jobSize = 64;
+    std::string checkpointFilename;
+    double checkpointInterval = 60.0;
+    bool resume = false;
+    std::string relightFilename;
+    std::string incrementalFilename;
+    std::string aovFilename;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--stats" && i + 1 < argc) {
+            statsFilename = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            traceFilename = argv[++i];
+        } else if (arg == "--heatmap" && i + 1 < argc) {
+            heatmapFilename = argv[++i];
+        } else if (arg == "--heatmap-metric" && i + 1 < argc) {
+            heatmapMetric = argv[++i];
+        } else if (arg == "--scene-cache" && i + 1 < argc) {
+            cacheFilename = argv[++i];
+        } else if (arg == "--serve" && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (arg == "--crop" && i + 1 < argc) {
+            cropWindow = argv[++i];
+        } else if (arg == "--crop-output" && i + 1 < argc) {
+            cropOutput = argv[++i];
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc) {
+            workerList = argv[++i];
+        } else if (arg == "--split" && i + 1 < argc) {
+            splitMode = argv[++i];
+        } else if (arg == "--job-size" && i + 1 < argc) {
+            jobSize = std::atoi(argv[++i]);
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpointFilename = argv[++i];
+        } else if (arg == "--checkpoint-interval" && i + 1 < argc) {
+            checkpointInterval = std::atof(argv[++i]);
+        } else if (arg == "--resume") {
+            resume = true;
+        } else if (arg == "--relight" && i + 1 < argc) {
+            relightFilename = argv[++i];
+        } else if (arg == "--incremental" && i + 1 < argc) {
+            incrementalFilename = argv[++i];
+        } else if (arg == "--aov" && i + 1 < argc) {
+            aovFilename = argv[++i];
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Error: Unknown option '" << arg << "'" << std::endl;
+            return 1;
+        } else {
+            positionalArgs.push_back(arg);
+        }
+    }
+
+    // Server mode keeps scenes resident and takes its jobs from the socket
+    if (!socketPath.empty()) {
+        RenderServer server(socketPath);
+        return server.run() ? 0 : 1;
+    }
+
+    if (!(positionalArgs.size() == 2 || positionalArgs.size() == 3)) {
+        std::cerr << "Usage: raytracer.exe path_to_JSON output_filename.ppm <optional-tonemapping> [--stats stats.json] [--trace trace.json] [--heatmap cost.ppm] [--heatmap-metric nodes|tests|rays|time] [--scene-cache scene.rtscene] [--crop x,y,width,height] [--crop-output cropped|full] [--seed N] [--workers address,...] [--split tiles|samples] [--job-size N] [--checkpoint file.rtckpt [--checkpoint-interval seconds] [--resume]] [--relight file.rtrelight] [--incremental file.rtinc] [--aov aovs.exr]\n       raytracer.exe --serve socket_path|host:port"<< std::endl;
         return 1;
     }
 
-    std::string jsonFilename = argv[1];
-    std::string outputFilename = argv[2];
+    std::string jsonFilename = positionalArgs[0];
+    std::string outputFilename = positionalArgs[1];
 
-    // Load the JSON file
-    std::ifstream jsonFile(jsonFilename);
-    if (!jsonFile.is_open()) {
-        std::cerr << "Error: Could not open JSON file " << jsonFilename << std::endl;
+    // In distributed mode the workers load the shapes; only the settings are needed here
+    std::vector<std::string> workers;
+    std::istringstream workerStream(workerList);
+    for (std::string worker; std::getline(workerStream, worker, ',');) {
+        if (!worker.empty())
+            workers.push_back(worker);
+    }
+    if (!workers.empty() && splitMode != "tiles" && splitMode != "samples") {
+        std::cerr << "Error: --split expects 'tiles' or 'samples'" << std::endl;
+        return 1;
+    }
+    if (!workers.empty())
+        cacheFilename.clear();
+    if (!relightFilename.empty() && !incrementalFilename.empty()) {
+        std::cerr << "Error: --relight and --incremental cannot be combined" << std::endl;
+        return 1;
+    }
+    // Incremental renders compare the shapes one by one, which the scene cache does not keep
+    if (!incrementalFilename.empty())
+        cacheFilename.clear();
+    if (resume && checkpointFilename.empty()) {
+        std::cerr << "Error: --resume needs --checkpoint" << std::endl;
         return 1;
     }
 
+    // Use the binary scene cache when the JSON it was built from is unchanged,
+    // or when only settings outside the shapes array have changed since. A
+    // cache built from another scene file is rebuilt.
+    SceneLoader loader;
+    SceneCache cache;
     json sceneJson;
-    jsonFile >> sceneJson;
+    bool loaderRan = false;
+    bool cacheHit = false;
+    bool writeCache = !cacheFilename.empty();
+    if (!cacheFilename.empty()) {
+        PhaseTimer cacheTimer("cache");
+        if (cache.open(cacheFilename)) {
+            if (!cache.isBuiltFrom(jsonFilename)) {
+                std::cout << "Scene cache " << cacheFilename << " was built from another scene, rebuilding it." << std::endl;
+            } else if (cache.matchesSource(jsonFilename)) {
+                sceneJson = cache.getSettings();
+                cacheHit = sceneJson.is_object();
+                writeCache = !cacheHit;
+            } else {
+                std::cout << "Checking scene cache against " << jsonFilename << "..." << std::endl;
+                loader.setSkipShapes(true);
+                if (!loader.load(jsonFilename))
+                    return 1;
+                loaderRan = true;
+                sceneJson = loader.getSettings();
+                // The cached BVH is only reused when it was built the same way
+                json cachedSettings = cache.getSettings();
+                cacheHit = loader.getShapesHash() == cache.getShapesHash() && cachedSettings.is_object() &&
+                           cachedSettings.value("bvhspatialsplits", false) == sceneJson.value("bvhspatialsplits", false) &&
+                           cachedSettings.value("bvhsplitbudget", 0.3) == sceneJson.value("bvhsplitbudget", 0.3);
+            }
+        }
+    }
+
+    if (cacheHit) {
+        std::cout << "Using scene cache " << cacheFilename << std::endl;
+    } else {
+        // Load the JSON file; shapes are built while it is streamed in
+        std::cout << "Loading scene..." << std::endl;
+        loader.setSkipShapes(!workers.empty());
+        if (!loader.load(jsonFilename))
+            return 1;
+        loaderRan = true;
+        sceneJson = loader.getSettings();
+    }
 
     // Variables to hold parsed data
     int maxDepth = 5;
@@ -85,65 +222,178 @@ int main(int argc, char* argv[]) {
     parseLights(sceneJson["scene"]["lightsources"], scene);
     std::cout << "Lights parsed." << std::endl;
 
-    // Parse shapes
-    std::cout << "Parsing shapes..." << std::endl;
-    std::vector<std::shared_ptr<Intersectable>> objects;
-    parseShapes(sceneJson["scene"]["shapes"], scene, objects);
-    std::cout << "Shapes parsed." << std::endl;
-
-    // Build the BVH
-    if (sceneJson.value("bvh", true)) {
+    // Add the shapes built by the loader, or mapped from the cache
+    if (cacheHit) {
+        PhaseTimer cacheTimer("cache");
+        cache.populate(scene);
+    } else {
+        for (const auto& object : loader.getObjects()) {
+            scene.addObject(object);
+        }
+    }
+    std::cout << scene.objects.size() + scene.unboundedObjects.size() << " shapes loaded." << std::endl;
+
+    // Build the BVH, or only collapse it when it came from the cache
+    if (!sceneJson.value("bvh", true) || !workers.empty()) {
+        scene.bvhRoot = nullptr;
+    } else if (scene.bvhRoot) {
+        PhaseTimer bvhTimer("bvh");
+        scene.collapseBVH();
+    } else {
         std::cout << "Building BVH..." << std::endl;
+        PhaseTimer bvhTimer("bvh");
         scene.buildBVH();
+        bvhTimer.stop();
         std::cout << "BVH built." << std::endl;
+        if (scene.bvhSpatialSplits)
+            std::cout << "Spatial splits added " << scene.bvhSplitReferences << " references." << std::endl;
+        writeCache = !cacheFilename.empty();
+    }
+
+    if (writeCache) {
+        PhaseTimer cacheTimer("cache");
+        if (SceneCache::write(cacheFilename, scene, sceneJson, cacheHit ? cache.getShapesHash() : loader.getShapesHash(),
+                              jsonFilename))
+            std::cout << "Scene cache written to " << cacheFilename << std::endl;
     }
 
     // Create the ray tracer
     RayTracer rayTracer(&scene, &camera, imageWidth, imageHeight);
 
     RayTracer::RenderMode renderModeEnum;
-    if (renderModeStr == "phong")
-        renderModeEnum = RayTracer::PHONG;
-    else if (renderModeStr == "binary")
-        renderModeEnum = RayTracer::BINARY;
-    else if (renderModeStr == "pathtrace")
-        renderModeEnum = RayTracer::PATH_TRACE;
-    else{
-        std::cerr << "Error: Unsupported rendermode '" << renderModeStr << "'. Defaulting to 'phong'." << std::endl;
-        renderModeEnum = RayTracer::PHONG;
-    }
-
-    if (argc == 4) {
-        std::string toneMappingStr = argv[3];
-        if (toneMappingStr == "reinhard") {
-            rayTracer.setToneMap(RayTracer::REINHARD);
-        } else if (toneMappingStr == "ward") {
-            rayTracer.setToneMap(RayTracer::WARD);
-        } else if (toneMappingStr == "uncharted2") {
-            rayTracer.setToneMap(RayTracer::UNCHARTED2);
+    try {
+        renderModeEnum = configureRayTracer(rayTracer, sceneJson, renderModeStr, maxDepth, exposure);
+    } catch (const std::invalid_argument& exception) {
+        std::cerr << "Error: " << exception.what() << std::endl;
+        return 1;
+    }
+
+    if (positionalArgs.size() == 3) {
+        rayTracer.setToneMap(parseToneMapping(positionalArgs[2]));
+    }
+
+    // Command-line crop settings override the scene's
+    if (!cropWindow.empty()) {
+        int x, y, width, height;
+        char separator1, separator2, separator3;
+        std::istringstream cropStream(cropWindow);
+        if (cropStream >> x >> separator1 >> y >> separator2 >> width >> separator3 >> height &&
+            separator1 == ',' && separator2 == ',' && separator3 == ',' && rayTracer.isValidRegion(x, y, width, height)) {
+            rayTracer.setRegion(x, y, width, height);
         } else {
-            std::cerr << "Error: Unsupported tonemapping '" << toneMappingStr << "'. Defaulting to 'none'." << std::endl;
+            std::cerr << "Error: --crop expects x,y,width,height with a positive size, overlapping the "
+                      << imageWidth << "x" << imageHeight << " frame" << std::endl;
+            return 1;
+        }
+    }
+    if (!cropOutput.empty()) {
+        if (cropOutput != "cropped" && cropOutput != "full") {
+            std::cerr << "Error: --crop-output expects 'cropped' or 'full'" << std::endl;
+            return 1;
         }
+        rayTracer.setCropOutput(cropOutput == "cropped");
+    }
+    if (!seed.empty()) {
+        uint64_t seedValue;
+        std::istringstream seedStream(seed);
+        if (!(seedStream >> seedValue)) {
+            std::cerr << "Error: --seed expects a non-negative integer" << std::endl;
+            return 1;
+        }
+        rayTracer.setSeed(seedValue);
     }
 
-    rayTracer.setRenderMode(renderModeEnum);
-    rayTracer.setExposure(exposure);
-    rayTracer.setMaxDepth(maxDepth);
+    // Checkpoints only apply to local path tracing
+    if (!checkpointFilename.empty()) {
+        if (renderModeEnum != RayTracer::PATH_TRACE || !workers.empty()) {
+            std::cerr << "Warning: --checkpoint only applies to local path-traced renders" << std::endl;
+        } else {
+            // The sample target and crop are left out of the scene's identity,
+            // so a resumed render can add samples or cover more of the frame;
+            // "lightsample" sets the pixel sample count (see configureRayTracer)
+            json identity = sceneJson;
+            identity.erase("lightsample");
+            identity.erase("crop");
+            identity.erase("cropoutput");
+            uint64_t shapesHash = cacheHit ? cache.getShapesHash() : loader.getShapesHash();
+            rayTracer.setCheckpoint(checkpointFilename, checkpointInterval,
+                                    RenderCheckpoint::hashScene(identity.dump(), shapesHash));
+            if (resume && !rayTracer.resumeFrom(checkpointFilename))
+                return 1;
+        }
+    }
 
-    if (renderModeEnum == RayTracer::PATH_TRACE) {
-        int nspp = sceneJson.value("pixelsample", 16);
+    // Relighting re-shades the primary hits of an earlier deferred render
+    if (!relightFilename.empty()) {
+        if (renderModeEnum == RayTracer::PATH_TRACE || !workers.empty()) {
+            std::cerr << "Warning: --relight only applies to local phong and binary renders" << std::endl;
+        } else {
+            // The geometry hash comes from the scene file; a fresh scene cache skipped reading it
+            if (!loaderRan) {
+                loader.setSkipShapes(true);
+                if (!loader.load(jsonFilename))
+                    return 1;
+            }
+            rayTracer.setRelight(relightFilename, sceneJson.dump(), loader.getGeometryHash());
+        }
+    }
 
-        int nspal = sceneJson.value("lightsample", 4);
+    // Incremental renders re-render only what the shapes edited since the last run can affect
+    if (!incrementalFilename.empty()) {
+        if (renderModeEnum == RayTracer::PATH_TRACE || !workers.empty()) {
+            std::cerr << "Warning: --incremental only applies to local phong and binary renders" << std::endl;
+        } else {
+            std::vector<BoundingBox> shapeBounds;
+            for (const auto& object : loader.getObjects()) {
+                shapeBounds.push_back(object->getBoundingBox());
+            }
+            rayTracer.setIncremental(incrementalFilename, sceneJson.dump(), loader.getShapeHashes(), shapeBounds);
+        }
+    }
 
-        rayTracer.setLightSample(nspp);
-        rayTracer.setPixelSample(nspal);
+    // AOVs are summed alongside the image in a single local path-traced render
+    if (!aovFilename.empty()) {
+        if (renderModeEnum != RayTracer::PATH_TRACE || !workers.empty() || !checkpointFilename.empty())
+            std::cerr << "Warning: --aov only applies to local path-traced renders without --checkpoint" << std::endl;
+        else
+            rayTracer.setAovs(aovFilename);
+    }
 
+    if (!heatmapFilename.empty()) {
+        RayTracer::CostMetric costMetric = RayTracer::COST_TIME;
+        if (heatmapMetric == "nodes")
+            costMetric = RayTracer::COST_NODES;
+        else if (heatmapMetric == "tests")
+            costMetric = RayTracer::COST_TESTS;
+        else if (heatmapMetric == "rays")
+            costMetric = RayTracer::COST_RAYS;
+        else if (heatmapMetric != "time")
+            std::cerr << "Error: Unsupported heatmap metric '" << heatmapMetric << "'. Defaulting to 'time'." << std::endl;
+        if (costMetric != RayTracer::COST_TIME && !RenderStats::enabled()) {
+            std::cerr << "Warning: --heatmap-metric " << heatmapMetric << " needs a build with make STATS=1. Defaulting to 'time'." << std::endl;
+            costMetric = RayTracer::COST_TIME;
+        }
+        rayTracer.setHeatmap(heatmapFilename, costMetric);
+    }
+
+    if (renderModeEnum == RayTracer::PATH_TRACE) {
         std::cout << "Pixel samples: " << rayTracer.getPixelSamples() << std::endl;
         std::cout << "Light samples: " << rayTracer.getLightSamples() << std::endl;
     }
     
     // Render the scene
-    if (renderModeEnum == RayTracer::PATH_TRACE)
+    if (!workers.empty()) {
+        if (!heatmapFilename.empty())
+            std::cerr << "Warning: --heatmap is not supported with --workers" << std::endl;
+        std::cout << "Rendering on " << workers.size() << " workers..." << std::endl;
+        DistributedRenderer distributed(workers, std::filesystem::absolute(jsonFilename).string());
+        distributed.setSplitMode(splitMode == "samples" ? DistributedRenderer::SPLIT_SAMPLES : DistributedRenderer::SPLIT_TILES);
+        distributed.setJobSize(jobSize);
+        std::vector<std::vector<Vector3>> buffer(imageHeight, std::vector<Vector3>(imageWidth));
+        if (!distributed.render(rayTracer, buffer))
+            return 1;
+        rayTracer.writeImageToPPM(outputFilename, buffer);
+    } else if (renderModeEnum == RayTracer::PATH_TRACE)
         rayTracer.renderPathTrace(outputFilename);
     else
         rayTracer.render(outputFilename);
@@ -153,8 +403,24 @@ int main(int argc, char* argv[]) {
     auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
 
     std::cout << "Rendering complete. Image saved to " << outputFilename << std::endl;
+    RenderStats::printSummary();
     std::cout << "Total execution time: " << duration.count() << " milliseconds" << std::endl;
 
+    if (!statsFilename.empty()) {
+        RenderStats::addPhase("total", std::chrono::duration<double, std::milli>(end - start).count());
+        if (RenderStats::writeJSON(statsFilename, jsonFilename))
+            std::cout << "Render statistics written to " << statsFilename << std::endl;
+    }
+
+    if (Profiler::enabled())
+        Profiler::printSummary();
+    if (!traceFilename.empty()) {
+        if (!Profiler::enabled())
+            std::cerr << "Warning: built without RT_PROFILE (make PROFILE=1), the trace contains no events" << std::endl;
+        if (Profiler::writeChromeTrace(traceFilename))
+            std::cout << "Trace written to " << traceFilename << std::endl;
+    }
+
     return 0;
 }
 
@@ -204,124 +470,131 @@ Vector3 toneMap(Vector3 color, RayTracer::ToneMapping toneMapping) {
 * Function to render the scene and output to a PPM file.
  */
 void RayTracer::render(const std::string& filename) {
-    // Image buffer to store computed colors
+    PhaseTimer renderTimer("render");
+    resetCostBuffer();
+
+    // Image buffer to store computed colors; pixels outside the region stay black
     std::vector<std::vector<Vector3>> buffer(imageHeight, std::vector<Vector3>(imageWidth));
+    int i0, j0, i1, j1;
+    getRegionBounds(i0, j0, i1, j1);
+
+    if (deferredShading || !relightFilename.empty() || !incrementalFilename.empty()) {
+        if (!incrementalFilename.empty())
+            renderIncremental(buffer);
+        else
+            renderDeferred(buffer);
+        renderTimer.stop();
+        writeImageToPPM(filename, buffer);
+        writeHeatmap();
+        return;
+    }
+
+    if (raySorting) {
+        renderBatched(buffer, false);
+        renderTimer.stop();
+        writeImageToPPM(filename, buffer);
+        writeHeatmap();
+        return;
+    }
 
     // Setup OpenMP
     #pragma omp parallel
     {
         // Loop over each pixel
         #pragma omp for schedule(dynamic)
-        for (int j = 0; j < imageHeight; ++j) {
-            for (int i = 0; i < imageWidth; ++i) {
-                double u = 1.0 - (double(i) / (imageWidth - 1));
-                double v = double(j) / (imageHeight - 1);
-
-                Ray ray = camera->getRay(u, v);
-                Vector3 color = traceRay(ray, 0);
-
-                // Apply tone mapping
-                color = toneMap(color, toneMapping);
-
-                // Apply exposure
-                color = color * exposure;
-
-                // Clamp color values to [0,1]
-                color.x = std::min(1.0, std::max(0.0, color.x));
-                color.y = std::min(1.0, std::max(0.0, color.y));
-                color.z = std::min(1.0, std::max(0.0, color.z));
+        for (int j = j0; j < j1; ++j) {
+            RT_PROFILE_TRACE("row");
+            for (int i = i0; i < i1; ++i) {
+                double costStart = sampleCost();
 
                 // Store the computed color in the buffer
-                buffer[j][i] = color;
+                buffer[j][i] = renderPixel(i, j);
+                recordPixelCost(i, j, sampleCost() - costStart);
             }
 
             // Update progress (only from master thread)
             #pragma omp critical
             {
-                int progress = (j * 100) / imageHeight;
+                int progress = ((j - j0) * 100) / (j1 - j0);
                 std::cout << "\rRendering: " << progress << "% completed" << std::flush;
             }
         }
     }
 
+    renderTimer.stop();
+
     // Write the image buffer to a PPM file
     writeImageToPPM(filename, buffer);
+    writeHeatmap();
 }
 
 /*
 * Function to parse the scene settings from the JSON file.
 */
 void RayTracer::renderPathTrace(const std::string& filename) {
-    const int sqrt_nspp = static_cast<int>(std::sqrt(pixelSamples)); // Grid dimensions for stratified sampling
+    PhaseTimer renderTimer("render");
+    resetCostBuffer();
 
-    // Image buffer to store computed colors
+    // Image buffer to store computed colors; pixels outside the region stay black
     std::vector<std::vector<Vector3>> buffer(imageHeight, std::vector<Vector3>(imageWidth));
+    int i0, j0, i1, j1;
+    getRegionBounds(i0, j0, i1, j1);
+
+    if (!checkpointFilename.empty()) {
+        renderProgressive(buffer, filename);
+        renderTimer.stop();
+        if (denoiseIterations > 0)
+            denoiseImage(buffer);
+        writeImageToPPM(filename, buffer);
+        writeHeatmap();
+        return;
+    }
+
+    // The AOVs and the denoiser, which reads its features from them, need the
+    // radiance sums, which sorted batches do not keep
+    bool recordAovs = !aovFilename.empty() || denoiseIterations > 0;
+    if (raySorting && !recordAovs) {
+        renderBatched(buffer, true);
+        renderTimer.stop();
+        writeImageToPPM(filename, buffer);
+        writeHeatmap();
+        return;
+    }
+
+    // Denoised renders and AOVs keep their sums in the checkpoint, as progressive ones do
+    if (recordAovs) {
+        checkpoint.reset(imageWidth, imageHeight, getSampleGrid(), frameSeed, checkpointSceneHash);
+        aovs.reset(imageWidth, imageHeight, i0, j0, i1, j1);
+    }
 
     // Setup OpenMP
     #pragma omp parallel
     {
         // Loop over each pixel
         #pragma omp for schedule(dynamic) 
-        for (int j = 0; j < imageHeight; ++j) {
-            for (int i = 0; i < imageWidth; ++i) {
-                Vector3 color(0, 0, 0);
-
-                // Stratified sampling within the pixel
-                for (int sy = 0; sy < sqrt_nspp; ++sy) {
-                    for (int sx = 0; sx < sqrt_nspp; ++sx) {
-                        // Generate random offsets within the sub-pixel grid cell using thread-local RNG
-                        double r1 = (sx + dist(rng)) / sqrt_nspp;
-                        double r2 = (sy + dist(rng)) / sqrt_nspp;
-
-                        // Map to image plane coordinates
-                        double u = 1.0 - (double(i) + r1) / (imageWidth - 1);
-                        double v = (double(j) + r2) / (imageHeight - 1);
-
-                        // Generate ray and trace it
-                        Ray ray = camera->getRay(u, v, true);
-
-                        color += traceRayPath(ray, 0);
-                    }
-                }
-
-                //Try jittered sampling
-                // for (int s = 0; s < nspp; ++s) {
-                //     double uOffset = dist(rng) / imageWidth;
-                //     double vOffset = dist(rng) / imageHeight;
-                //     double u = 1.0 - (static_cast<double>(i) + uOffset) / (imageWidth - 1);
-                //     double v = (static_cast<double>(j) + vOffset) / (imageHeight - 1);;
-
-                //     // Generate ray and trace it
-                //     Ray ray = camera->getRay(u, v, true);
-
-                //     color += traceRayPath(ray, 0);
-                // }
-
-
-                color /= pixelSamples; // Average the color over all samples
-
-                // Apply tone mapping and exposure
-                color = toneMap(color, toneMapping);
-                color = color * exposure;
-
-                // Gamma correction (sRGB gamma 2.2 approximation)
-                color.x = pow(color.x, 1.0 / 2.2);
-                color.y = pow(color.y, 1.0 / 2.2);
-                color.z = pow(color.z, 1.0 / 2.2);
-
-                // Clamp color values to [0,1]
-                color.x = std::min(1.0, std::max(0.0, color.x));
-                color.y = std::min(1.0, std::max(0.0, color.y));
-                color.z = std::min(1.0, std::max(0.0, color.z));
+        for (int j = j0; j < j1; ++j) {
+            RT_PROFILE_TRACE("row");
+            for (int i = i0; i < i1; ++i) {
+                double costStart = sampleCost();
 
                 // Store the computed color in the buffer
-                buffer[j][i] = color;
+                if (recordAovs) {
+                    size_t pixel = static_cast<size_t>(j) * imageWidth + i;
+                    Vec3<double> squaredSum(0, 0, 0);
+                    checkpoint.radianceSum[pixel] = samplePixel(i, j, 0, getStratifiedSamples(), &squaredSum, recordAovs);
+                    checkpoint.radianceSquaredSum[pixel] = squaredSum;
+                    checkpoint.sampleCount[pixel] = getStratifiedSamples();
+                    buffer[j][i] = resolvePixel(checkpoint.radianceSum[pixel]);
+                } else {
+                    buffer[j][i] = renderPixel(i, j);
+                }
+                recordPixelCost(i, j, sampleCost() - costStart);
             }
 
             // Update progress (only from master thread)
             #pragma omp critical
             {
-                int progress = (j * 100) / imageHeight;
+                int progress = ((j - j0) * 100) / (j1 - j0);
                 std::cout << "\rRendering: " << progress << "% completed" << std::flush;
             }
         }
@@ -345,16 +618,421 @@ void RayTracer::renderPathTrace(const std::string& filename) {
 
     // }
 
+    renderTimer.stop();
+    if (denoiseIterations > 0)
+        denoiseImage(buffer);
+
     // Write the image buffer to a PPM file
     writeImageToPPM(filename, buffer);
+    writeHeatmap();
+    writeAovs();
+}
+
+/*
+* Function to sum the linear radiance of samples [firstSample, firstSample + sampleCount)
+* of pixel (i, j), with j counted from the bottom row. Each sample reseeds the
+* sampler, so the result does not depend on how samples are split between calls.
+* Samples past the end of the stratification grid wrap around it again. Sums are
+* accumulated in double, like the checkpoint they go into.
+* With recordAovs set, each sample's primary hit is added to the AOV sums.
+*/
+Vec3<double> RayTracer::samplePixel(int i, int j, int firstSample, int sampleCount, Vec3<double>* squaredSum,
+                                    bool recordAovs) {
+    uint64_t pixel = static_cast<uint64_t>(j) * imageWidth + i;
+    if (renderMode != PATH_TRACE) {
+        Sampler::seed(frameSeed, pixel, 0);
+        Real u = 1.0 - (Real(i) / (imageWidth - 1));
+        Real v = Real(j) / (imageHeight - 1);
+
+        Ray ray = camera->getRay(u, v);
+        return Vec3<double>(traceRay(ray, 0));
+    }
+
+    const int sqrt_nspp = getSampleGrid(); // Grid dimensions for stratified sampling
+    Vec3<double> color(0, 0, 0);
+
+    // Stratified sampling within the pixel, sample s covers grid cell (s % sqrt_nspp, s / sqrt_nspp)
+    for (int s = firstSample; s < firstSample + sampleCount; ++s) {
+        Ray ray = sampleRay(i, j, s, sqrt_nspp);
+        AovSample aovSample;
+        Vec3<double> radiance(traceRayPath(ray, 0, recordAovs ? &aovSample : nullptr));
+        if (recordAovs)
+            aovs.add(pixel, aovSample);
+        color += radiance;
+        if (squaredSum)
+            *squaredSum += radiance * radiance;
+    }
+
+    //Try jittered sampling
+    // for (int s = 0; s < nspp; ++s) {
+    //     double uOffset = Sampler::next() / imageWidth;
+    //     double vOffset = Sampler::next() / imageHeight;
+    //     double u = 1.0 - (static_cast<double>(i) + uOffset) / (imageWidth - 1);
+    //     double v = (static_cast<double>(j) + vOffset) / (imageHeight - 1);;
+
+    //     // Generate ray and trace it
+    //     Ray ray = camera->getRay(u, v, true);
+
+    //     color += traceRayPath(ray, 0);
+    // }
+
+    return color;
+}
+
+/*
+* Function to generate the camera ray of sample s of pixel (i, j) on a grid x
+* grid stratification. The sampler is seeded for the sample, so the ray is the
+* same every time and the path continues the sample's own sequence.
+*/
+Ray RayTracer::sampleRay(int i, int j, int s, int grid) const {
+    int sx = s % grid;
+    int sy = (s / grid) % grid;
+    Sampler::seed(frameSeed, static_cast<uint64_t>(j) * imageWidth + i, s);
+
+    // Generate random offsets within the sub-pixel grid cell using thread-local RNG
+    Real r1 = (sx + Sampler::next()) / grid;
+    Real r2 = (sy + Sampler::next()) / grid;
+
+    // Map to image plane coordinates
+    Real u = 1.0 - (Real(i) + r1) / (imageWidth - 1);
+    Real v = (Real(j) + r2) / (imageHeight - 1);
+    return camera->getRay(u, v, true);
+}
+
+/*
+* Function to compute the finished color of pixel (i, j), with j counted from the bottom row.
+*/
+Vector3 RayTracer::renderPixel(int i, int j) {
+    if (renderMode != PATH_TRACE)
+        return resolvePixel(samplePixel(i, j, 0, 1));
+    return resolvePixel(samplePixel(i, j, 0, getStratifiedSamples()));
+}
+
+/*
+* Function to turn a pixel's linear radiance sum over all of its samples into its finished color.
+*/
+Vector3 RayTracer::resolvePixel(const Vec3<double>& radianceSum) const {
+    if (renderMode != PATH_TRACE)
+        return finishPixel(Vector3(radianceSum), false);
+    return finishPixel(Vector3(radianceSum / double(pixelSamples)), true); // Average the color over all samples
+}
+
+int RayTracer::getStratifiedSamples() const {
+    if (renderMode != PATH_TRACE)
+        return 1;
+    int sqrt_nspp = static_cast<int>(std::sqrt(pixelSamples));
+    return sqrt_nspp * sqrt_nspp;
+}
+
+/*
+* Function to get the edge of the stratification grid; a resumed render keeps
+* the grid of its checkpoint, so added samples stay evenly spread.
+*/
+int RayTracer::getSampleGrid() const {
+    if (resumed)
+        return checkpoint.sampleGrid;
+    return std::max(1, static_cast<int>(std::sqrt(pixelSamples)));
+}
+
+/*
+* Function to clip the render region to the image and convert it to buffer
+* indices: columns [i0, i1) and rows [j0, j1) with row 0 at the bottom.
+*/
+void RayTracer::getRegionBounds(int& i0, int& j0, int& i1, int& j1) const {
+    if (regionWidth <= 0 || regionHeight <= 0) {
+        i0 = j0 = 0;
+        i1 = imageWidth;
+        j1 = imageHeight;
+        return;
+    }
+    i0 = std::clamp(regionX, 0, imageWidth);
+    i1 = std::clamp(regionX + regionWidth, i0, imageWidth);
+    j0 = std::clamp(imageHeight - (regionY + regionHeight), 0, imageHeight);
+    j1 = std::clamp(imageHeight - regionY, j0, imageHeight);
+}
+
+void RayTracer::getRegion(int& x, int& y, int& width, int& height) const {
+    int i0, j0, i1, j1;
+    getRegionBounds(i0, j0, i1, j1);
+    x = i0;
+    y = imageHeight - j1;
+    width = i1 - i0;
+    height = j1 - j0;
+}
+
+/*
+* Function to path trace the region in passes of one grid row of samples per
+* pixel, accumulating into the checkpoint. After a pass the checkpoint and a
+* preview image are written once the interval has elapsed, and always after
+* the last pass, so an interrupted render loses at most that much work.
+* Ray sorting is not used in this mode. A denoised render records the
+* denoiser's features for the samples it traces in this run.
+*/
+void RayTracer::renderProgressive(std::vector<std::vector<Vector3>>& buffer, const std::string& filename) {
+    int i0, j0, i1, j1;
+    getRegionBounds(i0, j0, i1, j1);
+    if (!resumed)
+        checkpoint.reset(imageWidth, imageHeight, getSampleGrid(), frameSeed, checkpointSceneHash);
+    bool recordAovs = denoiseIterations > 0;
+    if (recordAovs)
+        aovs.reset(imageWidth, imageHeight, i0, j0, i1, j1);
+
+    uint32_t target = static_cast<uint32_t>(getStratifiedSamples());
+    uint32_t done = checkpoint.minSampleCount(i0, j0, i1, j1);
+    if (done > 0)
+        std::cout << "Resuming from " << done << " of " << target << " samples per pixel" << std::endl;
+
+    auto lastCheckpoint = std::chrono::steady_clock::now();
+    while (done < target) {
+        uint32_t passEnd = std::min(done + static_cast<uint32_t>(checkpoint.sampleGrid), target);
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int j = j0; j < j1; ++j) {
+            RT_PROFILE_TRACE("row");
+            for (int i = i0; i < i1; ++i) {
+                // Pixels can be ahead when an earlier run covered a different region
+                size_t pixel = static_cast<size_t>(j) * imageWidth + i;
+                uint32_t have = checkpoint.sampleCount[pixel];
+                if (have >= passEnd)
+                    continue;
+
+                double costStart = sampleCost();
+                Vec3<double> squaredSum(0, 0, 0);
+                checkpoint.radianceSum[pixel] += samplePixel(i, j, have, passEnd - have, &squaredSum, recordAovs);
+                checkpoint.radianceSquaredSum[pixel] += squaredSum;
+                checkpoint.sampleCount[pixel] = passEnd;
+                recordPixelCost(i, j, sampleCost() - costStart);
+            }
+        }
+        done = passEnd;
+        std::cout << "\rRendering: " << (done * 100) / target << "% completed (" << done << " samples per pixel)" << std::flush;
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - lastCheckpoint).count();
+        if (done < target && elapsed < checkpointInterval)
+            continue;
+
+        // Root mean square error of the pixel means, from the per-pixel variance
+        double varianceSum = 0.0;
+        for (int j = j0; j < j1; ++j) {
+            for (int i = i0; i < i1; ++i) {
+                varianceSum += checkpoint.meanVariance(static_cast<size_t>(j) * imageWidth + i);
+            }
+        }
+        double rmsError = std::sqrt(varianceSum / std::max(1, (i1 - i0) * (j1 - j0)));
+
+        if (checkpoint.write(checkpointFilename))
+            std::cout << "\nCheckpoint written to " << checkpointFilename << " (RMS error " << rmsError << ")" << std::endl;
+        if (done < target) {
+            resolveCheckpoint(buffer);
+            writeImageToPPM(filename, buffer);
+        }
+        lastCheckpoint = std::chrono::steady_clock::now();
+    }
+    resolveCheckpoint(buffer);
+}
+
+/*
+* Function to resolve the checkpoint's region into finished colors. The mean is
+* scaled back to a full grid's sum, so a completed checkpoint resolves exactly
+* like a render that traced all samples in one go.
+*/
+void RayTracer::resolveCheckpoint(std::vector<std::vector<Vector3>>& buffer) const {
+    int i0, j0, i1, j1;
+    getRegionBounds(i0, j0, i1, j1);
+    double fullSamples = getStratifiedSamples();
+    for (int j = j0; j < j1; ++j) {
+        for (int i = i0; i < i1; ++i) {
+            size_t pixel = static_cast<size_t>(j) * imageWidth + i;
+            uint32_t count = checkpoint.sampleCount[pixel];
+            if (count > 0)
+                buffer[j][i] = resolvePixel(checkpoint.radianceSum[pixel] * (fullSamples / count));
+        }
+    }
+}
+
+/*
+* Function to render the region tile by tile, handing each finished tile to a
+* callback as soon as it is done. Tiles are rendered in parallel; the callback
+* is called by one thread at a time. With radiance set, tiles hold the linear
+* radiance sums of the samples selected by setSampleRange instead of colors.
+*/
+void RayTracer::renderTiles(const TileCallback& onTile, bool radiance) {
+    PhaseTimer renderTimer("render");
+    bool batched = raySorting && !radiance;
+    if (batched)
+        sceneBounds = scene->getBounds();
+
+    int firstSample = std::clamp(sampleRangeFirst, 0, getStratifiedSamples());
+    int sampleCount = sampleRangeCount < 0 ? getStratifiedSamples() - firstSample
+                                           : std::min(sampleRangeCount, getStratifiedSamples() - firstSample);
+
+    int i0, j0, i1, j1;
+    getRegionBounds(i0, j0, i1, j1);
+    int tilesX = (i1 - i0 + tileSize - 1) / tileSize;
+    int tilesY = (j1 - j0 + tileSize - 1) / tileSize;
+    int tileCount = tilesX * tilesY;
+
+    #pragma omp parallel
+    {
+        std::vector<Vector3> tileColors;
+        std::vector<Vec3<double>> pixels;
+
+        #pragma omp for schedule(dynamic)
+        for (int tile = 0; tile < tileCount; ++tile) {
+            RT_PROFILE_TRACE("tile");
+            int x0 = i0 + (tile % tilesX) * tileSize;
+            int y0 = j0 + (tile / tilesX) * tileSize;
+            int x1 = std::min(x0 + tileSize, i1);
+            int y1 = std::min(y0 + tileSize, j1);
+            int tileWidth = x1 - x0;
+            int tileHeight = y1 - y0;
+
+            // Tiles are handed out top row first, in image coordinates
+            pixels.resize(tileWidth * tileHeight);
+            if (batched)
+                traceTileBatched(x0, y0, x1, y1, tileColors);
+            for (int j = y0; j < y1; ++j) {
+                int row = y1 - 1 - j;
+                for (int i = x0; i < x1; ++i) {
+                    Vec3<double>& pixel = pixels[row * tileWidth + (i - x0)];
+                    if (batched)
+                        pixel = Vec3<double>(finishPixel(tileColors[(j - y0) * tileWidth + (i - x0)], renderMode == PATH_TRACE));
+                    else if (radiance)
+                        pixel = samplePixel(i, j, firstSample, sampleCount);
+                    else
+                        pixel = Vec3<double>(renderPixel(i, j));
+                }
+            }
+
+            #pragma omp critical
+            onTile(x0, imageHeight - y1, tileWidth, tileHeight, pixels);
+        }
+    }
+}
+
+/*
+* Function to read the calling thread's running total of the heatmap cost metric.
+*/
+double RayTracer::sampleCost() const {
+    if (heatmapFilename.empty())
+        return 0.0;
+
+    // The counter metrics are only offered by builds that count (see main)
+    const RenderCounters& counters = RenderStats::local();
+    switch (costMetric) {
+        case COST_NODES:
+            return static_cast<double>(counters.bvhNodeVisits);
+        case COST_TESTS:
+            return static_cast<double>(counters.primitiveTests);
+        case COST_RAYS:
+            return static_cast<double>(counters.totalRays());
+        case COST_TIME:
+        default:
+            return static_cast<double>(Profiler::now());
+    }
+}
+
+void RayTracer::resetCostBuffer() {
+    if (heatmapFilename.empty())
+        return;
+    costBuffer.assign(imageHeight, std::vector<double>(imageWidth, 0.0));
+}
+
+void RayTracer::recordPixelCost(int i, int j, double cost) {
+    if (!heatmapFilename.empty())
+        costBuffer[j][i] += cost;
+}
+
+/*
+* Function to map a normalized cost in [0,1] to a black-blue-red-yellow-white ramp.
+*/
+Vector3 heatColor(double t) {
+    static const Vector3 ramp[] = {
+        Vector3(0.0, 0.0, 0.0),
+        Vector3(0.0, 0.0, 1.0),
+        Vector3(1.0, 0.0, 0.0),
+        Vector3(1.0, 1.0, 0.0),
+        Vector3(1.0, 1.0, 1.0)
+    };
+    const int segments = 4;
+
+    t = std::clamp(t, 0.0, 1.0) * segments;
+    int index = std::min(static_cast<int>(t), segments - 1);
+    double f = t - index;
+    return ramp[index] * (1.0 - f) + ramp[index + 1] * f;
+}
+
+/*
+* Function to write the per-pixel cost buffer as a false colour image.
+*/
+void RayTracer::writeHeatmap() {
+    if (heatmapFilename.empty())
+        return;
+
+    double maxCost = 0.0;
+    double totalCost = 0.0;
+    for (const auto& row : costBuffer) {
+        for (double cost : row) {
+            maxCost = std::max(maxCost, cost);
+            totalCost += cost;
+        }
+    }
+
+    // Costs are heavily skewed (deep glass paths cost orders of magnitude more than
+    // diffuse hits), so the ramp is applied on a log scale
+    int i0, j0, i1, j1;
+    getRegionBounds(i0, j0, i1, j1);
+    double regionPixels = std::max(1, (i1 - i0) * (j1 - j0));
+
+    double logMax = std::log1p(maxCost);
+    std::vector<std::vector<Vector3>> heatBuffer(imageHeight, std::vector<Vector3>(imageWidth));
+    for (int j = 0; j < imageHeight; ++j) {
+        for (int i = 0; i < imageWidth; ++i) {
+            heatBuffer[j][i] = heatColor(logMax > 0.0 ? std::log1p(costBuffer[j][i]) / logMax : 0.0);
+        }
+    }
+    writeImageToPPM(heatmapFilename, heatBuffer);
+
+    static const char* metricNames[] = {"BVH nodes", "primitive tests", "rays", "ns"};
+    std::cout << "\nHeatmap written to " << heatmapFilename << " (white = " << maxCost << " "
+              << metricNames[costMetric] << " per pixel, mean " << totalCost / regionPixels << ")" << std::endl;
+}
+
+/*
+* Function to tone map, expose, gamma correct and clamp a linear pixel color.
+*/
+Vector3 RayTracer::finishPixel(Vector3 color, bool gammaCorrect) const {
+    // Apply tone mapping and exposure
+    color = toneMap(color, toneMapping);
+    color = color * exposure;
+
+    // Gamma correction (sRGB gamma 2.2 approximation)
+    if (gammaCorrect) {
+        color.x = pow(color.x, 1.0 / 2.2);
+        color.y = pow(color.y, 1.0 / 2.2);
+        color.z = pow(color.z, 1.0 / 2.2);
+    }
+
+    // Clamp color values to [0,1]
+    color.x = std::min(Real(1), std::max(Real(0), color.x));
+    color.y = std::min(Real(1), std::max(Real(0), color.y));
+    color.z = std::min(Real(1), std::max(Real(0), color.z));
+    return color;
 }
 
 void RayTracer::writeImageToPPM(const std::string& filename, const std::vector<std::vector<Vector3>>& buffer) {
+    PhaseTimer writeTimer("write");
+
+    // A cropped image holds only the region, otherwise the full frame is written
+    int i0 = 0, j0 = 0, i1 = imageWidth, j1 = imageHeight;
+    if (cropOutput)
+        getRegionBounds(i0, j0, i1, j1);
+
     std::ofstream outFile(filename);
-    outFile << "P3\n" << imageWidth << " " << imageHeight << "\n255\n";
+    outFile << "P3\n" << i1 - i0 << " " << j1 - j0 << "\n255\n";
 
-    for (int j = imageHeight - 1; j >= 0; --j) {
-        for (int i = 0; i < imageWidth; ++i) {
+    for (int j = j1 - 1; j >= j0; --j) {
+        for (int i = i0; i < i1; ++i) {
             Vector3 color = buffer[j][i];
             int ir = static_cast<int>(255.999 * color.x);
             int ig = static_cast<int>(255.999 * color.y);
@@ -367,6 +1045,16 @@ outFile.close();
 }
 
 
+/*
+* Function to count a traced ray as primary or secondary.
+*/
+static inline void countRay(int depth) {
+    if (depth == 0)
+        RT_STAT(primaryRays);
+    else
+        RT_STAT(secondaryRays);
+}
+
 /* 
 * Function to trace a ray and compute the shading.
 */
@@ -376,6 +1064,8 @@ Vector3 RayTracer::traceRay(const Ray& ray, int depth) {
         return scene->backgroundColor;
     }
 
+    countRay(depth);
+
     HitRecord hitRecord;
     if (scene->intersect(ray, hitRecord)) {
         if (renderMode == PHONG) 
@@ -397,48 +1087,48 @@ Vector3 RayTracer::traceRay(const Ray& ray, int depth) {
 */
 Vector3 randomInHemisphere(const Vector3& normal) {
     // Generate random numbers
-    double r1 = ((double)rand() / RAND_MAX);
-    double r2 = ((double)rand() / RAND_MAX);
+    Real r1 = Sampler::next();
+    Real r2 = Sampler::next();
 
     // Convert to spherical coordinates
-    double sinTheta = sqrt(1 - r1 * r1);
-    double phi = 2 * M_PI * r2;
+    Real sinTheta = sqrt(1 - r1 * r1);
+    Real phi = 2 * M_PI * r2;
 
     // Convert to Cartesian coordinates
-    double x = cos(phi) * sinTheta;
-    double y = r1; // Cos(theta)
-    double z = sin(phi) * sinTheta;
+    Real x = cos(phi) * sinTheta;
+    Real y = r1; // Cos(theta)
+    Real z = sin(phi) * sinTheta;
 
     // Create an orthonormal basis (tangent, bitangent, normal)
     Vector3 tangent, bitangent;
     if (fabs(normal.x) > fabs(normal.y)) {
-        tangent = Vector3(-normal.z, 0, normal.x).normalize();
+        tangent = Vector3(-normal.z, 0, normal.x).normalizeFast();
     } else {
-        tangent = Vector3(0, normal.z, -normal.y).normalize();
+        tangent = Vector3(0, normal.z, -normal.y).normalizeFast();
     }
     bitangent = normal.cross(tangent);
 
     // Transform the sampled direction to world space
     Vector3 direction = tangent * x + normal * y + bitangent * z;
-    return direction.normalize();
+    return direction.normalizeFast();
 }
 
 
 /* 
 * Pathtracing Function to refract a vector through a surface. 
 */
-Vector3 refract(const Vector3& I, const Vector3& N, double eta_t, double eta_i = 1.0) {
+Vector3 refract(const Vector3& I, const Vector3& N, Real eta_t, Real eta_i = 1.0) {
     // I: Incident direction (normalized)
     // N: Surface normal (normalized)
     // eta_i: Refractive index of incident medium
     // eta_t: Refractive index of transmitted medium
-    double cosi = -std::max(-1.0, std::min(1.0, I.dot(N)));
+    Real cosi = -std::max(Real(-1), std::min(Real(1), I.dot(N)));
     if (cosi < 0) {
         // Ray is inside the medium
         return refract(I, -N, eta_i, eta_t);
     }
-    double eta = eta_i / eta_t;
-    double k = 1 - eta * eta * (1 - cosi * cosi);
+    Real eta = eta_i / eta_t;
+    Real k = 1 - eta * eta * (1 - cosi * cosi);
     if (k < 0) {
         // Total internal reflection
         return Vector3(0, 0, 0);
@@ -450,23 +1140,23 @@ Vector3 refract(const Vector3& I, const Vector3& N, double eta_t, double eta_i =
 /*
 * Function to compute the Fresnel reflectance.
 */
-double fresnel(const Vector3& I, const Vector3& N, double eta_t, double eta_i = 1.0) {
-    double cosi = std::clamp(I.dot(N), -1.0, 1.0);
-    double etai = eta_i;
-    double etat = eta_t;
+Real fresnel(const Vector3& I, const Vector3& N, Real eta_t, Real eta_i = 1.0) {
+    Real cosi = std::clamp(I.dot(N), Real(-1), Real(1));
+    Real etai = eta_i;
+    Real etat = eta_t;
     if (cosi > 0) {
         std::swap(etai, etat);
     }
     // Compute sini using Snell's law
-    double sint = etai / etat * sqrt(std::max(0.0, 1 - cosi * cosi));
+    Real sint = etai / etat * sqrt(std::max(Real(0), 1 - cosi * cosi));
     // Total internal reflection
     if (sint >= 1) {
         return 1.0;
     } else {
-        double cost = sqrt(std::max(0.0, 1 - sint * sint));
+        Real cost = sqrt(std::max(Real(0), 1 - sint * sint));
         cosi = fabs(cosi);
-        double Rs = ((etat * cosi) - (etai * cost)) / ((etat * cosi) + (etai * cost));
-        double Rp = ((etai * cosi) - (etat * cost)) / ((etai * cosi) + (etat * cost));
+        Real Rs = ((etat * cosi) - (etai * cost)) / ((etat * cosi) + (etai * cost));
+        Real Rp = ((etai * cosi) - (etat * cost)) / ((etai * cosi) + (etat * cost));
         return (Rs * Rs + Rp * Rp) / 2.0;
     }
 }
@@ -487,9 +1177,9 @@ bool shouldTerminate(const Vector3& albedo, int depth) {
     if (depth < 5) {
         return false;
     }
-    double maxComponent = std::max(albedo.x, std::max(albedo.y, albedo.z));
-    double terminationProbability = 1.0 - maxComponent;
-    double randomValue = ((double)rand() / RAND_MAX);
+    Real maxComponent = std::max(albedo.x, std::max(albedo.y, albedo.z));
+    Real terminationProbability = 1.0 - maxComponent;
+    Real randomValue = Sampler::next();
     return randomValue < terminationProbability;
 }
 
@@ -497,19 +1187,28 @@ bool shouldTerminate(const Vector3& albedo, int depth) {
 /* 
 * Function to compute the Fresnel reflectance.
 */
-double fresnelReflectance(double cosTheta, double refractiveIndex) {
-    double r0 = (1.0 - refractiveIndex) / (1.0 + refractiveIndex);
+Real fresnelReflectance(Real cosTheta, Real refractiveIndex) {
+    Real r0 = (1.0 - refractiveIndex) / (1.0 + refractiveIndex);
     r0 = r0 * r0;
     return r0 + (1.0 - r0) * pow(1.0 - cosTheta, 5.0);
 }
 
-Vector3 RayTracer::traceRayPath(const Ray& ray, int depth) {
+/*
+* Function to trace a path and return the radiance it carries back along ray.
+* When aov is given (primary rays only), the light reaching the first hit
+* directly and the hit's features are recorded in it.
+*/
+Vector3 RayTracer::traceRayPath(const Ray& ray, int depth, AovSample* aov) {
     if (depth >= maxDepth) {
         return Vector3(0, 0, 0);
     }
 
+    countRay(depth);
+
     HitRecord hitRecord;
     if (!scene->intersect(ray, hitRecord)) {
+        if (aov)
+            aov->direct = scene->backgroundColor;
         return scene->backgroundColor;
     }
 
@@ -521,15 +1220,15 @@ Vector3 RayTracer::traceRayPath(const Ray& ray, int depth) {
     // Get albedo (diffuse color or texture)
     Vector3 albedo = hitRecord.material.diffuseColor;
     if (hitRecord.material.hasTexture && hitRecord.getUV) {
-        double u, v;
+        Real u, v;
         hitRecord.getUV(hitRecord.point, u, v);
         albedo = hitRecord.material.getTextureColor(u, v);
     }
 
     // Russian Roulette termination
     if (depth > 3) {
-        double maxReflectance = std::max(albedo.x, std::max(albedo.y, albedo.z));
-        if (dist(rng) > maxReflectance) {
+        Real maxReflectance = std::max(albedo.x, std::max(albedo.y, albedo.z));
+        if (Sampler::next() > maxReflectance) {
             return Vector3(0, 0, 0);
         }
         albedo = albedo / maxReflectance;
@@ -539,19 +1238,28 @@ Vector3 RayTracer::traceRayPath(const Ray& ray, int depth) {
     Vector3 directLight = estimateDirectLight(hitRecord, -ray.direction.normalize());
     Vector3 indirectLight(0, 0, 0);
 
+    if (aov) {
+        const Material& material = hitRecord.material;
+        aov->direct = directLight;
+        aov->albedo = material.isReflective || material.isRefractive ? Vector3(1, 1, 1) : albedo;
+        aov->normal = normal;
+        aov->depth = hitRecord.t * ray.direction.length();
+        aov->object = hitRecord.object;
+    }
+
     // Handle different material types
     if (hitRecord.material.isReflective) {
         
         Vector3 reflectedDir = reflect(ray.direction.normalize(), normal).normalize();
-        Ray reflectedRay(hitRecord.point + normal * shadowBias, reflectedDir);
+        Ray reflectedRay(offsetRayOrigin(hitRecord.point, normal), reflectedDir);
         
         Vector3 reflectedColor = traceRayPath(reflectedRay, depth + 1);
         indirectLight = reflectedColor * hitRecord.material.reflectivity;
 
     } else if (hitRecord.material.isRefractive) {
         normal = hitRecord.normal;
-        double eta_i = 1.0;
-        double eta_t = hitRecord.material.refractiveIndex;
+        Real eta_i = 1.0;
+        Real eta_t = hitRecord.material.refractiveIndex;
         Vector3 incident = ray.direction.normalize();
         bool entering = incident.dot(normal) < 0;
         
@@ -560,12 +1268,11 @@ Vector3 RayTracer::traceRayPath(const Ray& ray, int depth) {
             normal = -normal;
         }
 
-        double fresnelCoeff = fresnel(incident, normal, eta_t, eta_i);
-        Vector3 bias = normal * shadowBias;
+        Real fresnelCoeff = fresnel(incident, normal, eta_t, eta_i);
 
         // Always calculate reflection
         Vector3 reflectDir = reflect(incident, normal).normalize();
-        Ray reflectRay(hitRecord.point + bias, reflectDir);
+        Ray reflectRay(offsetRayOrigin(hitRecord.point, normal), reflectDir);
         Vector3 reflectColor = traceRayPath(reflectRay, depth + 1);
 
         // Calculate refraction
@@ -573,7 +1280,7 @@ Vector3 RayTracer::traceRayPath(const Ray& ray, int depth) {
         Vector3 refractColor;
 
         if (refractDir.length() > 0.0) {
-            Ray refractRay(hitRecord.point - bias, refractDir);
+            Ray refractRay(offsetRayOrigin(hitRecord.point, -normal), refractDir);
             refractColor = traceRayPath(refractRay, depth + 1);
             indirectLight = reflectColor * fresnelCoeff + refractColor * (1.0 - fresnelCoeff);
         } else {
@@ -585,8 +1292,8 @@ Vector3 RayTracer::traceRayPath(const Ray& ray, int depth) {
     else {
         // Diffuse material
         Vector3 newDir = randomInHemisphere(normal);
-        double cosTheta = std::max(0.0, newDir.dot(normal));
-        Ray newRay(hitRecord.point + normal * shadowBias, newDir);
+        Real cosTheta = std::max(Real(0), newDir.dot(normal));
+        Ray newRay(offsetRayOrigin(hitRecord.point, normal), newDir);
         
         indirectLight = traceRayPath(newRay, depth + 1) * (albedo / M_PI) * cosTheta;
     }
@@ -595,38 +1302,85 @@ Vector3 RayTracer::traceRayPath(const Ray& ray, int depth) {
 }
 
 
+/*
+* Last occluder found for each light by the shadow rays of the calling thread.
+* Neighbouring shading points tend to be shadowed by the same primitive, so
+* testing it first often answers the ray without a traversal. The entries
+* belong to one RayTracer (and so one scene) and are dropped when another
+* tracer uses the thread.
+*/
+namespace {
+
+struct OccluderCache {
+    uint64_t tracerId = 0;
+    std::vector<const Intersectable*> lastOccluder;
+};
+
+thread_local OccluderCache threadOccluderCache;
+
+}
+
+/*
+* Function to test whether a shadow ray hits anything before reaching the light.
+*/
+bool RayTracer::isShadowed(const Ray& shadowRay, Real lightDistance, size_t lightIndex) {
+    RT_PROFILE_ZONE(ProfileZone::ShadowRay);
+    RT_STAT(shadowRays);
+
+    const Intersectable* occluder = nullptr;
+    if (!occluderCache)
+        return scene->occluded(shadowRay, lightDistance, occluder);
+
+    OccluderCache& cache = threadOccluderCache;
+    if (cache.tracerId != occluderCacheId) {
+        cache.tracerId = occluderCacheId;
+        cache.lastOccluder.assign(scene->lights.size(), nullptr);
+    }
+    const Intersectable*& cached = cache.lastOccluder[lightIndex];
+    if (cached && cached->occluded(shadowRay, lightDistance, occluder)) {
+        RT_STAT(shadowCacheHits);
+        return true;
+    }
+    if (scene->occluded(shadowRay, lightDistance, occluder)) {
+        cached = occluder;
+        return true;
+    }
+    return false;
+}
+
 Vector3 RayTracer::estimateDirectLight(const HitRecord& hitRecord, const Vector3& viewDir) {
+    RT_PROFILE_ZONE(ProfileZone::Shading);
     Vector3 directLight(0, 0, 0);
 
-    for (const auto& light : scene->lights) {
+    for (size_t lightIndex = 0; lightIndex < scene->lights.size(); ++lightIndex) {
+        const auto& light = scene->lights[lightIndex];
         if (light->type == Light::POINT) {
             // Handle point light
             auto pointLight = std::static_pointer_cast<PointLight>(light);
             Vector3 lightDir = (pointLight->getPosition() - hitRecord.point).normalize();
-            double distance = (pointLight->getPosition() - hitRecord.point).length();
+            Real distance = (pointLight->getPosition() - hitRecord.point).length();
 
             // Shadow check
-            Ray shadowRay(hitRecord.point + hitRecord.normal * shadowBias, lightDir);
-            HitRecord shadowHit;
-            if (scene->intersect(shadowRay, shadowHit) && shadowHit.t < distance) {
+            Ray shadowRay(offsetRayOrigin(hitRecord.point, hitRecord.normal), lightDir);
+            if (isShadowed(shadowRay, distance, lightIndex)) {
                 continue; // In shadow
             }
 
             // Compute BRDF components
-            double ndotl = std::max(0.0, hitRecord.normal.dot(lightDir));
+            Real ndotl = std::max(Real(0), hitRecord.normal.dot(lightDir));
 
 
             Vector3 diffuseBRDF = (hitRecord.material.diffuseColor * hitRecord.material.kd) / M_PI;
             if (hitRecord.material.hasTexture) {
-                double u, v;
+                Real u, v;
                 hitRecord.getUV(hitRecord.point, u, v);
                 diffuseBRDF = hitRecord.material.getTextureColor(u, v) * hitRecord.material.kd / M_PI;
             }
 
             // Specular component using Blinn-Phong model
             Vector3 halfVector = (lightDir + viewDir).normalize();
-            double ndoth = std::max(0.0, hitRecord.normal.dot(halfVector));
-            double specularFactor = pow(ndoth, hitRecord.material.specularExponent);
+            Real ndoth = std::max(Real(0), hitRecord.normal.dot(halfVector));
+            Real specularFactor = pow(ndoth, hitRecord.material.specularExponent);
             Vector3 specularBRDF = hitRecord.material.specularColor * hitRecord.material.ks * ((hitRecord.material.specularExponent + 2.0) / (2.0 * M_PI)) * specularFactor;
 
             // Total BRDF
@@ -642,33 +1396,32 @@ Vector3 RayTracer::estimateDirectLight(const HitRecord& hitRecord, const Vector3
 
             for (int i = 0; i < lightSamples; i++) {
                 Vector3 lightDir;
-                double distance, pdf;
+                Real distance, pdf;
                 Vector3 intensity = areaLight->sample(hitRecord.point, lightDir, distance, pdf);
 
                 // Shadow check
-                Ray shadowRay(hitRecord.point + hitRecord.normal * shadowBias, lightDir);
-                HitRecord shadowHit;
-                if (scene->intersect(shadowRay, shadowHit) && shadowHit.t < distance) {
+                Ray shadowRay(offsetRayOrigin(hitRecord.point, hitRecord.normal), lightDir);
+                if (isShadowed(shadowRay, distance, lightIndex)) {
                     continue; // In shadow
                 }
 
                 // Compute BRDF components
-                double ndotl = std::max(0.0, hitRecord.normal.dot(lightDir));
-                double ndotl_light = std::max(0.0, areaLight->normal.dot(-lightDir));
+                Real ndotl = std::max(Real(0), hitRecord.normal.dot(lightDir));
+                Real ndotl_light = std::max(Real(0), areaLight->normal.dot(-lightDir));
 
                 if (ndotl > 0 && ndotl_light > 0) {
                     // Diffuse component
                     Vector3 diffuseBRDF = (hitRecord.material.diffuseColor * hitRecord.material.kd) / M_PI;
                     if (hitRecord.material.hasTexture) {
-                        double u, v;
+                        Real u, v;
                         hitRecord.getUV(hitRecord.point, u, v);
                         diffuseBRDF = hitRecord.material.getTextureColor(u, v) * hitRecord.material.kd / M_PI;
                     } 
 
                     // Specular component using Blinn-Phong model
                     Vector3 halfVector = (lightDir + viewDir).normalize();
-                    double ndoth = std::max(0.0, hitRecord.normal.dot(halfVector));
-                    double specularFactor = pow(ndoth, hitRecord.material.specularExponent);
+                    Real ndoth = std::max(Real(0), hitRecord.normal.dot(halfVector));
+                    Real specularFactor = pow(ndoth, hitRecord.material.specularExponent);
                     Vector3 specularBRDF = hitRecord.material.specularColor * hitRecord.material.ks * ((hitRecord.material.specularExponent + 2.0) / (2.0 * M_PI)) * specularFactor;
 
                     // Total BRDF
@@ -689,15 +1442,17 @@ Vector3 RayTracer::estimateDirectLight(const HitRecord& hitRecord, const Vector3
 }
 
 /*
-* Function to compute Phong shading.
+* Function to compute the local (ambient, diffuse and specular) Phong terms.
 */
-Vector3 RayTracer::computeShadingPhong(const HitRecord& hitRecord, const Ray& ray, int depth) {
+Vector3 RayTracer::computeLocalPhong(const HitRecord& hitRecord, const Ray& ray) {
+    RT_PROFILE_ZONE(ProfileZone::Shading);
+
     // Ambient component
-    double ambientIntensity = 0.25;
+    Real ambientIntensity = 0.25;
 
     Vector3 textureColor = hitRecord.material.diffuseColor;
     if (hitRecord.material.hasTexture) {
-        double u, v;
+        Real u, v;
         hitRecord.getUV(hitRecord.point, u, v);
         textureColor = hitRecord.material.getTextureColor(u, v);
     }
@@ -712,86 +1467,93 @@ Vector3 RayTracer::computeShadingPhong(const HitRecord& hitRecord, const Ray& ra
     Vector3 viewDir = -ray.direction.normalize();
 
     // Iterate over each light source
-    for (const auto& light : scene->lights) {
-
+    for (size_t lightIndex = 0; lightIndex < scene->lights.size(); ++lightIndex) {
+        const auto& light = scene->lights[lightIndex];
 
         Vector3 lightDir = (light->getPosition() - hitRecord.point).normalize();
         Vector3 halfVector = (lightDir + viewDir).normalize();
 
         // Shadow check
-        Ray shadowRay(hitRecord.point + hitRecord.normal * shadowBias, lightDir);
-        HitRecord shadowHit;
-        bool inShadow = false;
-        if (scene->intersect(shadowRay, shadowHit)) {
-            double lightDistance = (light->getPosition() - hitRecord.point).length();
-            if (shadowHit.t < lightDistance) {
-                inShadow = true;
-            }
-        }
+        Ray shadowRay(offsetRayOrigin(hitRecord.point, hitRecord.normal), lightDir);
+        bool inShadow = isShadowed(shadowRay, (light->getPosition() - hitRecord.point).length(), lightIndex);
 
         if (!inShadow) {
             // Diffuse shading (Lambertian)
-            double diffuseFactor = std::max(0.0, hitRecord.normal.dot(lightDir));
+            Real diffuseFactor = std::max(Real(0), hitRecord.normal.dot(lightDir));
 
             // Get texture color if available
 
             diffuseColor += textureColor * hitRecord.material.kd * diffuseFactor * light->intensity;
 
             // Specular shading (Blinn-Phong)
-            double specularFactor = pow(std::max(0.0, hitRecord.normal.dot(halfVector)), hitRecord.material.specularExponent);
+            Real specularFactor = pow(std::max(Real(0), hitRecord.normal.dot(halfVector)), hitRecord.material.specularExponent);
             specularColor += hitRecord.material.specularColor * hitRecord.material.ks * specularFactor * light->intensity;
         }
     }
     // Combine ambient, diffuse, and specular components
-    Vector3 localColor = ambientColor + diffuseColor + specularColor;
+    return ambientColor + diffuseColor + specularColor;
+}
+
+/*
+* Function to compute Phong shading.
+*/
+Vector3 RayTracer::computeShadingPhong(const HitRecord& hitRecord, const Ray& ray, int depth) {
+    Vector3 localColor = computeLocalPhong(hitRecord, ray);
+    return computeIndirectPhong(hitRecord.point, hitRecord.normal, hitRecord.material, ray.direction, depth, localColor);
+}
 
+/*
+* Function to add the reflected and refracted rays of a Phong hit to its local color.
+*/
+Vector3 RayTracer::computeIndirectPhong(const Vector3& point, const Vector3& surfaceNormal, const Material& material,
+                                        const Vector3& direction, int depth, Vector3 localColor) {
     // Recursive reflection
-    if (hitRecord.material.isReflective) {
-        Vector3 normal = hitRecord.normal;
-        if (ray.direction.dot(normal) > 0.0) {
+    if (material.isReflective) {
+        Vector3 normal = surfaceNormal;
+        if (direction.dot(normal) > 0.0) {
             normal = -normal;
         }
 
 
-        Vector3 reflectedDir = ray.direction - normal * 2 * ray.direction.dot(normal);
-        Ray reflectedRay(hitRecord.point + normal * shadowBias, reflectedDir);
+        Vector3 reflectedDir = direction - normal * 2 * direction.dot(normal);
+        Ray reflectedRay(offsetRayOrigin(point, normal), reflectedDir);
         Vector3 reflectedColor = traceRay(reflectedRay, depth + 1);
-        localColor = localColor * (1 - hitRecord.material.reflectivity) + reflectedColor * hitRecord.material.reflectivity;
+        localColor = localColor * (1 - material.reflectivity) + reflectedColor * material.reflectivity;
     }
 
     // Recursive refraction with Fresnel reflection
     // Recursive refraction with Fresnel mixing
-    if (hitRecord.material.isRefractive && depth < maxDepth) {
-        double n1 = 1.0;  // Assume air's refractive index is 1
-        double n2 = hitRecord.material.refractiveIndex;
-        Vector3 normal = hitRecord.normal;
+    if (material.isRefractive && depth < maxDepth) {
+        Real n1 = 1.0;  // Assume air's refractive index is 1
+        Real n2 = material.refractiveIndex;
+        Vector3 normal = surfaceNormal;
 
         // Flip normal if the ray is exiting the object
-        if (ray.direction.dot(normal) > 0.0) {
+        if (direction.dot(normal) > 0.0) {
             normal = -normal;
             std::swap(n1, n2);
         }
 
-        double eta = n1 / n2;
-        double cosI = -normal.dot(ray.direction);
-        double sinT2 = eta * eta * (1.0 - cosI * cosI);
+        Real eta = n1 / n2;
+        Real cosI = -normal.dot(direction);
+        Real sinT2 = eta * eta * (1.0 - cosI * cosI);
 
         // Check for total internal reflection
         if (sinT2 <= 1.0) {
-            double cosT = std::sqrt(1.0 - sinT2);
-            Vector3 refractDir = ray.direction * eta + normal * (eta * cosI - cosT);
+            Real cosT = std::sqrt(1.0 - sinT2);
+            Vector3 refractDir = direction * eta + normal * (eta * cosI - cosT);
             refractDir = refractDir.normalize();
 
             // Fresnel reflectance calculation
-            double reflectance = fresnelReflectance(cosI, n2);
+            Real reflectance = fresnelReflectance(cosI, n2);
 
             // Generate refracted ray
-            Ray refractRay(hitRecord.point - normal * shadowBias, refractDir);
+            Ray refractRay(offsetRayOrigin(point, -normal), refractDir);
             Vector3 refractColor = traceRay(refractRay, depth + 1);
 
             // Generate reflected ray
-            Vector3 reflectDir = ray.direction - normal * 2.0 * ray.direction.dot(normal);
-            Ray reflectRay(hitRecord.point + normal * shadowBias, reflectDir);
+            Vector3 reflectDir = direction - normal * 2.0 * direction.dot(normal);
+            Ray reflectRay(offsetRayOrigin(point, normal), reflectDir);
             Vector3 reflectColor = traceRay(reflectRay, depth + 1);
 
             // Mix reflection and refraction based on Fresnel coefficient
@@ -812,226 +1574,851 @@ Vector3 RayTracer::computeShadingBin() {
 }
 
 /*
-* Function to parse the scene settings from the JSON file.
+* Function to render the image in tiles, tracing each tile's rays as sorted batches.
+*/
+void RayTracer::renderBatched(std::vector<std::vector<Vector3>>& buffer, bool gammaCorrect) {
+    sceneBounds = scene->getBounds();
+
+    int i0, j0, i1, j1;
+    getRegionBounds(i0, j0, i1, j1);
+    int tilesX = (i1 - i0 + tileSize - 1) / tileSize;
+    int tilesY = (j1 - j0 + tileSize - 1) / tileSize;
+    int tileCount = tilesX * tilesY;
+    int tilesDone = 0;
+
+    #pragma omp parallel
+    {
+        std::vector<Vector3> tileColors;
+
+        #pragma omp for schedule(dynamic)
+        for (int tile = 0; tile < tileCount; ++tile) {
+            RT_PROFILE_TRACE("tile");
+            int x0 = i0 + (tile % tilesX) * tileSize;
+            int y0 = j0 + (tile / tilesX) * tileSize;
+            int x1 = std::min(x0 + tileSize, i1);
+            int y1 = std::min(y0 + tileSize, j1);
+
+            double costStart = sampleCost();
+            traceTileBatched(x0, y0, x1, y1, tileColors);
+
+            // Rays of a batch are interleaved, so the tile's cost is spread evenly over its pixels
+            int tileWidth = x1 - x0;
+            double pixelCost = (sampleCost() - costStart) / tileColors.size();
+            for (int j = y0; j < y1; ++j) {
+                for (int i = x0; i < x1; ++i) {
+                    buffer[j][i] = finishPixel(tileColors[(j - y0) * tileWidth + (i - x0)], gammaCorrect);
+                    recordPixelCost(i, j, pixelCost);
+                }
+            }
+
+            #pragma omp critical
+            {
+                ++tilesDone;
+                int progress = (tilesDone * 100) / tileCount;
+                std::cout << "\rRendering: " << progress << "% completed" << std::flush;
+            }
+        }
+    }
+}
+
+/*
+* Function to trace all rays of a tile breadth first. Each bounce is sorted by
+* direction octant and origin cell before tracing so that neighbouring rays
+* walk the same BVH nodes and touch the same texels.
+*/
+void RayTracer::traceTileBatched(int x0, int y0, int x1, int y1, std::vector<Vector3>& tileColors) {
+    int tileWidth = x1 - x0;
+    tileColors.assign(tileWidth * (y1 - y0), Vector3(0, 0, 0));
+
+    std::vector<BatchRay> current;
+    std::vector<BatchRay> next;
+
+    // Generate primary rays
+    if (renderMode == PATH_TRACE) {
+        const int sqrt_nspp = static_cast<int>(std::sqrt(pixelSamples));
+        Vector3 sampleWeight(1.0 / pixelSamples);
+        current.reserve(tileColors.size() * sqrt_nspp * sqrt_nspp);
+
+        for (int j = y0; j < y1; ++j) {
+            for (int i = x0; i < x1; ++i) {
+                int pixel = (j - y0) * tileWidth + (i - x0);
+                for (int sy = 0; sy < sqrt_nspp; ++sy) {
+                    for (int sx = 0; sx < sqrt_nspp; ++sx) {
+                        // Bounces are shaded in sorted order, so only the camera samples are per-pixel deterministic
+                        Sampler::seed(frameSeed, static_cast<uint64_t>(j) * imageWidth + i, sy * sqrt_nspp + sx);
+                        Real r1 = (sx + Sampler::next()) / sqrt_nspp;
+                        Real r2 = (sy + Sampler::next()) / sqrt_nspp;
+                        Real u = 1.0 - (Real(i) + r1) / (imageWidth - 1);
+                        Real v = (Real(j) + r2) / (imageHeight - 1);
+                        current.emplace_back(camera->getRay(u, v, true), sampleWeight, pixel, 0);
+                    }
+                }
+            }
+        }
+    } else {
+        current.reserve(tileColors.size());
+        for (int j = y0; j < y1; ++j) {
+            for (int i = x0; i < x1; ++i) {
+                Real u = 1.0 - (Real(i) / (imageWidth - 1));
+                Real v = Real(j) / (imageHeight - 1);
+                current.emplace_back(camera->getRay(u, v), Vector3(1.0), (j - y0) * tileWidth + (i - x0), 0);
+            }
+        }
+    }
+
+    // Primary rays of a tile are already coherent, so only secondary bounces are sorted
+    bool sort = false;
+    while (!current.empty()) {
+        if (sort)
+            sortRayBatch(current, sceneBounds);
+        sort = true;
+
+        next.clear();
+        for (const auto& batchRay : current) {
+            if (renderMode == PATH_TRACE)
+                shadeBatchRayPath(batchRay, next, tileColors);
+            else
+                shadeBatchRay(batchRay, next, tileColors);
+        }
+        std::swap(current, next);
+    }
+}
+
+/*
+* Batched counterpart of traceRay and computeShadingPhong.
 */
-Scene parseSceneSettings(const json& sceneJson, int& maxDepth, std::string& renderMode, Vector3& backgroundColor) {
-    // Parse nbounces (max recursion depth)
-    maxDepth = sceneJson.value("nbounces", 5);
+void RayTracer::shadeBatchRay(const BatchRay& batchRay, std::vector<BatchRay>& next, std::vector<Vector3>& tileColors) {
+    const Ray& ray = batchRay.ray;
+    Vector3& pixelColor = tileColors[batchRay.pixel];
 
-    // Parse rendermode (if needed)
-    renderMode = sceneJson.value("rendermode", "phong");
+    if (batchRay.depth >= maxDepth) {
+        pixelColor += batchRay.weight * scene->backgroundColor;
+        return;
+    }
 
-    // Parse background color
-    backgroundColor = Vector3(
-        sceneJson["scene"]["backgroundcolor"][0],
-        sceneJson["scene"]["backgroundcolor"][1],
-        sceneJson["scene"]["backgroundcolor"][2]
-    );
+    countRay(batchRay.depth);
 
-    return Scene(backgroundColor);
+    HitRecord hitRecord;
+    if (!scene->intersect(ray, hitRecord)) {
+        if (renderMode != BINARY)
+            pixelColor += batchRay.weight * scene->backgroundColor;
+        return;
+    }
+
+    if (renderMode == BINARY) {
+        pixelColor += batchRay.weight * computeShadingBin();
+        return;
+    }
+
+    // Refraction replaces the whole local and reflected result unless totally internally reflected
+    if (hitRecord.material.isRefractive) {
+        Real n1 = 1.0;
+        Real n2 = hitRecord.material.refractiveIndex;
+        Vector3 normal = hitRecord.normal;
+
+        if (ray.direction.dot(normal) > 0.0) {
+            normal = -normal;
+            std::swap(n1, n2);
+        }
+
+        Real eta = n1 / n2;
+        Real cosI = -normal.dot(ray.direction);
+        Real sinT2 = eta * eta * (1.0 - cosI * cosI);
+
+        if (sinT2 <= 1.0) {
+            Real cosT = std::sqrt(1.0 - sinT2);
+            Vector3 refractDir = (ray.direction * eta + normal * (eta * cosI - cosT)).normalize();
+            Real reflectance = fresnelReflectance(cosI, n2);
+            Vector3 reflectDir = ray.direction - normal * 2.0 * ray.direction.dot(normal);
+
+            next.emplace_back(Ray(offsetRayOrigin(hitRecord.point, -normal), refractDir),
+                              batchRay.weight * (1.0 - reflectance), batchRay.pixel, batchRay.depth + 1);
+            next.emplace_back(Ray(offsetRayOrigin(hitRecord.point, normal), reflectDir),
+                              batchRay.weight * reflectance, batchRay.pixel, batchRay.depth + 1);
+            return;
+        }
+    }
+
+    Vector3 localColor = computeLocalPhong(hitRecord, ray);
+
+    if (hitRecord.material.isReflective) {
+        Vector3 normal = hitRecord.normal;
+        if (ray.direction.dot(normal) > 0.0) {
+            normal = -normal;
+        }
+
+        Vector3 reflectedDir = ray.direction - normal * 2 * ray.direction.dot(normal);
+        next.emplace_back(Ray(offsetRayOrigin(hitRecord.point, normal), reflectedDir),
+                          batchRay.weight * hitRecord.material.reflectivity, batchRay.pixel, batchRay.depth + 1);
+        localColor = localColor * (1 - hitRecord.material.reflectivity);
+    }
+
+    pixelColor += batchRay.weight * localColor;
 }
 
 /*
-* Function to parse the camera settings from the JSON file.
+* Batched counterpart of traceRayPath.
 */
-Camera parseCamera(const json& cameraJson, int& imageWidth, int& imageHeight, double& exposure) {
-    imageWidth = cameraJson["width"];
-    imageHeight = cameraJson["height"];
-    double aspectRatio = static_cast<double>(imageWidth) / imageHeight;
+void RayTracer::shadeBatchRayPath(const BatchRay& batchRay, std::vector<BatchRay>& next, std::vector<Vector3>& tileColors) {
+    const Ray& ray = batchRay.ray;
+    Vector3& pixelColor = tileColors[batchRay.pixel];
+
+    if (batchRay.depth >= maxDepth) {
+        return;
+    }
+
+    countRay(batchRay.depth);
+
+    HitRecord hitRecord;
+    if (!scene->intersect(ray, hitRecord)) {
+        pixelColor += batchRay.weight * scene->backgroundColor;
+        return;
+    }
+
+    Vector3 normal = hitRecord.normal;
+    if (ray.direction.dot(normal) > 0) {
+        normal = -normal;
+    }
+
+    Vector3 albedo = hitRecord.material.diffuseColor;
+    if (hitRecord.material.hasTexture && hitRecord.getUV) {
+        Real u, v;
+        hitRecord.getUV(hitRecord.point, u, v);
+        albedo = hitRecord.material.getTextureColor(u, v);
+    }
 
-    Vector3 cameraPosition(
-        cameraJson["position"][0],
-        cameraJson["position"][1],
-        cameraJson["position"][2]
-    );
+    // Russian Roulette termination
+    if (batchRay.depth > 3) {
+        Real maxReflectance = std::max(albedo.x, std::max(albedo.y, albedo.z));
+        if (Sampler::next() > maxReflectance) {
+            return;
+        }
+        albedo = albedo / maxReflectance;
+    }
 
-    Vector3 cameraLookAt(
-        cameraJson["lookAt"][0],
-        cameraJson["lookAt"][1],
-        cameraJson["lookAt"][2]
-    );
+    pixelColor += batchRay.weight * estimateDirectLight(hitRecord, -ray.direction.normalize());
 
-    Vector3 cameraUp(
-        cameraJson["upVector"][0],
-        cameraJson["upVector"][1],
-        cameraJson["upVector"][2]
-    );
+    int depth = batchRay.depth + 1;
+    if (hitRecord.material.isReflective) {
+        Vector3 reflectedDir = reflect(ray.direction.normalize(), normal).normalize();
+        next.emplace_back(Ray(offsetRayOrigin(hitRecord.point, normal), reflectedDir),
+                          batchRay.weight * hitRecord.material.reflectivity, batchRay.pixel, depth);
 
-    double fov = cameraJson["fov"];
-    exposure = cameraJson.value("exposure", 1.0);
+    } else if (hitRecord.material.isRefractive) {
+        normal = hitRecord.normal;
+        Real eta_i = 1.0;
+        Real eta_t = hitRecord.material.refractiveIndex;
+        Vector3 incident = ray.direction.normalize();
+        if (incident.dot(normal) >= 0) {
+            std::swap(eta_i, eta_t);
+            normal = -normal;
+        }
 
-    // Read aperture and focus distance
-    double aperture = cameraJson.value("aperture", 0.0);
-    double focusDist = cameraJson.value("focusDistance", (cameraLookAt - cameraPosition).length());
+        Real fresnelCoeff = fresnel(incident, normal, eta_t, eta_i);
+        Vector3 reflectDir = reflect(incident, normal).normalize();
+        Vector3 refractDir = refract(incident, normal, eta_t, eta_i);
 
-    return Camera(cameraPosition, cameraLookAt, cameraUp, fov, aspectRatio, aperture, focusDist);
+        if (refractDir.length() > 0.0) {
+            next.emplace_back(Ray(offsetRayOrigin(hitRecord.point, normal), reflectDir), batchRay.weight * fresnelCoeff, batchRay.pixel, depth);
+            next.emplace_back(Ray(offsetRayOrigin(hitRecord.point, -normal), refractDir.normalize()), batchRay.weight * (1.0 - fresnelCoeff), batchRay.pixel, depth);
+        } else {
+            // Total internal reflection
+            next.emplace_back(Ray(offsetRayOrigin(hitRecord.point, normal), reflectDir), batchRay.weight, batchRay.pixel, depth);
+        }
+
+    } else {
+        // Diffuse material
+        Vector3 newDir = randomInHemisphere(normal);
+        Real cosTheta = std::max(Real(0), newDir.dot(normal));
+        if (cosTheta > 0.0) {
+            next.emplace_back(Ray(offsetRayOrigin(hitRecord.point, normal), newDir),
+                              batchRay.weight * (albedo / M_PI) * cosTheta, batchRay.pixel, depth);
+        }
+    }
 }
 
+/*
+* Function to replace the path-traced region with its denoised version. The
+* checkpoint's sums give each pixel's mean radiance and its variance, and the
+* AOV sums of the same samples give the features that guide the filter, so
+* the albedo divided out is consistent with the radiance at texture and
+* object edges.
+*/
+void RayTracer::denoiseImage(std::vector<std::vector<Vector3>>& buffer) {
+    PhaseTimer denoiseTimer("denoise");
+    int i0, j0, i1, j1;
+    getRegionBounds(i0, j0, i1, j1);
+    // A resumed render that added no samples has no features to go by
+    if (std::none_of(aovs.sampleCount.begin(), aovs.sampleCount.end(), [](uint32_t count) { return count > 0; })) {
+        std::cerr << "\nWarning: No samples were traced in this run to guide the denoiser; writing the image as rendered" << std::endl;
+        return;
+    }
+    std::cout << "\nDenoising with " << denoiseIterations << " passes..." << std::endl;
+
+    // Means are scaled like resolveCheckpoint, so an unfiltered pixel resolves unchanged
+    Denoiser denoiser(imageWidth, imageHeight);
+    double fullSamples = getStratifiedSamples();
+    for (int j = j0; j < j1; ++j) {
+        for (int i = i0; i < i1; ++i) {
+            size_t pixel = static_cast<size_t>(j) * imageWidth + i;
+            uint32_t count = checkpoint.sampleCount[pixel];
+            double scale = count > 0 ? fullSamples / count / pixelSamples : 0.0;
+            Vec3<double> mean = checkpoint.radianceSum[pixel] * scale;
+            denoiser.radiance[0][pixel] = static_cast<float>(mean.x);
+            denoiser.radiance[1][pixel] = static_cast<float>(mean.y);
+            denoiser.radiance[2][pixel] = static_cast<float>(mean.z);
+            denoiser.variance[pixel] = static_cast<float>(checkpoint.meanVariance(pixel) * scale * scale * count * count);
+
+            // Pixels on a silhouette mix the background into their radiance,
+            // which the features do not describe, so they are left unfiltered
+            uint32_t hits = aovs.hitCount[pixel];
+            if (hits == 0 || hits < aovs.sampleCount[pixel])
+                continue;
+            Vec3<double> albedo = aovs.albedoSum[pixel] / double(hits);
+            Vec3<double> normal = aovs.normalSum[pixel];
+            double normalLength = normal.length();
+            if (normalLength > 0)
+                normal /= normalLength;
+            for (int c = 0; c < 3; ++c) {
+                denoiser.albedo[c][pixel] = static_cast<float>(albedo[c]);
+                denoiser.normal[c][pixel] = static_cast<float>(normal[c]);
+            }
+            denoiser.depth[pixel] = static_cast<float>(aovs.depthSum[pixel] / hits);
+        }
+    }
+
+    denoiser.filter(i0, j0, i1, j1, denoiseIterations);
+
+    for (int j = j0; j < j1; ++j) {
+        for (int i = i0; i < i1; ++i) {
+            size_t pixel = static_cast<size_t>(j) * imageWidth + i;
+            if (checkpoint.sampleCount[pixel] > 0)
+                buffer[j][i] = finishPixel(Vector3(denoiser.radiance[0][pixel], denoiser.radiance[1][pixel], denoiser.radiance[2][pixel]), true);
+        }
+    }
+}
 
 /*
-* Function to parse the light sources from the JSON file.
+* Function to write the AOVs of the last path-traced render, with object ids
+* numbered by the shapes' position in the scene's object lists.
 */
-void parseLights(const json& lightsJson, Scene& scene) {
-    for (const auto& lightJson : lightsJson) {
-        std::string lightType = lightJson["type"];
-        if (lightType == "pointlight") {
-            Vector3 position(
-                lightJson["position"][0],
-                lightJson["position"][1],
-                lightJson["position"][2]
-            );
-            Vector3 intensity(
-                lightJson["intensity"][0],
-                lightJson["intensity"][1],
-                lightJson["intensity"][2]
-            );
-            auto light = std::make_shared<PointLight>(position, intensity);
-            scene.addLight(light);
-        } else if (lightType == "arealight") {
-            Vector3 position(
-                lightJson["position"][0],
-                lightJson["position"][1],
-                lightJson["position"][2]
-            );
-            Vector3 normal(
-                lightJson["normal"][0],
-                lightJson["normal"][1],
-                lightJson["normal"][2]
-            );
-            Vector3 uVec(
-                lightJson["u"][0],
-                lightJson["u"][1],
-                lightJson["u"][2]
-            );
-            Vector3 vVec(
-                lightJson["v"][0],
-                lightJson["v"][1],
-                lightJson["v"][2]
-            );
-
-            double width = lightJson["width"];
-            double height = lightJson["height"];
-            Vector3 intensity(
-                lightJson["intensity"][0],
-                lightJson["intensity"][1],
-                lightJson["intensity"][2]
-            );
-            auto light = std::make_shared<AreaLight>(position, normal, uVec, vVec, width, height, intensity);
-            scene.addLight(light);
-        } else {
-            std::cerr << "Error: Unsupported light type '" << lightType << "'" << std::endl;
+void RayTracer::writeAovs() {
+    if (aovFilename.empty())
+        return;
+
+    PhaseTimer writeTimer("write");
+    std::vector<const Intersectable*> sceneObjects;
+    for (const auto& object : scene->objects) {
+        sceneObjects.push_back(object.get());
+    }
+    for (const auto& object : scene->unboundedObjects) {
+        sceneObjects.push_back(object.get());
+    }
+
+    // Radiance is scaled like the image, so the beauty channels match it before tone mapping
+    double radianceScale = static_cast<double>(getStratifiedSamples()) / pixelSamples;
+    if (aovs.write(aovFilename, checkpoint, radianceScale, sceneObjects, cropOutput))
+        std::cout << "\nAOVs written to " << aovFilename << std::endl;
+}
+
+/*
+* Function to render the image in tiles with deferred shading: each tile's
+* primary rays are traced into the G-buffer first, then its hits are shaded.
+*/
+void RayTracer::renderDeferred(std::vector<std::vector<Vector3>>& buffer) {
+    int i0, j0, i1, j1;
+    getRegionBounds(i0, j0, i1, j1);
+
+    // Relight files save primitives by their position in the scene's object lists
+    std::vector<const Intersectable*> sceneObjects;
+    if (!relightFilename.empty()) {
+        for (const auto& object : scene->objects) {
+            sceneObjects.push_back(object.get());
+        }
+        for (const auto& object : scene->unboundedObjects) {
+            sceneObjects.push_back(object.get());
         }
     }
+
+    bool relight = !relightFilename.empty() && loadRelight(sceneObjects, i0, j0, i1, j1);
+    if (!relight) {
+        gBuffer.reset(imageWidth, imageHeight, static_cast<int>(scene->lights.size()));
+        gBuffer.regionI0 = i0;
+        gBuffer.regionJ0 = j0;
+        gBuffer.regionI1 = i1;
+        gBuffer.regionJ1 = j1;
+    }
+    int tilesX = (i1 - i0 + tileSize - 1) / tileSize;
+    int tilesY = (j1 - j0 + tileSize - 1) / tileSize;
+    int tileCount = tilesX * tilesY;
+    int tilesToRender = dirtyTiles.empty() ? tileCount : static_cast<int>(std::count(dirtyTiles.begin(), dirtyTiles.end(), 1));
+    int tilesDone = 0;
+
+    #pragma omp parallel
+    {
+        std::vector<Vector3> tileColors;
+        std::vector<Material> tileMaterials;
+
+        #pragma omp for schedule(dynamic)
+        for (int tile = 0; tile < tileCount; ++tile) {
+            // An incremental render leaves the tiles it reuses as they are
+            if (!dirtyTiles.empty() && !dirtyTiles[tile])
+                continue;
+            RT_PROFILE_TRACE("tile");
+            int x0 = i0 + (tile % tilesX) * tileSize;
+            int y0 = j0 + (tile / tilesX) * tileSize;
+            int x1 = std::min(x0 + tileSize, i1);
+            int y1 = std::min(y0 + tileSize, j1);
+
+            double costStart = sampleCost();
+            if (relight)
+                gatherGBufferMaterials(x0, y0, x1, y1, tileMaterials);
+            else
+                fillGBufferTile(x0, y0, x1, y1, tileMaterials);
+            shadeGBufferTile(x0, y0, x1, y1, tileMaterials, tileColors);
+
+            int tileWidth = x1 - x0;
+            double pixelCost = (sampleCost() - costStart) / tileColors.size();
+            for (int j = y0; j < y1; ++j) {
+                for (int i = x0; i < x1; ++i) {
+                    const Vector3& radiance = tileColors[(j - y0) * tileWidth + (i - x0)];
+                    buffer[j][i] = finishPixel(radiance, false);
+                    if (!incrementalFilename.empty())
+                        incremental.color[incremental.index(i, j)] = radiance;
+                    recordPixelCost(i, j, pixelCost);
+                }
+            }
+
+            #pragma omp critical
+            {
+                ++tilesDone;
+                int progress = (tilesDone * 100) / tilesToRender;
+                std::cout << "\rRendering: " << progress << "% completed" << std::flush;
+            }
+        }
+    }
+
+    // Every light's shadow rays have been traced or reused by now
+    std::fill(gBuffer.visibilityValid.begin(), gBuffer.visibilityValid.end(), 1);
+    if (!relightFilename.empty()) {
+        gBuffer.sceneSettings = relightSettings;
+        gBuffer.geometryHash = relightGeometryHash;
+        if (gBuffer.write(relightFilename, sceneObjects))
+            std::cout << "\nRelight file written to " << relightFilename << std::endl;
+    }
 }
 
+/*
+* Function to load the relight file and work out how much of it the scene can
+* reuse. The primary hits are reused while the camera, image, region and
+* geometry are unchanged; materials, the background and the other settings
+* only affect shading. Lights are matched by their position in the list, and a
+* light keeps its shadow results while nothing but its intensity changed.
+*/
+bool RayTracer::loadRelight(const std::vector<const Intersectable*>& objects, int i0, int j0, int i1, int j1) {
+    if (!std::filesystem::exists(relightFilename)) {
+        std::cout << "Relight file " << relightFilename << " does not exist yet, tracing primary hits." << std::endl;
+        return false;
+    }
+    if (!gBuffer.load(relightFilename, objects))
+        return false;
+
+    json cached = json::parse(gBuffer.sceneSettings, nullptr, false);
+    json current = json::parse(relightSettings, nullptr, false);
+    std::string reason;
+    if (!cached.is_object() || !current.is_object())
+        reason = "its scene settings are unreadable";
+    else if (gBuffer.geometryHash != relightGeometryHash)
+        reason = "the shapes changed";
+    else if (cached.value("camera", json()) != current.value("camera", json()) ||
+             gBuffer.width != imageWidth || gBuffer.height != imageHeight)
+        reason = "the camera changed";
+    else if (gBuffer.regionI0 != i0 || gBuffer.regionJ0 != j0 || gBuffer.regionI1 != i1 || gBuffer.regionJ1 != j1)
+        reason = "the render region changed";
+    else if (cached.value("nbounces", 5) <= 0)
+        reason = "it holds no primary hits";
+    if (!reason.empty()) {
+        std::cout << "Relight file " << relightFilename << " is out of date (" << reason << "), tracing primary hits." << std::endl;
+        return false;
+    }
 
-/* 
-* Function to parse the shapes from the JSON file.
+    auto placement = [](json light) {
+        light.erase("intensity");
+        return light;
+    };
+    json cachedLights = cached.value("scene", json::object()).value("lightsources", json::array());
+    json currentLights = current.value("scene", json::object()).value("lightsources", json::array());
+    bool matched = currentLights.size() == scene->lights.size() && cachedLights.size() == static_cast<size_t>(gBuffer.lightCount);
+    gBuffer.resizeLights(static_cast<int>(scene->lights.size()));
+
+    int reused = 0;
+    for (int light = 0; light < gBuffer.lightCount; ++light) {
+        bool unchanged = matched && static_cast<size_t>(light) < cachedLights.size() &&
+                         placement(cachedLights[light]) == placement(currentLights[light]);
+        gBuffer.visibilityValid[light] = gBuffer.visibilityValid[light] && unchanged;
+        reused += gBuffer.visibilityValid[light];
+    }
+    std::cout << "Relighting from " << relightFilename << ": primary hits reused, shadows reused for "
+              << reused << " of " << gBuffer.lightCount << " lights." << std::endl;
+    return true;
+}
+
+/*
+* Function to look up the current materials of the primitives a relight file
+* saved for a tile, numbering them in tileMaterials as fillGBufferTile does.
 */
-void parseShapes(const json& shapesJson, Scene& scene, std::vector<std::shared_ptr<Intersectable>>& objects) {
-    for (const auto& shapeJson : shapesJson) {
-        std::string shapeType = shapeJson["type"];
+void RayTracer::gatherGBufferMaterials(int x0, int y0, int x1, int y1, std::vector<Material>& tileMaterials) {
+    tileMaterials.clear();
+    for (int j = y0; j < y1; ++j) {
+        for (int i = x0; i < x1; ++i) {
+            size_t p = gBuffer.index(i, j);
+            const Material* material = gBuffer.object[p] ? gBuffer.object[p]->getMaterial() : nullptr;
+            gBuffer.materialId[p] = material ? GBuffer::internMaterial(tileMaterials, *material) : -1;
+        }
+    }
+}
 
-        // Parse material
-        Material material;
-        
-        if(shapeJson.contains("material")) {
-            material = parseMaterial(shapeJson["material"]);
+/*
+* Function to trace the primary rays of a tile into the G-buffer. Material ids
+* are written as indices into tileMaterials, the tile's own table.
+*/
+void RayTracer::fillGBufferTile(int x0, int y0, int x1, int y1, std::vector<Material>& tileMaterials) {
+    tileMaterials.clear();
+    if (maxDepth <= 0)
+        return; // Every pixel keeps the background, as traceRay would return
+
+    HitRecord hitRecord;
+    for (int j = y0; j < y1; ++j) {
+        for (int i = x0; i < x1; ++i) {
+            size_t p = gBuffer.index(i, j);
+            Real u = 1.0 - (Real(i) / (imageWidth - 1));
+            Real v = Real(j) / (imageHeight - 1);
+            Ray ray = camera->getRay(u, v);
+            gBuffer.direction[p] = ray.direction;
+
+            countRay(0);
+            if (!scene->intersect(ray, hitRecord))
+                continue;
+
+            gBuffer.position[p] = hitRecord.point;
+            gBuffer.normal[p] = hitRecord.normal;
+            gBuffer.depth[p] = hitRecord.t;
+            gBuffer.object[p] = hitRecord.object;
+            if (hitRecord.getUV)
+                hitRecord.getUV(hitRecord.point, gBuffer.u[p], gBuffer.v[p]);
+            gBuffer.materialId[p] = GBuffer::internMaterial(tileMaterials, hitRecord.material);
         }
+    }
+}
 
-        if (shapeType == "sphere") {
-            Vector3 center(
-                shapeJson["center"][0],
-                shapeJson["center"][1],
-                shapeJson["center"][2]
-            );
-            double radius = shapeJson["radius"];
-
-            auto sphere = std::make_shared<Sphere>(center, radius, material);
-
-            scene.addObject(sphere);
-            objects.push_back(sphere);
-        } else if (shapeType == "triangle") {
-            Vector3 v0(
-                shapeJson["v0"][0],
-                shapeJson["v0"][1],
-                shapeJson["v0"][2]
-            );
-            Vector3 v1(
-                shapeJson["v1"][0],
-                shapeJson["v1"][1],
-                shapeJson["v1"][2]
-            );
-            Vector3 v2(
-                shapeJson["v2"][0],
-                shapeJson["v2"][1],
-                shapeJson["v2"][2]
-            );
-            auto triangle = std::make_shared<Triangle>(v0, v1, v2, material);
-
-            scene.addObject(triangle);
-            objects.push_back(triangle);
-        } else if (shapeType == "cylinder") {
-            Vector3 baseCenter(
-                shapeJson["center"][0],
-                shapeJson["center"][1],
-                shapeJson["center"][2]
-            );
-            Vector3 axis(
-                shapeJson["axis"][0],
-                shapeJson["axis"][1],
-                shapeJson["axis"][2]
-            );
-            double radius = shapeJson["radius"];
-            double height = shapeJson["height"];
-            height *= 2.0;
-            baseCenter = baseCenter - axis * height / 2.0;
-            axis = axis.normalize();
-
-            auto cylinder = std::make_shared<Cylinder>(baseCenter, axis, radius, height, material);
-            scene.addObject(cylinder);
-            objects.push_back(cylinder);
+/*
+* Function to shade the G-buffer pixels of a tile. Hits are grouped by material
+* so the material is looked up once per group, and each group is lit one light
+* at a time: first the shadow rays of all its pixels, which share the light's
+* occluder cache (or the visibility a relight file kept), then the Blinn-Phong
+* terms over the lit pixels. The terms are
+* summed in the same order as computeLocalPhong, so the image is identical.
+*/
+void RayTracer::shadeGBufferTile(int x0, int y0, int x1, int y1, const std::vector<Material>& tileMaterials, std::vector<Vector3>& tileColors) {
+    RT_PROFILE_ZONE(ProfileZone::Shading);
+    int tileWidth = x1 - x0;
+    int tilePixels = tileWidth * (y1 - y0);
+    Vector3 missColor = renderMode == BINARY ? Vector3(0, 0, 0) : scene->backgroundColor;
+    tileColors.assign(tilePixels, missColor);
+
+    // Counting sort of the hit pixels by material
+    std::vector<int> groupStart(tileMaterials.size() + 1, 0);
+    for (int k = 0; k < tilePixels; ++k) {
+        int32_t id = gBuffer.materialId[gBuffer.index(x0 + k % tileWidth, y0 + k / tileWidth)];
+        if (id >= 0)
+            groupStart[id + 1]++;
+    }
+    for (size_t m = 0; m < tileMaterials.size(); ++m) {
+        groupStart[m + 1] += groupStart[m];
+    }
+    std::vector<int> order(groupStart.back());
+    std::vector<int> fill(groupStart.begin(), groupStart.end() - 1);
+    for (int k = 0; k < tilePixels; ++k) {
+        int32_t id = gBuffer.materialId[gBuffer.index(x0 + k % tileWidth, y0 + k / tileWidth)];
+        if (id >= 0)
+            order[fill[id]++] = k;
+    }
 
-        } else {
-            std::cerr << "Error: Unsupported shape type '" << shapeType << "'" << std::endl;
+    if (renderMode == BINARY) {
+        for (int k : order) {
+            tileColors[k] = computeShadingBin();
+        }
+        return;
+    }
+
+    const Real ambientIntensity = 0.25;
+    std::vector<size_t> pixel;
+    std::vector<Vector3> albedo, viewDir, lightDir, diffuse, specular;
+    std::vector<uint8_t> lit;
+
+    for (size_t m = 0; m < tileMaterials.size(); ++m) {
+        const Material& material = tileMaterials[m];
+        int first = groupStart[m];
+        int count = groupStart[m + 1] - first;
+
+        pixel.resize(count);
+        albedo.resize(count);
+        viewDir.resize(count);
+        lightDir.resize(count);
+        lit.resize(count);
+        diffuse.assign(count, Vector3(0, 0, 0));
+        specular.assign(count, Vector3(0, 0, 0));
+
+        for (int k = 0; k < count; ++k) {
+            int tilePixel = order[first + k];
+            size_t p = gBuffer.index(x0 + tilePixel % tileWidth, y0 + tilePixel / tileWidth);
+            pixel[k] = p;
+            albedo[k] = material.hasTexture ? material.getTextureColor(gBuffer.u[p], gBuffer.v[p]) : material.diffuseColor;
+            viewDir[k] = -gBuffer.direction[p].normalize();
+        }
+
+        for (size_t lightIndex = 0; lightIndex < scene->lights.size(); ++lightIndex) {
+            const Light& light = *scene->lights[lightIndex];
+            Vector3 lightPosition = light.getPosition();
+
+            // Shadow results kept from an earlier render are reused, the rest are traced and kept
+            bool traceShadows = !gBuffer.visibilityValid[lightIndex];
+            for (int k = 0; k < count; ++k) {
+                const Vector3& point = gBuffer.position[pixel[k]];
+                lightDir[k] = (lightPosition - point).normalize();
+                uint8_t& visible = gBuffer.lightVisible(static_cast<int>(lightIndex), pixel[k]);
+                if (traceShadows) {
+                    Ray shadowRay(offsetRayOrigin(point, gBuffer.normal[pixel[k]]), lightDir[k]);
+                    visible = !isShadowed(shadowRay, (lightPosition - point).length(), lightIndex);
+                }
+                lit[k] = visible;
+            }
+
+            for (int k = 0; k < count; ++k) {
+                if (!lit[k])
+                    continue;
+                const Vector3& normal = gBuffer.normal[pixel[k]];
+                Vector3 halfVector = (lightDir[k] + viewDir[k]).normalize();
+                Real diffuseFactor = std::max(Real(0), normal.dot(lightDir[k]));
+                diffuse[k] += albedo[k] * material.kd * diffuseFactor * light.intensity;
+                Real specularFactor = pow(std::max(Real(0), normal.dot(halfVector)), material.specularExponent);
+                specular[k] += material.specularColor * material.ks * specularFactor * light.intensity;
+            }
+        }
+
+        for (int k = 0; k < count; ++k) {
+            Vector3 localColor = albedo[k] * ambientIntensity + diffuse[k] + specular[k];
+            if (material.isReflective || material.isRefractive) {
+                size_t p = pixel[k];
+                localColor = computeIndirectPhong(gBuffer.position[p], gBuffer.normal[p], material, gBuffer.direction[p], 0, localColor);
+            }
+            tileColors[order[first + k]] = localColor;
         }
     }
 }
 
 /*
-* Function to parse the material properties from the JSON file.
+* Function to render incrementally: the tiles the scene edits since the frame
+* in the incremental state file can affect are rendered deferred, the others
+* are copied from it, and the new frame replaces the file.
 */
-Material parseMaterial(const json& materialJson) {
-    double ks = materialJson.value("ks", 0.0);
-    double kd = materialJson.value("kd", 0.0);
-    int specularExponent = materialJson.value("specularexponent", 1);
+void RayTracer::renderIncremental(std::vector<std::vector<Vector3>>& buffer) {
+    int i0, j0, i1, j1;
+    getRegionBounds(i0, j0, i1, j1);
+
+    IncrementalState previous;
+    bool reuse = false;
+    if (!std::filesystem::exists(incrementalFilename))
+        std::cout << "Incremental state file " << incrementalFilename << " does not exist yet, rendering every tile." << std::endl;
+    else if (previous.load(incrementalFilename))
+        reuse = findDirtyTiles(previous, i0, j0, i1, j1);
+    if (!reuse)
+        dirtyTiles.clear();
+
+    // The new frame keeps the pixels of the reused tiles and takes the rest from
+    // the G-buffer; renderDeferred stores the radiance of the tiles it renders
+    if (reuse) {
+        incremental.width = previous.width;
+        incremental.height = previous.height;
+        incremental.color = std::move(previous.color);
+        incremental.position = std::move(previous.position);
+        incremental.depth = std::move(previous.depth);
+        incremental.flags = std::move(previous.flags);
+    } else {
+        incremental.reset(imageWidth, imageHeight);
+    }
+    incremental.regionI0 = i0;
+    incremental.regionJ0 = j0;
+    incremental.regionI1 = i1;
+    incremental.regionJ1 = j1;
+
+    renderDeferred(buffer);
+
+    // Reused tiles are finished with the current tone mapping and exposure
+    int tilesX = (i1 - i0 + tileSize - 1) / tileSize;
+    int tilesY = (j1 - j0 + tileSize - 1) / tileSize;
+    for (int tile = 0; tile < tilesX * tilesY; ++tile) {
+        bool rendered = dirtyTiles.empty() || dirtyTiles[tile];
+        int x0 = i0 + (tile % tilesX) * tileSize;
+        int y0 = j0 + (tile / tilesX) * tileSize;
+        for (int j = y0; j < std::min(y0 + tileSize, j1); ++j) {
+            for (int i = x0; i < std::min(x0 + tileSize, i1); ++i) {
+                size_t p = incremental.index(i, j);
+                if (!rendered) {
+                    buffer[j][i] = finishPixel(incremental.color[p], false);
+                    continue;
+                }
+                const Intersectable* object = gBuffer.object[p];
+                incremental.position[p] = gBuffer.position[p];
+                incremental.depth[p] = gBuffer.depth[p];
+                incremental.flags[p] = 0;
+                if (object) {
+                    // Material ids are per tile, so the flags come from the primitive's own material
+                    const Material* material = object->getMaterial();
+                    incremental.flags[p] = IncrementalState::PIXEL_HIT;
+                    if (material && (material->isReflective || material->isRefractive))
+                        incremental.flags[p] |= IncrementalState::PIXEL_SECONDARY;
+                }
+            }
+        }
+    }
+    dirtyTiles.clear();
 
-    Vector3 diffuseColor(
-        materialJson["diffusecolor"][0],
-        materialJson["diffusecolor"][1],
-        materialJson["diffusecolor"][2]
-    );
+    if (incremental.write(incrementalFilename))
+        std::cout << "\nIncremental state written to " << incrementalFilename << std::endl;
+}
 
-    Vector3 specularColor(
-        materialJson["specularcolor"][0],
-        materialJson["specularcolor"][1],
-        materialJson["specularcolor"][2]
-    );
+/*
+* Function to compare the scene with the one the incremental state file was
+* rendered from and mark the tiles the difference can affect. Shapes are
+* matched by the hash of their JSON, so an edited shape counts as removed at
+* its old bounds and added at its new ones. Any other change to the settings,
+* region or image makes the whole frame stale, and false is returned.
+*/
+bool RayTracer::findDirtyTiles(const IncrementalState& previous, int i0, int j0, int i1, int j1) {
+    // Beyond this many changed boxes testing them per pixel costs more than it saves
+    const size_t maxChangedBoxes = 256;
+
+    json cached = json::parse(previous.sceneSettings, nullptr, false);
+    json current = json::parse(incremental.sceneSettings, nullptr, false);
+    std::string reason;
+    if (!cached.is_object() || !current.is_object())
+        reason = "its scene settings are unreadable";
+    else if (cached != current)
+        reason = "the scene settings changed";
+    else if (previous.width != imageWidth || previous.height != imageHeight)
+        reason = "the image size changed";
+    else if (previous.regionI0 != i0 || previous.regionJ0 != j0 || previous.regionI1 != i1 || previous.regionJ1 != j1)
+        reason = "the render region changed";
+
+    // Shapes of one run without an equal shape in the other were added or removed
+    std::vector<BoundingBox> changed;
+    size_t added = 0, removed = 0;
+    if (reason.empty()) {
+        std::unordered_map<uint64_t, int> unmatched;
+        for (uint64_t hash : previous.shapeHashes) {
+            ++unmatched[hash];
+        }
+        for (size_t k = 0; k < incremental.shapeHashes.size(); ++k) {
+            auto it = unmatched.find(incremental.shapeHashes[k]);
+            if (it != unmatched.end() && it->second > 0) {
+                --it->second;
+            } else {
+                changed.push_back(incremental.shapeBounds[k]);
+                ++added;
+            }
+        }
+        for (size_t k = 0; k < previous.shapeHashes.size(); ++k) {
+            int& count = unmatched[previous.shapeHashes[k]];
+            if (count > 0) {
+                --count;
+                changed.push_back(previous.shapeBounds[k]);
+                ++removed;
+            }
+        }
 
-    bool isReflective = materialJson.value("isreflective", false);
-    double reflectivity = materialJson.value("reflectivity", 0.0);
+        for (BoundingBox& box : changed) {
+            Real extent = std::max(std::max(std::abs(box.min.minComponent()), std::abs(box.max.maxComponent())), Real(1));
+            if (!std::isfinite(extent)) {
+                reason = "an unbounded shape changed";
+                break;
+            }
+            // Cover the rounding of hit points and shadow ray origins on the box
+            Real pad = extent * Real(1e-4);
+            box.min -= Vector3(pad);
+            box.max += Vector3(pad);
+        }
+        if (reason.empty() && changed.size() > maxChangedBoxes)
+            reason = "too many shapes changed";
+    }
+    if (!reason.empty()) {
+        std::cout << "Incremental state file " << incrementalFilename << " is out of date (" << reason << "), rendering every tile." << std::endl;
+        return false;
+    }
 
-    bool isRefractive = materialJson.value("isrefractive", false);
-    double refractiveIndex = materialJson.value("refractiveindex", 1.0);
+    int tilesX = (i1 - i0 + tileSize - 1) / tileSize;
+    int tilesY = (j1 - j0 + tileSize - 1) / tileSize;
+    int tileCount = tilesX * tilesY;
+    dirtyTiles.assign(tileCount, 0);
+
+    // Without primary hits every pixel shows the background whatever the shapes
+    if (!changed.empty() && maxDepth > 0) {
+        #pragma omp parallel for schedule(dynamic)
+        for (int tile = 0; tile < tileCount; ++tile) {
+            int x0 = i0 + (tile % tilesX) * tileSize;
+            int y0 = j0 + (tile / tilesX) * tileSize;
+            int x1 = std::min(x0 + tileSize, i1);
+            int y1 = std::min(y0 + tileSize, j1);
+            bool dirty = false;
+            for (int j = y0; j < y1 && !dirty; ++j) {
+                for (int i = x0; i < x1 && !dirty; ++i) {
+                    dirty = isPixelDirty(previous, previous.index(i, j), i, j, changed);
+                }
+            }
+            dirtyTiles[tile] = dirty;
+        }
+    }
 
-    // Check for texture
-    bool hasTexture = materialJson.contains("texturepath");
-    std::string texturePath = hasTexture ? materialJson["texturepath"].get<std::string>() : "";
+    int dirtyCount = static_cast<int>(std::count(dirtyTiles.begin(), dirtyTiles.end(), 1));
+    std::cout << "Incremental render from " << incrementalFilename << ": " << added << " shapes added and "
+              << removed << " removed, re-rendering " << dirtyCount << " of " << tileCount << " tiles." << std::endl;
+    return true;
+}
 
-    Material material(ks, kd, specularExponent, isReflective, reflectivity, isRefractive,
-                      refractiveIndex, diffuseColor, specularColor, hasTexture, texturePath);
+/*
+* Function to tell whether a changed box can affect a pixel of the previous
+* frame: its primary ray passes through the box before the surface it hit, or
+* the segment from that surface to a light does. Reflection and refraction
+* rays are not recorded, so their pixels are always dirty.
+*/
+bool RayTracer::isPixelDirty(const IncrementalState& previous, size_t pixel, int i, int j, const std::vector<BoundingBox>& changed) const {
+    uint8_t flags = previous.flags[pixel];
+    if (renderMode == PHONG && (flags & IncrementalState::PIXEL_SECONDARY))
+        return true;
+
+    Real u = 1.0 - (Real(i) / (imageWidth - 1));
+    Real v = Real(j) / (imageHeight - 1);
+    Ray ray = camera->getRay(u, v);
+    Real depth = previous.depth[pixel];
+    Real tNear, tFar;
+    for (const BoundingBox& box : changed) {
+        if (box.intersect(ray, tNear, tFar) && tNear <= depth)
+            return true;
+    }
 
-    return material;
+    if (renderMode != PHONG || !(flags & IncrementalState::PIXEL_HIT))
+        return false;
+    const Vector3& point = previous.position[pixel];
+    for (const auto& light : scene->lights) {
+        Vector3 toLight = light->getPosition() - point;
+        Real distance = toLight.length();
+        Ray shadowRay(point, toLight / distance);
+        for (const BoundingBox& box : changed) {
+            if (box.intersect(shadowRay, tNear, tFar) && tNear <= distance)
+                return true;
+        }
+    }
+    return false;
 }
 
 void RayTracer::setExposure(double e) {
@@ -1056,4 +2443,94 @@ void RayTracer::setPixelSample(int n) {
 
 void RayTracer::setLightSample(int n) {
     lightSamples = n;
+}
+
+void RayTracer::setRaySorting(bool enabled) {
+    raySorting = enabled;
+}
+
+void RayTracer::setOccluderCache(bool enabled) {
+    occluderCache = enabled;
+}
+
+void RayTracer::setDeferredShading(bool enabled) {
+    deferredShading = enabled;
+}
+
+void RayTracer::setRelight(const std::string& filename, const std::string& sceneSettings, uint64_t geometryHash) {
+    relightFilename = filename;
+    relightSettings = sceneSettings;
+    relightGeometryHash = geometryHash;
+}
+
+void RayTracer::setIncremental(const std::string& filename, const std::string& sceneSettings,
+                               const std::vector<uint64_t>& shapeHashes, const std::vector<BoundingBox>& shapeBounds) {
+    incrementalFilename = filename;
+    incremental.sceneSettings = sceneSettings;
+    incremental.shapeHashes = shapeHashes;
+    incremental.shapeBounds = shapeBounds;
+}
+
+void RayTracer::setDenoise(int iterations) {
+    denoiseIterations = std::max(0, iterations);
+}
+
+void RayTracer::setAovs(const std::string& filename) {
+    aovFilename = filename;
+}
+
+void RayTracer::setRegion(int x, int y, int width, int height) {
+    regionX = x;
+    regionY = y;
+    regionWidth = width;
+    regionHeight = height;
+}
+
+bool RayTracer::isValidRegion(int x, int y, int width, int height) const {
+    return width > 0 && height > 0 && x < imageWidth && y < imageHeight && x + width > 0 && y + height > 0;
+}
+
+void RayTracer::setSampleRange(int first, int count) {
+    sampleRangeFirst = first;
+    sampleRangeCount = count;
+}
+
+void RayTracer::setSeed(uint64_t seed) {
+    frameSeed = seed;
+}
+
+void RayTracer::setCheckpoint(const std::string& filename, double intervalSeconds, uint64_t sceneHash) {
+    checkpointFilename = filename;
+    checkpointInterval = intervalSeconds;
+    checkpointSceneHash = sceneHash;
+}
+
+bool RayTracer::resumeFrom(const std::string& filename) {
+    if (!checkpoint.load(filename))
+        return false;
+    if (checkpoint.width != imageWidth || checkpoint.height != imageHeight) {
+        std::cerr << "Error: Checkpoint " << filename << " is for a " << checkpoint.width << "x" << checkpoint.height
+                  << " image, not " << imageWidth << "x" << imageHeight << std::endl;
+        return false;
+    }
+    if (checkpoint.sceneHash != checkpointSceneHash) {
+        std::cerr << "Error: Checkpoint " << filename << " was rendered from another scene or other sampling settings" << std::endl;
+        return false;
+    }
+    frameSeed = checkpoint.seed;
+    resumed = true;
+    return true;
+}
+
+void RayTracer::setCropOutput(bool crop) {
+    cropOutput = crop;
+}
+
+void RayTracer::setTileSize(int size) {
+    tileSize = std::max(1, size);
+}
+
+void RayTracer::setHeatmap(const std::string& filename, CostMetric metric) {
+    heatmapFilename = filename;
+    costMetric = metric;
 }
\ No newline at end of file
@@ -0,0 +1,124 @@
+// RenderCheckpoint.cpp
+#include "RenderCheckpoint.h"
+#include "BinaryFile.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+namespace {
+
+const char checkpointMagic[8] = {'R', 'T', 'C', 'K', 'P', 'T', '\0', '\0'};
+const uint32_t checkpointVersion = 2;
+const uint32_t checkpointEndianTag = 0x01020304;
+
+/*
+* Fixed-size header of a checkpoint file. It is followed by the per-pixel sample
+* counts (uint32), then the radiance sums and squared sums (three doubles each).
+*/
+struct CheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t width;
+    uint32_t height;
+    uint32_t sampleGrid;
+    uint32_t reserved;
+    uint64_t seed;
+    uint64_t sceneHash;
+};
+
+}
+
+void RenderCheckpoint::reset(int width, int height, int sampleGrid, uint64_t seed, uint64_t sceneHash) {
+    this->width = width;
+    this->height = height;
+    this->sampleGrid = std::max(1, sampleGrid);
+    this->seed = seed;
+    this->sceneHash = sceneHash;
+    size_t pixels = static_cast<size_t>(width) * height;
+    sampleCount.assign(pixels, 0);
+    radianceSum.assign(pixels, Vec3<double>(0, 0, 0));
+    radianceSquaredSum.assign(pixels, Vec3<double>(0, 0, 0));
+}
+
+bool RenderCheckpoint::load(const std::string& filename) {
+    std::ifstream inFile(filename, std::ios::binary);
+    if (!inFile.is_open()) {
+        std::cerr << "Error: Could not open checkpoint file " << filename << std::endl;
+        return false;
+    }
+
+    CheckpointHeader header;
+    if (!inFile.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, checkpointMagic, sizeof(checkpointMagic)) != 0 ||
+        header.version != checkpointVersion || header.endianTag != checkpointEndianTag ||
+        header.width == 0 || header.height == 0 || header.sampleGrid == 0 ||
+        static_cast<uint64_t>(header.width) * header.height > std::numeric_limits<int>::max()) {
+        std::cerr << "Error: " << filename << " is not a checkpoint written by this version" << std::endl;
+        return false;
+    }
+
+    reset(static_cast<int>(header.width), static_cast<int>(header.height), static_cast<int>(header.sampleGrid), header.seed,
+          header.sceneHash);
+    if (!BinaryFile::readArray(inFile, sampleCount) ||
+        !BinaryFile::readVectors<double>(inFile, radianceSum) || !BinaryFile::readVectors<double>(inFile, radianceSquaredSum)) {
+        std::cerr << "Error: Checkpoint file " << filename << " is truncated" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool RenderCheckpoint::write(const std::string& filename) const {
+    CheckpointHeader header = {};
+    std::memcpy(header.magic, checkpointMagic, sizeof(checkpointMagic));
+    header.version = checkpointVersion;
+    header.endianTag = checkpointEndianTag;
+    header.width = static_cast<uint32_t>(width);
+    header.height = static_cast<uint32_t>(height);
+    header.sampleGrid = static_cast<uint32_t>(sampleGrid);
+    header.seed = seed;
+    header.sceneHash = sceneHash;
+
+    return BinaryFile::replace(filename, "checkpoint file", [&](std::ostream& outFile) {
+        outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        BinaryFile::writeArray(outFile, sampleCount);
+        BinaryFile::writeVectors<double>(outFile, radianceSum);
+        BinaryFile::writeVectors<double>(outFile, radianceSquaredSum);
+    });
+}
+
+uint32_t RenderCheckpoint::minSampleCount(int i0, int j0, int i1, int j1) const {
+    uint32_t minimum = std::numeric_limits<uint32_t>::max();
+    for (int j = j0; j < j1; ++j) {
+        for (int i = i0; i < i1; ++i) {
+            minimum = std::min(minimum, sampleCount[static_cast<size_t>(j) * width + i]);
+        }
+    }
+    return minimum == std::numeric_limits<uint32_t>::max() ? 0 : minimum;
+}
+
+/*
+* Function to estimate the variance of a pixel's mean radiance from its sums:
+* (E[x^2] - E[x]^2) / (n - 1) per channel, averaged over the channels.
+*/
+double RenderCheckpoint::meanVariance(size_t pixel) const {
+    double n = sampleCount[pixel];
+    if (n < 2)
+        return 0.0;
+    Vec3<double> mean = radianceSum[pixel] / n;
+    Vec3<double> variance = radianceSquaredSum[pixel] / n - mean * mean;
+    return std::max(0.0, (variance.x + variance.y + variance.z) / 3.0) / (n - 1);
+}
+
+uint64_t RenderCheckpoint::hashScene(const std::string& settings, uint64_t shapesHash) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : settings) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    for (int k = 0; k < 8; ++k) {
+        hash = (hash ^ ((shapesHash >> (8 * k)) & 0xff)) * 1099511628211ULL;
+    }
+    return hash;
+}
@@ -0,0 +1,283 @@
+// RenderServer.cpp
+#include "RenderServer.h"
+#include "SceneLoader.h"
+#include "RayTracer.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+
+/*
+* A scene kept in memory between jobs.
+*/
+struct RenderServer::ResidentScene {
+    json settings;
+    std::unique_ptr<Scene> scene;
+    std::string renderMode;
+    int maxDepth = 5;
+    std::filesystem::file_time_type modifiedTime;
+};
+
+namespace {
+
+double millisecondsSince(std::chrono::high_resolution_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+bool sendError(SocketConnection& connection, const std::string& message) {
+    return connection.sendLine({{"type", "error"}, {"message", message}});
+}
+
+}
+
+RenderServer::RenderServer(const std::string& address) : address(address), running(false) {}
+
+RenderServer::~RenderServer() {}
+
+bool RenderServer::run() {
+    SocketListener listener;
+    if (!listener.open(address))
+        return false;
+
+    std::cout << "Render server listening on " << address << std::endl;
+    running = true;
+    while (running) {
+        std::unique_ptr<SocketConnection> connection = listener.accept();
+        if (!connection)
+            break;
+        serveConnection(*connection);
+    }
+    std::cout << "Render server stopped." << std::endl;
+    return true;
+}
+
+/*
+* Function to read newline-delimited requests from a client until it disconnects.
+*/
+void RenderServer::serveConnection(SocketConnection& connection) {
+    std::string line;
+    while (running && connection.readLine(line)) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+
+        json request = json::parse(line, nullptr, false);
+        if (request.is_discarded() || !request.is_object()) {
+            sendError(connection, "Request is not a JSON object");
+            continue;
+        }
+        handleRequest(connection, request);
+    }
+}
+
+void RenderServer::handleRequest(SocketConnection& connection, const json& request) {
+    std::string command = request.value("command", "render");
+    if (command == "render") {
+        // Malformed fields surface as JSON type errors before anything is rendered
+        try {
+            renderJob(connection, request);
+        } catch (const json::exception& exception) {
+            sendError(connection, std::string("Invalid render request: ") + exception.what());
+        }
+    } else if (command == "status") {
+        json resident = json::array();
+        for (const auto& entry : scenes) {
+            resident.push_back({{"scene", entry.first}, {"objects", entry.second->scene->objects.size()}});
+        }
+        connection.sendLine({{"type", "status"}, {"scenes", resident}});
+    } else if (command == "unload") {
+        scenes.erase(request.value("scene", ""));
+        connection.sendLine({{"type", "done"}});
+    } else if (command == "shutdown") {
+        running = false;
+        connection.sendLine({{"type", "done"}});
+    } else {
+        sendError(connection, "Unknown command '" + command + "'");
+    }
+}
+
+RenderServer::ResidentScene* RenderServer::getScene(const std::string& path, std::string& error) {
+    std::error_code fileError;
+    auto modifiedTime = std::filesystem::last_write_time(path, fileError);
+    if (fileError) {
+        error = "Could not open scene " + path;
+        return nullptr;
+    }
+
+    auto found = scenes.find(path);
+    if (found != scenes.end() && found->second->modifiedTime == modifiedTime)
+        return found->second.get();
+
+    std::cout << "Loading scene " << path << "..." << std::endl;
+    SceneLoader loader;
+    if (!loader.load(path)) {
+        error = "Could not parse scene " + path;
+        return nullptr;
+    }
+
+    auto resident = std::make_unique<ResidentScene>();
+    resident->settings = loader.getSettings();
+    resident->modifiedTime = modifiedTime;
+    Vector3 backgroundColor(0, 0, 0);
+    try {
+        resident->scene = std::make_unique<Scene>(
+            parseSceneSettings(resident->settings, resident->maxDepth, resident->renderMode, backgroundColor));
+        parseLights(resident->settings["scene"]["lightsources"], *resident->scene);
+    } catch (const json::exception& exception) {
+        error = "Invalid scene " + path + ": " + exception.what();
+        return nullptr;
+    }
+    for (const auto& object : loader.getObjects()) {
+        resident->scene->addObject(object);
+    }
+    if (resident->settings.value("bvh", true) && !resident->scene->objects.empty()) {
+        PhaseTimer bvhTimer("bvh");
+        resident->scene->buildBVH();
+    }
+    std::cout << resident->scene->objects.size() << " shapes resident." << std::endl;
+
+    ResidentScene* scene = resident.get();
+    scenes[path] = std::move(resident);
+    return scene;
+}
+
+/*
+* Function to render one job and stream its tiles back to the client.
+*/
+void RenderServer::renderJob(SocketConnection& connection, const json& job) {
+    auto jobStart = std::chrono::high_resolution_clock::now();
+    if (!job.contains("scene") || !job["scene"].is_string()) {
+        sendError(connection, "Render request needs a \"scene\" path");
+        return;
+    }
+
+    std::string error;
+    ResidentScene* resident = getScene(job["scene"], error);
+    if (!resident) {
+        sendError(connection, error);
+        return;
+    }
+    double loadMs = millisecondsSince(jobStart);
+
+    // Per-job overrides are applied to copies of the resident settings
+    json settings = resident->settings;
+    json cameraJson = settings["camera"];
+    if (job.contains("camera"))
+        cameraJson.merge_patch(job["camera"]);
+    for (const char* key : {"width", "height"}) {
+        if (job.contains(key))
+            cameraJson[key] = job[key];
+    }
+    for (const char* key : {"pixelsample", "lightsample", "raysorting", "occludercache", "tilesize"}) {
+        if (job.contains(key))
+            settings[key] = job[key];
+    }
+
+    int imageWidth = 0;
+    int imageHeight = 0;
+    double exposure = 1.0;
+    auto camera = std::make_unique<Camera>(parseCamera(cameraJson, imageWidth, imageHeight, exposure));
+    if (imageWidth < 2 || imageHeight < 2) {
+        sendError(connection, "Image must be at least 2x2 pixels");
+        return;
+    }
+
+    // Jobs choose their own region; a crop stored in the scene does not apply
+    settings.erase("crop");
+    RayTracer rayTracer(resident->scene.get(), camera.get(), imageWidth, imageHeight);
+    configureRayTracer(rayTracer, settings, resident->renderMode, resident->maxDepth, exposure);
+    rayTracer.setToneMap(parseToneMapping(job.value("tonemap", "none")));
+
+    int regionX = 0, regionY = 0, regionWidth = imageWidth, regionHeight = imageHeight;
+    rayTracer.setRegion(0, 0, 0, 0);
+    if (job.contains("region")) {
+        const json& region = job["region"];
+        if (!region.is_array() || region.size() != 4) {
+            sendError(connection, "\"region\" must be [x, y, width, height]");
+            return;
+        }
+        regionX = std::clamp(region[0].get<int>(), 0, imageWidth);
+        regionY = std::clamp(region[1].get<int>(), 0, imageHeight);
+        regionWidth = std::clamp(region[2].get<int>(), 0, imageWidth - regionX);
+        regionHeight = std::clamp(region[3].get<int>(), 0, imageHeight - regionY);
+        if (regionWidth == 0 || regionHeight == 0) {
+            sendError(connection, "\"region\" is empty");
+            return;
+        }
+        rayTracer.setRegion(regionX, regionY, regionWidth, regionHeight);
+    }
+
+    // Distributed jobs share the coordinator's seed and may cover only part of the samples
+    if (job.contains("seed"))
+        rayTracer.setSeed(job["seed"].get<uint64_t>());
+    if (job.contains("samples")) {
+        const json& samples = job["samples"];
+        if (!samples.is_array() || samples.size() != 2) {
+            sendError(connection, "\"samples\" must be [first, count]");
+            return;
+        }
+        rayTracer.setSampleRange(samples[0].get<int>(), samples[1].get<int>());
+    }
+    std::string format = job.value("format", "rgb8");
+    if (format != "rgb8" && format != "radiance") {
+        sendError(connection, "Unknown format '" + format + "'");
+        return;
+    }
+    bool radiance = format == "radiance";
+
+    connection.sendLine({
+        {"type", "begin"},
+        {"width", imageWidth},
+        {"height", imageHeight},
+        {"region", {regionX, regionY, regionWidth, regionHeight}},
+        {"format", format}
+    });
+
+    // Tiles are sent as they finish; once the client is gone the rest are dropped
+    bool connected = true;
+    int tilesSent = 0;
+    std::string payload;
+    auto renderStart = std::chrono::high_resolution_clock::now();
+    rayTracer.renderTiles([&](int x, int y, int width, int height, const std::vector<Vec3<double>>& pixels) {
+        if (!connected)
+            return;
+        if (radiance) {
+            payload.resize(pixels.size() * 3 * sizeof(double));
+            char* out = payload.data();
+            for (const Vec3<double>& pixel : pixels) {
+                double channels[3] = {pixel.x, pixel.y, pixel.z};
+                std::memcpy(out, channels, sizeof(channels));
+                out += sizeof(channels);
+            }
+        } else {
+            payload.resize(pixels.size() * 3);
+            for (size_t p = 0; p < pixels.size(); ++p) {
+                payload[3 * p] = static_cast<char>(static_cast<int>(255.999 * pixels[p].x));
+                payload[3 * p + 1] = static_cast<char>(static_cast<int>(255.999 * pixels[p].y));
+                payload[3 * p + 2] = static_cast<char>(static_cast<int>(255.999 * pixels[p].z));
+            }
+        }
+        connected = connection.sendLine({
+            {"type", "tile"},
+            {"x", x},
+            {"y", y},
+            {"width", width},
+            {"height", height},
+            {"bytes", payload.size()}
+        }) && connection.sendAll(payload.data(), payload.size());
+        ++tilesSent;
+    }, radiance);
+
+    if (!connected) {
+        std::cerr << "Client disconnected during a render job" << std::endl;
+        return;
+    }
+    connection.sendLine({
+        {"type", "done"},
+        {"tiles", tilesSent},
+        {"load_ms", loadMs},
+        {"render_ms", millisecondsSince(renderStart)}
+    });
+}
+
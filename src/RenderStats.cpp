@@ -0,0 +1,207 @@
+// RenderStats.cpp
+#include "RenderStats.h"
+#include "CpuDispatch.h"
+#include "Profiler.h"
+#include "nlohmann/json.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+
+struct ThreadCounters;
+
+std::mutex registryMutex;
+std::vector<ThreadCounters*> registry;
+RenderCounters retired; // Counters of threads that have already exited
+std::vector<std::pair<std::string, double>> phases;
+
+/*
+* Per-thread counters that register themselves so that total() can find them.
+*/
+struct ThreadCounters {
+    RenderCounters counters;
+
+    ThreadCounters() {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.push_back(this);
+    }
+
+    ~ThreadCounters() {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        retired += counters;
+        registry.erase(std::remove(registry.begin(), registry.end(), this), registry.end());
+    }
+};
+
+}
+
+RenderCounters& RenderCounters::operator+=(const RenderCounters& other) {
+    primaryRays += other.primaryRays;
+    secondaryRays += other.secondaryRays;
+    shadowRays += other.shadowRays;
+    shadowCacheHits += other.shadowCacheHits;
+    bvhNodeVisits += other.bvhNodeVisits;
+    bvhLeafVisits += other.bvhLeafVisits;
+    primitiveTests += other.primitiveTests;
+    return *this;
+}
+
+bool RenderStats::enabled() {
+#ifdef RT_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+RenderCounters& RenderStats::local() {
+    thread_local ThreadCounters threadCounters;
+    return threadCounters.counters;
+}
+
+RenderCounters RenderStats::total() {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    RenderCounters sum = retired;
+    for (const ThreadCounters* threadCounters : registry) {
+        sum += threadCounters->counters;
+    }
+    return sum;
+}
+
+void RenderStats::addPhase(const std::string& name, double milliseconds) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto& phase : phases) {
+        if (phase.first == name) {
+            phase.second += milliseconds;
+            return;
+        }
+    }
+    phases.emplace_back(name, milliseconds);
+}
+
+double RenderStats::getPhase(const std::string& name) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto& phase : phases) {
+        if (phase.first == name)
+            return phase.second;
+    }
+    return 0.0;
+}
+
+const std::vector<std::pair<std::string, double>>& RenderStats::getPhases() {
+    return phases;
+}
+
+long RenderStats::peakRSSKilobytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS memoryCounters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &memoryCounters, sizeof(memoryCounters)))
+        return static_cast<long>(memoryCounters.PeakWorkingSetSize / 1024);
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // Bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+bool RenderStats::writeJSON(const std::string& filename, const std::string& sceneName) {
+    RenderCounters counters = total();
+    double renderMs = getPhase("render");
+
+    json stats;
+    stats["scene"] = sceneName;
+
+    json phaseJson = json::object();
+    for (const auto& phase : getPhases()) {
+        phaseJson[phase.first] = phase.second;
+    }
+    stats["phases_ms"] = phaseJson;
+
+    // Ray and traversal counts are only reported by builds that count them
+    stats["counters"] = enabled();
+    if (enabled()) {
+        stats["rays"] = {
+            {"primary", counters.primaryRays},
+            {"secondary", counters.secondaryRays},
+            {"shadow", counters.shadowRays},
+            {"shadow_cache_hits", counters.shadowCacheHits},
+            {"total", counters.totalRays()}
+        };
+        stats["mrays_per_second"] = renderMs > 0.0 ? counters.totalRays() / (renderMs * 1000.0) : 0.0;
+
+        double raysTraced = std::max<double>(1.0, static_cast<double>(counters.totalRays()));
+        stats["bvh"] = {
+            {"node_visits", counters.bvhNodeVisits},
+            {"leaf_visits", counters.bvhLeafVisits},
+            {"primitive_tests", counters.primitiveTests},
+            {"node_visits_per_ray", counters.bvhNodeVisits / raysTraced},
+            {"primitive_tests_per_ray", counters.primitiveTests / raysTraced}
+        };
+    }
+    stats["peak_rss_kb"] = peakRSSKilobytes();
+    stats["cpu_target"] = CpuDispatch::selectedTarget();
+
+    std::ofstream outFile(filename);
+    if (!outFile.is_open()) {
+        std::cerr << "Error: Could not open stats file " << filename << std::endl;
+        return false;
+    }
+    outFile << stats.dump(4) << std::endl;
+    return true;
+}
+
+void RenderStats::printSummary() {
+    RenderCounters counters = total();
+    double renderMs = getPhase("render");
+
+    std::cout << "Phase timings:" << std::endl;
+    for (const auto& phase : getPhases()) {
+        std::cout << "  " << phase.first << ": " << phase.second << " ms" << std::endl;
+    }
+    if (!enabled()) {
+        std::cout << "Rays: not counted (build with make STATS=1)" << std::endl;
+        return;
+    }
+    std::cout << "Rays: " << counters.primaryRays << " primary, " << counters.secondaryRays
+              << " secondary, " << counters.shadowRays << " shadow ("
+              << counters.shadowCacheHits << " answered by the occluder cache)" << std::endl;
+    if (renderMs > 0.0) {
+        std::cout << "Throughput: " << counters.totalRays() / (renderMs * 1000.0) << " Mrays/s" << std::endl;
+    }
+}
+
+PhaseTimer::PhaseTimer(const std::string& name)
+    : name(name), start(std::chrono::high_resolution_clock::now()), traceStart(Profiler::now()), stopped(false) {}
+
+PhaseTimer::~PhaseTimer() {
+    stop();
+}
+
+double PhaseTimer::stop() {
+    if (stopped)
+        return 0.0;
+    stopped = true;
+    auto end = std::chrono::high_resolution_clock::now();
+    double milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    RenderStats::addPhase(name, milliseconds);
+    if (Profiler::enabled())
+        Profiler::recordEvent(name, traceStart, Profiler::now() - traceStart);
+    return milliseconds;
+}
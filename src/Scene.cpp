@@ -7,13 +7,24 @@
 #include "Intersectable.h"
 #include "Light.h"
 #include "Vector3.h"
+#include "Profiler.h"
+#include "SpatialSplitBVH.h"
+#include "WideBVH.h"
+#include <cmath>
+#include <iostream>
 
 // Initialize scene with background color
 Scene::Scene(const Vector3& backgroundColor) : backgroundColor(backgroundColor) {}
 
 // Add object to scene
 void Scene::addObject(std::shared_ptr<Intersectable> object) {
-    objects.push_back(object);
+    BoundingBox box = object->getBoundingBox();
+    bool bounded = std::isfinite(box.min.x) && std::isfinite(box.min.y) && std::isfinite(box.min.z) &&
+                   std::isfinite(box.max.x) && std::isfinite(box.max.y) && std::isfinite(box.max.z);
+    if (bounded)
+        objects.push_back(object);
+    else
+        unboundedObjects.push_back(object);
 }
 
 // Add light to scene
@@ -39,7 +50,20 @@ void Scene::addLight(std::shared_ptr<Light> light) {
 // }
 
 void Scene::buildBVH() {
-    bvhRoot = std::make_shared<BVHNode>(objects, 0, objects.size());
+    bvhSplitReferences = 0;
+    if (objects.empty()) {
+        bvhRoot = nullptr;
+        wideBVH = nullptr;
+        return;
+    }
+    if (bvhSpatialSplits) {
+        SpatialSplitBVH builder(objects, bvhSplitBudget);
+        bvhRoot = builder.build();
+        bvhSplitReferences = builder.getReferenceCount() - objects.size();
+    } else {
+        bvhRoot = std::make_shared<BVHNode>(objects, 0, objects.size());
+    }
+    collapseBVH();
     
     // std::cout << "BVH Tree: " << std::endl;    
     // std::cout << "Root: " << bvhRoot->boundingBox.min << " " << bvhRoot->boundingBox.max << std::endl;
@@ -60,13 +84,54 @@ void Scene::buildBVH() {
     
 }
 
+void Scene::collapseBVH() {
+    wideBVH = nullptr;
+    if (!bvhRoot || bvhWidth == 2)
+        return;
+    if (bvhWidth != 4 && bvhWidth != 8) {
+        std::cerr << "Error: Unsupported bvhwidth " << bvhWidth << ", expected 2, 4 or 8. Using the binary BVH." << std::endl;
+        return;
+    }
+    if (bvhQuantization != 0 && bvhQuantization != 8 && bvhQuantization != 16) {
+        std::cerr << "Error: Unsupported bvhquantization " << bvhQuantization << ", expected 0, 8 or 16. Storing uncompressed bounds." << std::endl;
+        bvhQuantization = 0;
+    }
+
+    int format = bvhWidth * 100 + bvhQuantization;
+    switch (format) {
+        case 400: wideBVH = std::make_shared<WideBVH<4>>(*bvhRoot); break;
+        case 800: wideBVH = std::make_shared<WideBVH<8>>(*bvhRoot); break;
+        case 408: wideBVH = std::make_shared<WideBVH<4, 8>>(*bvhRoot); break;
+        case 808: wideBVH = std::make_shared<WideBVH<8, 8>>(*bvhRoot); break;
+        case 416: wideBVH = std::make_shared<WideBVH<4, 16>>(*bvhRoot); break;
+        case 816: wideBVH = std::make_shared<WideBVH<8, 16>>(*bvhRoot); break;
+    }
+}
+
+BoundingBox Scene::getBounds() const {
+    if (bvhRoot)
+        return bvhRoot->boundingBox;
+    if (objects.empty())
+        return BoundingBox();
+
+    BoundingBox bounds = objects[0]->getBoundingBox();
+    for (size_t i = 1; i < objects.size(); ++i) {
+        bounds = bounds.merge(objects[i]->getBoundingBox());
+    }
+    return bounds;
+}
+
 bool Scene::intersect(const Ray& ray, HitRecord& hitRecord) const {
-    if (bvhRoot) 
-        return bvhRoot->intersect(ray, hitRecord);
+    RT_PROFILE_ZONE(ProfileZone::SceneIntersect);
+
+    bool hitAnything = false;
+    if (wideBVH)
+        hitAnything = wideBVH->intersect(ray, hitRecord);
+    else if (bvhRoot) 
+        hitAnything = bvhRoot->intersect(ray, hitRecord);
     else {
         // Fallback to linear traversal if BVH is not built
-        bool hitAnything = false;
-        double closestSoFar = std::numeric_limits<double>::max();
+        Real closestSoFar = std::numeric_limits<Real>::max();
         HitRecord tempRecord;
 
         for (const auto& object : objects) {
@@ -76,6 +141,40 @@ bool Scene::intersect(const Ray& ray, HitRecord& hitRecord) const {
                 hitRecord = tempRecord;
             }
         }
-        return hitAnything;
     }
+
+    // Infinite planes would overlap every BVH node, so they are tested on their own
+    if (!unboundedObjects.empty()) {
+        HitRecord tempRecord;
+        for (const auto& object : unboundedObjects) {
+            if (object->intersect(ray, tempRecord) && (!hitAnything || tempRecord.t < hitRecord.t)) {
+                hitAnything = true;
+                hitRecord = tempRecord;
+            }
+        }
+    }
+    return hitAnything;
+}
+
+bool Scene::occluded(const Ray& ray, Real maxDistance, const Intersectable*& occluder) const {
+    RT_PROFILE_ZONE(ProfileZone::SceneIntersect);
+
+    if (wideBVH) {
+        if (wideBVH->occluded(ray, maxDistance, occluder))
+            return true;
+    } else if (bvhRoot) {
+        if (bvhRoot->occluded(ray, maxDistance, occluder))
+            return true;
+    } else {
+        for (const auto& object : objects) {
+            if (object->occluded(ray, maxDistance, occluder))
+                return true;
+        }
+    }
+
+    for (const auto& object : unboundedObjects) {
+        if (object->occluded(ray, maxDistance, occluder))
+            return true;
+    }
+    return false;
 }
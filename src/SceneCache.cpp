@@ -0,0 +1,607 @@
+// SceneCache.cpp
+#include "SceneCache.h"
+#include "BinaryFile.h"
+#include "BVHNode.h"
+#include "Sphere.h"
+#include "Triangle.h"
+#include "Cylinder.h"
+#include "Plane.h"
+#include "Quad.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+* A section of the cache file: byte offset and number of records.
+*/
+struct CacheSection {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianTag;
+    uint32_t vectorSize;   // sizeof(Vector3) of the writer; texels are stored in that layout
+    uint32_t reserved;
+    uint64_t fileSize;
+    uint64_t shapesHash;
+    uint64_t sourceSize;   // Size and time of the scene file the cache was built from
+    int64_t sourceTime;
+    CacheSection materials;
+    CacheSection textures;
+    CacheSection primitives;
+    CacheSection nodes;
+    CacheSection texels;
+    CacheSection strings;  // Texture paths
+    CacheSection settings; // CBOR encoded scene JSON without shapes
+    CacheSection source;   // Canonical path of the scene file
+};
+
+/*
+* Read-only view of a cache file, memory-mapped where the platform allows it.
+*/
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    std::vector<char> buffer;
+#endif
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (data)
+            munmap(const_cast<char*>(data), size);
+#endif
+    }
+};
+
+namespace {
+
+const char cacheMagic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '\0'};
+const uint32_t cacheVersion = 3;
+const uint32_t cacheEndianTag = 0x01020304;
+const uint64_t sectionAlignment = 64;
+
+enum PrimitiveType : uint32_t {
+    PRIMITIVE_SPHERE,
+    PRIMITIVE_TRIANGLE,
+    PRIMITIVE_CYLINDER,
+    PRIMITIVE_PLANE,
+    PRIMITIVE_QUAD
+};
+
+struct CacheMaterial {
+    double ks;
+    double kd;
+    double reflectivity;
+    double refractiveIndex;
+    double diffuseColor[3];
+    double specularColor[3];
+    int32_t specularExponent;
+    int32_t texture; // Index into the texture table, -1 for none
+    uint8_t isReflective;
+    uint8_t isRefractive;
+    uint8_t padding[6];
+};
+
+struct CacheTexture {
+    int32_t width;
+    int32_t height;
+    uint64_t firstTexel;
+    uint64_t pathOffset;
+    uint64_t pathLength;
+    int64_t modifiedTime; // Texture file time when the cache was written
+};
+
+struct CachePrimitive {
+    uint32_t type;
+    int32_t material;
+    // Sphere: center, radius. Triangle: v0, v1, v2. Cylinder: baseCenter, axis, radius, height, hasCaps.
+    // Plane: point, normal, tileSize. Quad: corner, edgeU, edgeV, tileSize, normal flipped (1) or not (0)
+    double data[11];
+};
+
+struct CacheNode {
+    double min[3];
+    double max[3];
+    int32_t left;  // Node or primitive index, -1 if none
+    int32_t right;
+    uint8_t leftIsNode;
+    uint8_t rightIsNode;
+    uint8_t isLeaf;
+    uint8_t isObjectLeaf; // Single primitive stored in left
+    uint32_t padding;
+};
+
+uint64_t alignOffset(uint64_t offset) {
+    return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+}
+
+int64_t fileTime(const std::string& path) {
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(path, error);
+    if (error)
+        return 0;
+    return static_cast<int64_t>(time.time_since_epoch().count());
+}
+
+uint64_t fileSize(const std::string& path) {
+    std::error_code error;
+    uintmax_t size = std::filesystem::file_size(path, error);
+    return error ? 0 : static_cast<uint64_t>(size);
+}
+
+// Absolute path with links and dot segments resolved, so a scene named two
+// ways maps to the same cache
+std::string canonicalPath(const std::string& path) {
+    std::error_code error;
+    std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+    return error ? path : canonical.string();
+}
+
+void storeVector(double* out, const Vector3& v) {
+    out[0] = v.x;
+    out[1] = v.y;
+    out[2] = v.z;
+}
+
+Vector3 loadVector(const double* in) {
+    return Vector3(in[0], in[1], in[2]);
+}
+
+/*
+* Serialises the objects and BVH of a scene into cache records.
+*/
+struct CacheWriter {
+    std::vector<CacheMaterial> materials;
+    std::vector<CacheTexture> textures;
+    std::vector<CachePrimitive> primitives;
+    std::vector<CacheNode> nodes;
+    std::vector<const Vector3*> textureTexels;
+    std::string strings;
+    uint64_t texelCount = 0;
+
+    std::map<std::string, int32_t> materialIndex;
+    std::map<std::string, int32_t> textureIndex;
+    std::unordered_map<const Intersectable*, int32_t> primitiveIndex;
+
+    int32_t addTexture(const Material& material) {
+        auto found = textureIndex.find(material.texturePath);
+        if (found != textureIndex.end())
+            return found->second;
+
+        CacheTexture texture = {};
+        texture.width = material.textureWidth;
+        texture.height = material.textureHeight;
+        texture.firstTexel = texelCount;
+        texture.pathOffset = strings.size();
+        texture.pathLength = material.texturePath.size();
+        texture.modifiedTime = fileTime(material.texturePath);
+        strings += material.texturePath;
+        texelCount += static_cast<uint64_t>(texture.width) * texture.height;
+
+        int32_t index = static_cast<int32_t>(textures.size());
+        textures.push_back(texture);
+        textureTexels.push_back(material.textureData.get());
+        textureIndex[material.texturePath] = index;
+        return index;
+    }
+
+    int32_t addMaterial(const Material& material) {
+        CacheMaterial record;
+        std::memset(&record, 0, sizeof(record));
+        record.ks = material.ks;
+        record.kd = material.kd;
+        record.reflectivity = material.reflectivity;
+        record.refractiveIndex = material.refractiveIndex;
+        storeVector(record.diffuseColor, material.diffuseColor);
+        storeVector(record.specularColor, material.specularColor);
+        record.specularExponent = material.specularExponent;
+        record.texture = material.hasTexture && material.textureData ? addTexture(material) : -1;
+        record.isReflective = material.isReflective;
+        record.isRefractive = material.isRefractive;
+
+        // Every primitive carries its own copy of its material, so identical ones are shared here
+        std::string key(reinterpret_cast<const char*>(&record), sizeof(record));
+        auto found = materialIndex.find(key);
+        if (found != materialIndex.end())
+            return found->second;
+
+        int32_t index = static_cast<int32_t>(materials.size());
+        materials.push_back(record);
+        materialIndex[key] = index;
+        return index;
+    }
+
+    bool addPrimitive(const std::shared_ptr<Intersectable>& object) {
+        CachePrimitive record;
+        std::memset(&record, 0, sizeof(record));
+
+        if (auto sphere = std::dynamic_pointer_cast<Sphere>(object)) {
+            record.type = PRIMITIVE_SPHERE;
+            record.material = addMaterial(sphere->material);
+            storeVector(record.data, sphere->center);
+            record.data[3] = sphere->radius;
+        } else if (auto triangle = std::dynamic_pointer_cast<Triangle>(object)) {
+            record.type = PRIMITIVE_TRIANGLE;
+            record.material = addMaterial(triangle->material);
+            storeVector(record.data, triangle->v0);
+            storeVector(record.data + 3, triangle->v1);
+            storeVector(record.data + 6, triangle->v2);
+        } else if (auto cylinder = std::dynamic_pointer_cast<Cylinder>(object)) {
+            record.type = PRIMITIVE_CYLINDER;
+            record.material = addMaterial(cylinder->material);
+            storeVector(record.data, cylinder->baseCenter);
+            storeVector(record.data + 3, cylinder->axis);
+            record.data[6] = cylinder->radius;
+            record.data[7] = cylinder->height;
+            record.data[8] = cylinder->hasCaps ? 1.0 : 0.0;
+        } else if (auto plane = std::dynamic_pointer_cast<Plane>(object)) {
+            record.type = PRIMITIVE_PLANE;
+            record.material = addMaterial(plane->material);
+            storeVector(record.data, plane->point);
+            storeVector(record.data + 3, plane->normal);
+            record.data[6] = plane->tileSize;
+        } else if (auto quad = std::dynamic_pointer_cast<Quad>(object)) {
+            record.type = PRIMITIVE_QUAD;
+            record.material = addMaterial(quad->material);
+            storeVector(record.data, quad->corner);
+            storeVector(record.data + 3, quad->edgeU);
+            storeVector(record.data + 6, quad->edgeV);
+            record.data[9] = quad->tileSize;
+            record.data[10] = quad->normal.dot(quad->edgeU.cross(quad->edgeV)) < 0 ? 1.0 : 0.0;
+        } else {
+            std::cerr << "Error: Scene cache does not support this primitive type" << std::endl;
+            return false;
+        }
+
+        primitiveIndex[object.get()] = static_cast<int32_t>(primitives.size());
+        primitives.push_back(record);
+        return true;
+    }
+
+    // Reference to a child: a BVH node (flattened recursively) or a primitive
+    bool addChild(const std::shared_ptr<Intersectable>& child, int32_t& index, uint8_t& isNode) {
+        index = -1;
+        isNode = 0;
+        if (!child)
+            return true;
+        if (auto node = std::dynamic_pointer_cast<BVHNode>(child)) {
+            isNode = 1;
+            index = addNode(*node);
+            return index >= 0;
+        }
+        auto found = primitiveIndex.find(child.get());
+        if (found == primitiveIndex.end()) {
+            std::cerr << "Error: BVH references an object that is not in the scene" << std::endl;
+            return false;
+        }
+        index = found->second;
+        return true;
+    }
+
+    // Nodes are stored in pre-order, so children always follow their parent
+    int32_t addNode(const BVHNode& node) {
+        int32_t index = static_cast<int32_t>(nodes.size());
+        nodes.emplace_back();
+        CacheNode record;
+        std::memset(&record, 0, sizeof(record));
+        storeVector(record.min, node.boundingBox.min);
+        storeVector(record.max, node.boundingBox.max);
+        record.isLeaf = node.isLeaf;
+
+        bool ok;
+        if (node.object) {
+            record.isObjectLeaf = 1;
+            ok = addChild(node.object, record.left, record.leftIsNode);
+            record.right = -1;
+        } else {
+            ok = addChild(node.left, record.left, record.leftIsNode) &&
+                 addChild(node.right, record.right, record.rightIsNode);
+        }
+        if (!ok)
+            return -1;
+        nodes[index] = record;
+        return index;
+    }
+};
+
+}
+
+SceneCache::SceneCache() : header(nullptr) {}
+
+bool SceneCache::open(const std::string& filename) {
+    file.reset();
+    header = nullptr;
+    this->filename = filename;
+
+    auto mapped = std::make_shared<MappedFile>();
+#ifdef _WIN32
+    // No mmap here: read the whole file instead
+    std::ifstream inFile(filename, std::ios::binary);
+    if (!inFile.is_open())
+        return false;
+    mapped->buffer.assign(std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>());
+    mapped->data = mapped->buffer.data();
+    mapped->size = mapped->buffer.size();
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < static_cast<off_t>(sizeof(CacheHeader))) {
+        ::close(fd);
+        return false;
+    }
+    void* address = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+        return false;
+    mapped->data = static_cast<const char*>(address);
+    mapped->size = static_cast<size_t>(fileStat.st_size);
+#endif
+
+    if (mapped->size < sizeof(CacheHeader))
+        return false;
+    const CacheHeader* fileHeader = reinterpret_cast<const CacheHeader*>(mapped->data);
+    if (std::memcmp(fileHeader->magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+        fileHeader->version != cacheVersion || fileHeader->endianTag != cacheEndianTag ||
+        fileHeader->vectorSize != sizeof(Vector3) || fileHeader->fileSize != mapped->size) {
+        std::cerr << "Scene cache " << filename << " is from an incompatible build, rebuilding it." << std::endl;
+        return false;
+    }
+
+    // Every section must lie inside the file
+    auto sectionValid = [&](const CacheSection& section, size_t recordSize) {
+        return section.offset % sectionAlignment == 0 && section.offset <= mapped->size &&
+               section.count <= (mapped->size - section.offset) / recordSize;
+    };
+    if (!sectionValid(fileHeader->materials, sizeof(CacheMaterial)) ||
+        !sectionValid(fileHeader->textures, sizeof(CacheTexture)) ||
+        !sectionValid(fileHeader->primitives, sizeof(CachePrimitive)) ||
+        !sectionValid(fileHeader->nodes, sizeof(CacheNode)) ||
+        !sectionValid(fileHeader->texels, sizeof(Vector3)) ||
+        !sectionValid(fileHeader->strings, 1) ||
+        !sectionValid(fileHeader->settings, 1) ||
+        !sectionValid(fileHeader->source, 1)) {
+        std::cerr << "Error: Scene cache " << filename << " is corrupt" << std::endl;
+        return false;
+    }
+
+    const CacheMaterial* materials = reinterpret_cast<const CacheMaterial*>(mapped->data + fileHeader->materials.offset);
+    const CacheTexture* textures = reinterpret_cast<const CacheTexture*>(mapped->data + fileHeader->textures.offset);
+    const CachePrimitive* primitives = reinterpret_cast<const CachePrimitive*>(mapped->data + fileHeader->primitives.offset);
+    const CacheNode* nodes = reinterpret_cast<const CacheNode*>(mapped->data + fileHeader->nodes.offset);
+
+    bool valid = true;
+    for (uint64_t i = 0; i < fileHeader->materials.count; ++i) {
+        valid = valid && materials[i].texture >= -1 && materials[i].texture < static_cast<int64_t>(fileHeader->textures.count);
+    }
+    for (uint64_t i = 0; i < fileHeader->textures.count; ++i) {
+        const CacheTexture& texture = textures[i];
+        uint64_t texelCount = static_cast<uint64_t>(texture.width) * texture.height;
+        valid = valid && texture.width > 0 && texture.height > 0 &&
+                texture.firstTexel <= fileHeader->texels.count && texelCount <= fileHeader->texels.count - texture.firstTexel &&
+                texture.pathOffset <= fileHeader->strings.count && texture.pathLength <= fileHeader->strings.count - texture.pathOffset;
+    }
+    for (uint64_t i = 0; i < fileHeader->primitives.count; ++i) {
+        valid = valid && primitives[i].type <= PRIMITIVE_QUAD && primitives[i].material >= 0 &&
+                primitives[i].material < static_cast<int64_t>(fileHeader->materials.count);
+    }
+    // Children must come after their parent, which also rules out cycles
+    auto childValid = [&](int32_t child, uint8_t isNode, uint64_t parent) {
+        if (child < 0)
+            return true;
+        if (isNode)
+            return static_cast<uint64_t>(child) > parent && static_cast<uint64_t>(child) < fileHeader->nodes.count;
+        return static_cast<uint64_t>(child) < fileHeader->primitives.count;
+    };
+    for (uint64_t i = 0; i < fileHeader->nodes.count; ++i) {
+        valid = valid && childValid(nodes[i].left, nodes[i].leftIsNode, i) && childValid(nodes[i].right, nodes[i].rightIsNode, i);
+    }
+    if (!valid) {
+        std::cerr << "Error: Scene cache " << filename << " is corrupt" << std::endl;
+        return false;
+    }
+
+    // Cached texels are stale once a texture file changes
+    for (uint64_t i = 0; i < fileHeader->textures.count; ++i) {
+        std::string path(mapped->data + fileHeader->strings.offset + textures[i].pathOffset, textures[i].pathLength);
+        if (fileTime(path) != textures[i].modifiedTime) {
+            std::cout << "Texture " << path << " changed, rebuilding scene cache." << std::endl;
+            return false;
+        }
+    }
+
+    file = mapped;
+    header = fileHeader;
+    return true;
+}
+
+bool SceneCache::isBuiltFrom(const std::string& sourceFilename) const {
+    if (!header)
+        return false;
+    std::string source(file->data + header->source.offset, header->source.count);
+    return source == canonicalPath(sourceFilename);
+}
+
+bool SceneCache::matchesSource(const std::string& sourceFilename) const {
+    return isBuiltFrom(sourceFilename) && header->sourceSize == fileSize(sourceFilename) &&
+           header->sourceTime == fileTime(sourceFilename);
+}
+
+uint64_t SceneCache::getShapesHash() const {
+    return header ? header->shapesHash : 0;
+}
+
+json SceneCache::getSettings() const {
+    if (!header)
+        return json();
+    const uint8_t* begin = reinterpret_cast<const uint8_t*>(file->data + header->settings.offset);
+    return json::from_cbor(begin, begin + header->settings.count, true, false);
+}
+
+void SceneCache::populate(Scene& scene) const {
+    if (!header)
+        return;
+
+    const CacheMaterial* materials = reinterpret_cast<const CacheMaterial*>(file->data + header->materials.offset);
+    const CacheTexture* textures = reinterpret_cast<const CacheTexture*>(file->data + header->textures.offset);
+    const CachePrimitive* primitives = reinterpret_cast<const CachePrimitive*>(file->data + header->primitives.offset);
+    const CacheNode* nodes = reinterpret_cast<const CacheNode*>(file->data + header->nodes.offset);
+    const Vector3* texels = reinterpret_cast<const Vector3*>(file->data + header->texels.offset);
+
+    std::vector<Material> materialTable;
+    materialTable.reserve(header->materials.count);
+    for (uint64_t i = 0; i < header->materials.count; ++i) {
+        const CacheMaterial& record = materials[i];
+        Material material(record.ks, record.kd, record.specularExponent, record.isReflective, record.reflectivity,
+                          record.isRefractive, record.refractiveIndex, loadVector(record.diffuseColor),
+                          loadVector(record.specularColor));
+        if (record.texture >= 0) {
+            // Texels are used straight from the mapping, which they keep alive
+            const CacheTexture& texture = textures[record.texture];
+            material.hasTexture = true;
+            material.texturePath.assign(file->data + header->strings.offset + texture.pathOffset, texture.pathLength);
+            material.textureWidth = texture.width;
+            material.textureHeight = texture.height;
+            material.textureData = std::shared_ptr<const Vector3>(file, texels + texture.firstTexel);
+        }
+        materialTable.push_back(material);
+    }
+
+    std::vector<std::shared_ptr<Intersectable>> objects;
+    objects.reserve(header->primitives.count);
+    for (uint64_t i = 0; i < header->primitives.count; ++i) {
+        const CachePrimitive& record = primitives[i];
+        const Material& material = materialTable[record.material];
+        const double* data = record.data;
+        if (record.type == PRIMITIVE_SPHERE) {
+            objects.push_back(std::make_shared<Sphere>(loadVector(data), data[3], material));
+        } else if (record.type == PRIMITIVE_TRIANGLE) {
+            objects.push_back(std::make_shared<Triangle>(loadVector(data), loadVector(data + 3), loadVector(data + 6), material));
+        } else if (record.type == PRIMITIVE_CYLINDER) {
+            auto cylinder = std::make_shared<Cylinder>(loadVector(data), loadVector(data + 3), data[6], data[7], material, data[8] != 0.0);
+            cylinder->axis = loadVector(data + 3); // Already normalised when cached
+            objects.push_back(cylinder);
+        } else if (record.type == PRIMITIVE_PLANE) {
+            objects.push_back(std::make_shared<Plane>(loadVector(data), loadVector(data + 3), material, data[6]));
+        } else {
+            Vector3 edgeU = loadVector(data + 3);
+            Vector3 edgeV = loadVector(data + 6);
+            Vector3 facing = edgeU.cross(edgeV) * (data[10] != 0.0 ? -1.0 : 1.0);
+            objects.push_back(std::make_shared<Quad>(loadVector(data), edgeU, edgeV, material, data[9], facing));
+        }
+        scene.addObject(objects.back());
+    }
+
+    if (header->nodes.count == 0)
+        return;
+
+    std::vector<std::shared_ptr<BVHNode>> bvhNodes(header->nodes.count);
+    for (auto& node : bvhNodes) {
+        node = std::make_shared<BVHNode>();
+    }
+    auto child = [&](int32_t index, uint8_t isNode) -> std::shared_ptr<Intersectable> {
+        if (index < 0)
+            return nullptr;
+        if (isNode)
+            return bvhNodes[index];
+        return objects[index];
+    };
+    for (uint64_t i = 0; i < header->nodes.count; ++i) {
+        const CacheNode& record = nodes[i];
+        BVHNode& node = *bvhNodes[i];
+        node.boundingBox = BoundingBox(loadVector(record.min), loadVector(record.max));
+        node.isLeaf = record.isLeaf;
+        if (record.isObjectLeaf) {
+            node.object = child(record.left, record.leftIsNode);
+        } else {
+            node.left = child(record.left, record.leftIsNode);
+            node.right = child(record.right, record.rightIsNode);
+        }
+    }
+    scene.bvhRoot = bvhNodes[0];
+}
+
+bool SceneCache::write(const std::string& filename, const Scene& scene, const json& settings, uint64_t shapesHash,
+                       const std::string& sourceFilename) {
+    CacheWriter writer;
+    for (const auto& object : scene.objects) {
+        if (!writer.addPrimitive(object))
+            return false;
+    }
+    for (const auto& object : scene.unboundedObjects) {
+        if (!writer.addPrimitive(object))
+            return false;
+    }
+    if (scene.bvhRoot && writer.addNode(*scene.bvhRoot) < 0)
+        return false;
+    std::vector<uint8_t> settingsCbor = json::to_cbor(settings);
+    std::string source = canonicalPath(sourceFilename);
+
+    CacheHeader fileHeader;
+    std::memset(&fileHeader, 0, sizeof(fileHeader));
+    std::memcpy(fileHeader.magic, cacheMagic, sizeof(cacheMagic));
+    fileHeader.version = cacheVersion;
+    fileHeader.endianTag = cacheEndianTag;
+    fileHeader.vectorSize = sizeof(Vector3);
+    fileHeader.shapesHash = shapesHash;
+    fileHeader.sourceSize = fileSize(sourceFilename);
+    fileHeader.sourceTime = fileTime(sourceFilename);
+
+    uint64_t offset = alignOffset(sizeof(CacheHeader));
+    auto placeSection = [&](CacheSection& section, uint64_t count, size_t recordSize) {
+        section.offset = offset;
+        section.count = count;
+        offset = alignOffset(offset + count * recordSize);
+    };
+    placeSection(fileHeader.materials, writer.materials.size(), sizeof(CacheMaterial));
+    placeSection(fileHeader.textures, writer.textures.size(), sizeof(CacheTexture));
+    placeSection(fileHeader.primitives, writer.primitives.size(), sizeof(CachePrimitive));
+    placeSection(fileHeader.nodes, writer.nodes.size(), sizeof(CacheNode));
+    placeSection(fileHeader.texels, writer.texelCount, sizeof(Vector3));
+    placeSection(fileHeader.strings, writer.strings.size(), 1);
+    placeSection(fileHeader.settings, settingsCbor.size(), 1);
+    placeSection(fileHeader.source, source.size(), 1);
+    fileHeader.fileSize = offset;
+
+    std::vector<char> buffer(offset, 0);
+    std::memcpy(buffer.data(), &fileHeader, sizeof(fileHeader));
+    auto copySection = [&](const CacheSection& section, const void* data, size_t bytes) {
+        if (bytes > 0)
+            std::memcpy(buffer.data() + section.offset, data, bytes);
+    };
+    copySection(fileHeader.materials, writer.materials.data(), writer.materials.size() * sizeof(CacheMaterial));
+    copySection(fileHeader.textures, writer.textures.data(), writer.textures.size() * sizeof(CacheTexture));
+    copySection(fileHeader.primitives, writer.primitives.data(), writer.primitives.size() * sizeof(CachePrimitive));
+    copySection(fileHeader.nodes, writer.nodes.data(), writer.nodes.size() * sizeof(CacheNode));
+    for (size_t i = 0; i < writer.textures.size(); ++i) {
+        const CacheTexture& texture = writer.textures[i];
+        std::memcpy(buffer.data() + fileHeader.texels.offset + texture.firstTexel * sizeof(Vector3),
+                    writer.textureTexels[i], static_cast<size_t>(texture.width) * texture.height * sizeof(Vector3));
+    }
+    copySection(fileHeader.strings, writer.strings.data(), writer.strings.size());
+    copySection(fileHeader.settings, settingsCbor.data(), settingsCbor.size());
+    copySection(fileHeader.source, source.data(), source.size());
+
+    // Write next to the target and rename, so a reader never maps a partial file
+    return BinaryFile::replace(filename, "scene cache file", [&](std::ostream& outFile) {
+        BinaryFile::writeArray(outFile, buffer);
+    });
+}
@@ -0,0 +1,848 @@
+// SceneLoader.cpp
+#include "SceneLoader.h"
+#include "Sphere.h"
+#include "Triangle.h"
+#include "Cylinder.h"
+#include "Plane.h"
+#include "Quad.h"
+#include "Light.h"
+#include "AreaLight.h"
+#include "PointLight.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+/*
+* Builds a JSON DOM from SAX events, the same way nlohmann's own DOM parser does.
+*/
+struct DomBuilder {
+    json* root = nullptr;
+    std::vector<json*> stack;
+    json* objectElement = nullptr;
+
+    void reset(json* newRoot) {
+        root = newRoot;
+        stack.clear();
+        objectElement = nullptr;
+    }
+
+    json* addValue(json&& value) {
+        if (stack.empty()) {
+            *root = std::move(value);
+            return root;
+        }
+        if (stack.back()->is_array()) {
+            stack.back()->push_back(std::move(value));
+            return &stack.back()->back();
+        }
+        *objectElement = std::move(value);
+        return objectElement;
+    }
+
+    void startContainer(json&& container) {
+        stack.push_back(addValue(std::move(container)));
+    }
+
+    void key(const std::string& name) {
+        objectElement = &(*stack.back())[name];
+    }
+
+    void endContainer() {
+        stack.pop_back();
+    }
+};
+
+/*
+* One key of a scene.shapes element, or of its material, with its value: up to
+* three numbers (a scalar counts as one), a boolean or a string. Any other
+* value, such as a nested object, is recorded as OTHER.
+*/
+struct ShapeField {
+    enum Kind : uint8_t { OTHER, NUMBERS, BOOLEAN, STRING };
+
+    std::string key;
+    bool inMaterial = false;
+    Kind kind = OTHER;
+    int count = 0;              // Numbers in the value; only the first three are kept
+    double numbers[3] = {0, 0, 0};
+    bool boolean = false;
+    std::string text;
+};
+
+/*
+* The fields of one shape, a range of its chunk's field list. A shape has a
+* dozen keys or so, so lookups scan them.
+*/
+class ShapeRecord {
+public:
+    ShapeRecord(const ShapeField* first, const ShapeField* last) : first(first), last(last) {}
+
+    const ShapeField* find(const char* key, bool inMaterial = false) const {
+        for (const ShapeField* field = first; field != last; ++field) {
+            if (field->inMaterial == inMaterial && field->key == key)
+                return field;
+        }
+        return nullptr;
+    }
+
+    bool getNumber(const char* key, double& value, bool inMaterial = false) const {
+        const ShapeField* field = find(key, inMaterial);
+        if (!field || field->kind != ShapeField::NUMBERS || field->count != 1)
+            return false;
+        value = field->numbers[0];
+        return true;
+    }
+
+    bool getVector(const char* key, Vector3& value, bool inMaterial = false) const {
+        const ShapeField* field = find(key, inMaterial);
+        if (!field || field->kind != ShapeField::NUMBERS || field->count != 3)
+            return false;
+        value = Vector3(field->numbers[0], field->numbers[1], field->numbers[2]);
+        return true;
+    }
+
+    double number(const char* key, double fallback, bool inMaterial = false) const {
+        getNumber(key, fallback, inMaterial);
+        return fallback;
+    }
+
+    Vector3 vector(const char* key, const Vector3& fallback, bool inMaterial = false) const {
+        Vector3 value = fallback;
+        getVector(key, value, inMaterial);
+        return value;
+    }
+
+    bool flag(const char* key, bool fallback, bool inMaterial = false) const {
+        const ShapeField* field = find(key, inMaterial);
+        if (field && field->kind == ShapeField::BOOLEAN)
+            return field->boolean;
+        if (field && field->kind == ShapeField::NUMBERS && field->count == 1)
+            return field->numbers[0] != 0;
+        return fallback;
+    }
+
+    const std::string* text(const char* key, bool inMaterial = false) const {
+        const ShapeField* field = find(key, inMaterial);
+        return field && field->kind == ShapeField::STRING ? &field->text : nullptr;
+    }
+
+private:
+    const ShapeField* first;
+    const ShapeField* last;
+};
+
+/*
+* Function to build a material from the fields of a shape's material object.
+*/
+Material parseMaterial(const ShapeRecord& shape) {
+    double ks = shape.number("ks", 0.0, true);
+    double kd = shape.number("kd", 0.0, true);
+    int specularExponent = static_cast<int>(shape.number("specularexponent", 1, true));
+
+    Vector3 diffuseColor = shape.vector("diffusecolor", Vector3(0, 0, 0), true);
+    Vector3 specularColor = shape.vector("specularcolor", Vector3(0, 0, 0), true);
+
+    bool isReflective = shape.flag("isreflective", false, true);
+    double reflectivity = shape.number("reflectivity", 0.0, true);
+
+    bool isRefractive = shape.flag("isrefractive", false, true);
+    double refractiveIndex = shape.number("refractiveindex", 1.0, true);
+
+    // Check for texture
+    const std::string* texturePath = shape.text("texturepath", true);
+    bool hasTexture = texturePath != nullptr;
+
+    return Material(ks, kd, specularExponent, isReflective, reflectivity, isRefractive,
+                    refractiveIndex, diffuseColor, specularColor, hasTexture, hasTexture ? *texturePath : "");
+}
+
+/*
+* Function to build the primitive a shape's fields describe; null (after
+* printing an error) when its type is unknown or a field it needs is missing.
+*/
+std::shared_ptr<Intersectable> parseShape(const ShapeRecord& shape) {
+    const std::string* typeText = shape.text("type");
+    std::string shapeType = typeText ? *typeText : "";
+
+    // Parse material
+    Material material;
+    if (shape.find("material")) {
+        material = parseMaterial(shape);
+    }
+
+    // Required fields; the first one missing is reported
+    const char* missing = nullptr;
+    auto vector = [&](const char* key) {
+        Vector3 value(0, 0, 0);
+        if (!shape.getVector(key, value) && !missing)
+            missing = key;
+        return value;
+    };
+    auto number = [&](const char* key) {
+        double value = 0.0;
+        if (!shape.getNumber(key, value) && !missing)
+            missing = key;
+        return value;
+    };
+    auto complete = [&]() {
+        if (missing)
+            std::cerr << "Error: " << shapeType << " shape is missing '" << missing << "'" << std::endl;
+        return !missing;
+    };
+
+    if (shapeType == "sphere") {
+        Vector3 center = vector("center");
+        double radius = number("radius");
+        if (!complete())
+            return nullptr;
+        return std::make_shared<Sphere>(center, radius, material);
+    } else if (shapeType == "triangle") {
+        Vector3 v0 = vector("v0");
+        Vector3 v1 = vector("v1");
+        Vector3 v2 = vector("v2");
+        if (!complete())
+            return nullptr;
+        return std::make_shared<Triangle>(v0, v1, v2, material);
+    } else if (shapeType == "cylinder") {
+        Vector3 baseCenter = vector("center");
+        Vector3 axis = vector("axis");
+        double radius = number("radius");
+        double height = number("height");
+        if (!complete())
+            return nullptr;
+        height *= 2.0;
+        baseCenter = baseCenter - axis * height / 2.0;
+        axis = axis.normalize();
+
+        return std::make_shared<Cylinder>(baseCenter, axis, radius, height, material);
+    } else if (shapeType == "plane") {
+        Vector3 point = vector("point");
+        Vector3 normal = vector("normal");
+        if (!complete())
+            return nullptr;
+        double tileSize = shape.number("tilesize", 1.0);
+        if (tileSize <= 0) {
+            std::cerr << "Error: Plane tilesize must be positive, using 1" << std::endl;
+            tileSize = 1.0;
+        }
+        return std::make_shared<Plane>(point, normal, material, tileSize);
+    } else if (shapeType == "quad") {
+        // Same description as an area light: centre, edge directions and size
+        Vector3 position = vector("position");
+        Vector3 uVec = vector("u");
+        Vector3 vVec = vector("v");
+        double width = number("width");
+        double height = number("height");
+        if (!complete())
+            return nullptr;
+        Vector3 facing = shape.vector("normal", Vector3(0, 0, 0));
+        Vector3 edgeU = uVec.normalize() * width;
+        Vector3 edgeV = vVec.normalize() * height;
+        Vector3 corner = position - edgeU * 0.5 - edgeV * 0.5;
+        return std::make_shared<Quad>(corner, edgeU, edgeV, material, shape.number("tilesize", 0.0), facing);
+    }
+
+    std::cerr << "Error: Unsupported shape type '" << shapeType << "'" << std::endl;
+    return nullptr;
+}
+
+/*
+* A batch of shapes, as their fields one shape after another, and the
+* primitives constructed from them.
+*/
+struct ShapeChunk {
+    std::vector<ShapeField> fields;
+    std::vector<size_t> shapeEnds;  // End of each shape's fields
+    std::vector<std::shared_ptr<Intersectable>> objects;
+};
+
+void buildChunk(ShapeChunk* chunk) {
+    chunk->objects.resize(chunk->shapeEnds.size());
+    size_t begin = 0;
+    for (size_t i = 0; i < chunk->shapeEnds.size(); ++i) {
+        const ShapeField* fields = chunk->fields.data();
+        chunk->objects[i] = parseShape(ShapeRecord(fields + begin, fields + chunk->shapeEnds[i]));
+        begin = chunk->shapeEnds[i];
+    }
+    // The fields are no longer needed once the primitives exist
+    std::vector<ShapeField>().swap(chunk->fields);
+}
+
+/*
+* SAX handler that builds the settings DOM and records the fields of each
+* scene.shapes element straight from the events, handing every finished
+* shape to a callback.
+*/
+class SceneSaxHandler : public nlohmann::json_sax<json> {
+public:
+    SceneSaxHandler(json& settings, bool skipShapes, std::function<void(std::vector<ShapeField>&)> onShape)
+        : skipShapes(skipShapes), onShape(std::move(onShape)) {
+        settingsBuilder.reset(&settings);
+    }
+
+    bool null() override {
+        hash('n', nullptr, 0, scalarInMaterial());
+        if (shapesDepth > 0)
+            return shapeValue(ShapeField::OTHER, 0.0, false, nullptr);
+        return value(json(nullptr));
+    }
+    bool boolean(bool val) override {
+        hash('b', &val, sizeof(val), scalarInMaterial());
+        if (shapesDepth > 0)
+            return shapeValue(ShapeField::BOOLEAN, 0.0, val, nullptr);
+        return value(json(val));
+    }
+    bool number_integer(number_integer_t val) override {
+        hash('i', &val, sizeof(val), scalarInMaterial());
+        if (shapesDepth > 0)
+            return shapeValue(ShapeField::NUMBERS, static_cast<double>(val), false, nullptr);
+        return value(json(val));
+    }
+    bool number_unsigned(number_unsigned_t val) override {
+        hash('u', &val, sizeof(val), scalarInMaterial());
+        if (shapesDepth > 0)
+            return shapeValue(ShapeField::NUMBERS, static_cast<double>(val), false, nullptr);
+        return value(json(val));
+    }
+    bool number_float(number_float_t val, const string_t&) override {
+        hash('f', &val, sizeof(val), scalarInMaterial());
+        if (shapesDepth > 0)
+            return shapeValue(ShapeField::NUMBERS, val, false, nullptr);
+        return value(json(val));
+    }
+    bool string(string_t& val) override {
+        hash('s', val.data(), val.size(), scalarInMaterial());
+        if (shapesDepth > 0)
+            return shapeValue(ShapeField::STRING, 0.0, false, &val);
+        return value(json(std::move(val)));
+    }
+    bool binary(binary_t& val) override {
+        hash('x', val.data(), val.size(), scalarInMaterial());
+        if (shapesDepth > 0)
+            return shapeValue(ShapeField::OTHER, 0.0, false, nullptr);
+        return value(json(json::binary_t(std::move(val))));
+    }
+
+    // FNV-1a hash of the events inside scene.shapes, computed even when skipping them
+    uint64_t getShapesHash() const {
+        return shapesHash;
+    }
+
+    // The same hash with every shape's "material" left out
+    uint64_t getGeometryHash() const {
+        return geometryHash;
+    }
+
+    // Hash of each element of scene.shapes on its own, in file order
+    const std::vector<uint64_t>& getShapeHashes() const {
+        return shapeHashes;
+    }
+
+    bool start_object(std::size_t) override {
+        if (shapesDepth == 1)
+            shapeHash = 14695981039346656037ULL;
+        hash('{', nullptr, 0, openInMaterial());
+        if (shapesDepth > 0) {
+            if (!skipShapes && shapesDepth > 1) {
+                // Only a shape's "material" object is read; other objects are kept as OTHER
+                if (fieldPending && shapesDepth == 2 && shapeFields.back().key == "material")
+                    materialObjectDepth = shapesDepth + 1;
+                else if (arrayDepth == shapesDepth)
+                    shapeFields.back().kind = ShapeField::OTHER;
+                fieldPending = false;
+            }
+            ++shapesDepth;
+            return true;
+        }
+        settingsBuilder.startContainer(json::object());
+        keyPath.push_back(currentKey);
+        return true;
+    }
+
+    bool key(string_t& val) override {
+        bool inMaterial = materialDepth > 0;
+        if (!inMaterial && shapesDepth == 2 && val == "material") {
+            inMaterial = true;
+            materialPending = true;
+        }
+        hash(':', val.data(), val.size(), inMaterial);
+        if (shapesDepth > 0) {
+            // Keys of the shape and of its material become fields; deeper keys are ignored
+            if (!skipShapes && (shapesDepth == 2 || shapesDepth == materialObjectDepth)) {
+                shapeFields.emplace_back();
+                shapeFields.back().key = val;
+                shapeFields.back().inMaterial = shapesDepth != 2;
+                fieldPending = true;
+            }
+            return true;
+        }
+        currentKey = val;
+        settingsBuilder.key(val);
+        return true;
+    }
+
+    bool end_object() override {
+        hash('}', nullptr, 0, closeInMaterial());
+        if (shapesDepth > 0) {
+            if (shapesDepth == materialObjectDepth)
+                materialObjectDepth = 0;
+            --shapesDepth;
+            if (shapesDepth == 1) {
+                shapeHashes.push_back(shapeHash);
+                if (!skipShapes) {
+                    onShape(shapeFields);
+                    shapeFields.clear();
+                }
+            }
+            return true;
+        }
+        settingsBuilder.endContainer();
+        keyPath.pop_back();
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        hash('[', nullptr, 0, openInMaterial());
+        if (shapesDepth > 0) {
+            if (shapesDepth == 1) {
+                std::cerr << "Error: Shape entries must be objects" << std::endl;
+                return false;
+            }
+            // An array straight after a key holds its numbers; nested arrays make it OTHER
+            if (!skipShapes) {
+                if (fieldPending) {
+                    shapeFields.back().kind = ShapeField::NUMBERS;
+                    arrayDepth = shapesDepth + 1;
+                } else if (arrayDepth == shapesDepth) {
+                    shapeFields.back().kind = ShapeField::OTHER;
+                }
+                fieldPending = false;
+            }
+            ++shapesDepth;
+            return true;
+        }
+
+        // scene.shapes is kept as an empty array in the settings DOM
+        settingsBuilder.startContainer(json::array());
+        keyPath.push_back(currentKey);
+        if (keyPath.size() == 3 && keyPath[1] == "scene" && keyPath[2] == "shapes")
+            shapesDepth = 1;
+        return true;
+    }
+
+    bool end_array() override {
+        hash(']', nullptr, 0, closeInMaterial());
+        if (shapesDepth > 1) {
+            if (shapesDepth == arrayDepth)
+                arrayDepth = 0;
+            --shapesDepth;
+            return true;
+        }
+        shapesDepth = 0;
+        settingsBuilder.endContainer();
+        keyPath.pop_back();
+        return true;
+    }
+
+    bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& ex) override {
+        std::cerr << "Error: Could not parse scene JSON at byte " << position << ": " << ex.what() << std::endl;
+        return false;
+    }
+
+private:
+    void hash(char tag, const void* data, size_t size, bool inMaterial) {
+        if (shapesDepth == 0)
+            return;
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        shapesHash = (shapesHash ^ static_cast<unsigned char>(tag)) * 1099511628211ULL;
+        for (size_t i = 0; i < size; ++i) {
+            shapesHash = (shapesHash ^ bytes[i]) * 1099511628211ULL;
+        }
+        shapeHash = (shapeHash ^ static_cast<unsigned char>(tag)) * 1099511628211ULL;
+        for (size_t i = 0; i < size; ++i) {
+            shapeHash = (shapeHash ^ bytes[i]) * 1099511628211ULL;
+        }
+        if (inMaterial)
+            return;
+        geometryHash = (geometryHash ^ static_cast<unsigned char>(tag)) * 1099511628211ULL;
+        for (size_t i = 0; i < size; ++i) {
+            geometryHash = (geometryHash ^ bytes[i]) * 1099511628211ULL;
+        }
+    }
+
+    // Track the value of a shape's "material" key, which the geometry hash skips
+    bool scalarInMaterial() {
+        bool inMaterial = materialPending || materialDepth > 0;
+        materialPending = false;
+        return inMaterial;
+    }
+
+    bool openInMaterial() {
+        if (materialPending) {
+            materialPending = false;
+            materialDepth = 1;
+            return true;
+        }
+        if (materialDepth > 0)
+            ++materialDepth;
+        return materialDepth > 0;
+    }
+
+    bool closeInMaterial() {
+        if (materialDepth == 0)
+            return false;
+        --materialDepth;
+        return true;
+    }
+
+    bool value(json&& val) {
+        settingsBuilder.addValue(std::move(val));
+        return true;
+    }
+
+    // A scalar inside scene.shapes: the value of the last field, one of the
+    // numbers of its array, or part of a value no field reads
+    bool shapeValue(ShapeField::Kind kind, double number, bool boolean, string_t* text) {
+        if (shapesDepth == 1) {
+            std::cerr << "Error: Shape entries must be objects" << std::endl;
+            return false;
+        }
+        if (skipShapes)
+            return true;
+        if (fieldPending) {
+            ShapeField& field = shapeFields.back();
+            field.kind = kind;
+            field.count = kind == ShapeField::NUMBERS ? 1 : 0;
+            field.numbers[0] = number;
+            field.boolean = boolean;
+            if (text)
+                field.text = std::move(*text);
+            fieldPending = false;
+        } else if (arrayDepth == shapesDepth) {
+            ShapeField& field = shapeFields.back();
+            if (kind != ShapeField::NUMBERS) {
+                field.kind = ShapeField::OTHER;
+            } else {
+                if (field.count < 3)
+                    field.numbers[field.count] = number;
+                ++field.count;
+            }
+        }
+        return true;
+    }
+
+    DomBuilder settingsBuilder;
+    std::vector<std::string> keyPath;
+    std::string currentKey;
+    int shapesDepth = 0; // 1 inside scene.shapes, deeper inside a shape
+    uint64_t shapesHash = 14695981039346656037ULL;
+    uint64_t geometryHash = 14695981039346656037ULL;
+    uint64_t shapeHash = 14695981039346656037ULL; // Of the shape being read
+    std::vector<uint64_t> shapeHashes;
+    bool materialPending = false; // The next value belongs to a shape's "material" key
+    int materialDepth = 0;        // Containers open inside a shape's material
+    std::vector<ShapeField> shapeFields; // Of the shape being read
+    bool fieldPending = false;    // The last field's key waits for its value
+    int arrayDepth = 0;           // shapesDepth inside the array holding the last field's numbers
+    int materialObjectDepth = 0;  // shapesDepth inside the shape's material object
+    bool skipShapes;
+    std::function<void(std::vector<ShapeField>&)> onShape;
+};
+
+}
+
+SceneLoader::SceneLoader() : skipShapes(false), chunkSize(256), shapesHash(0), geometryHash(0) {}
+
+void SceneLoader::setSkipShapes(bool skip) {
+    skipShapes = skip;
+}
+
+void SceneLoader::setChunkSize(size_t size) {
+    chunkSize = std::max<size_t>(1, size);
+}
+
+const json& SceneLoader::getSettings() const {
+    return settings;
+}
+
+const std::vector<std::shared_ptr<Intersectable>>& SceneLoader::getObjects() const {
+    return objects;
+}
+
+uint64_t SceneLoader::getShapesHash() const {
+    return shapesHash;
+}
+
+uint64_t SceneLoader::getGeometryHash() const {
+    return geometryHash;
+}
+
+const std::vector<uint64_t>& SceneLoader::getShapeHashes() const {
+    return shapeHashes;
+}
+
+bool SceneLoader::load(const std::string& filename) {
+    PhaseTimer readTimer("read");
+    std::ifstream jsonFile(filename, std::ios::binary);
+    if (!jsonFile.is_open()) {
+        std::cerr << "Error: Could not open JSON file " << filename << std::endl;
+        return false;
+    }
+    std::stringstream contents;
+    contents << jsonFile.rdbuf();
+    std::string text = contents.str();
+    readTimer.stop();
+
+    // Texture decoding happens while building materials and is reported as its own phase
+    auto parseStart = std::chrono::high_resolution_clock::now();
+    double texturesBefore = RenderStats::getPhase("textures");
+
+    std::vector<std::unique_ptr<ShapeChunk>> chunks;
+    std::vector<uint64_t> rawShapeHashes;
+    bool parsed = false;
+
+    // The master thread parses while the rest of the team builds finished chunks
+    #pragma omp parallel
+    {
+        #pragma omp single
+        {
+            chunks.push_back(std::make_unique<ShapeChunk>());
+            auto onShape = [&](std::vector<ShapeField>& fields) {
+                ShapeChunk& chunk = *chunks.back();
+                chunk.fields.insert(chunk.fields.end(), std::make_move_iterator(fields.begin()), std::make_move_iterator(fields.end()));
+                chunk.shapeEnds.push_back(chunk.fields.size());
+                if (chunk.shapeEnds.size() >= chunkSize) {
+                    ShapeChunk* chunk = chunks.back().get();
+                    #pragma omp task firstprivate(chunk)
+                    buildChunk(chunk);
+                    chunks.push_back(std::make_unique<ShapeChunk>());
+                }
+            };
+
+            SceneSaxHandler handler(settings, skipShapes, onShape);
+            parsed = json::sax_parse(text, &handler);
+            shapesHash = handler.getShapesHash();
+            geometryHash = handler.getGeometryHash();
+            rawShapeHashes = handler.getShapeHashes();
+
+            ShapeChunk* lastChunk = chunks.back().get();
+            #pragma omp task firstprivate(lastChunk)
+            buildChunk(lastChunk);
+
+            #pragma omp taskwait
+        }
+    }
+
+    if (!parsed)
+        return false;
+
+    // Shapes that failed to construct are dropped along with their hashes
+    objects.clear();
+    shapeHashes.clear();
+    size_t shapeIndex = 0;
+    for (const auto& chunk : chunks) {
+        for (const auto& object : chunk->objects) {
+            if (object) {
+                objects.push_back(object);
+                shapeHashes.push_back(rawShapeHashes[shapeIndex]);
+            }
+            ++shapeIndex;
+        }
+    }
+
+    double parseMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - parseStart).count();
+    double texturesMs = RenderStats::getPhase("textures") - texturesBefore;
+    RenderStats::addPhase("parse", std::max(0.0, parseMs - texturesMs));
+    return true;
+}
+
+/*
+* Function to parse the scene settings from the JSON file.
+*/
+Scene parseSceneSettings(const json& sceneJson, int& maxDepth, std::string& renderMode, Vector3& backgroundColor) {
+    // Parse nbounces (max recursion depth)
+    maxDepth = sceneJson.value("nbounces", 5);
+
+    // Parse rendermode (if needed)
+    renderMode = sceneJson.value("rendermode", "phong");
+
+    // Parse background color
+    backgroundColor = Vector3(
+        sceneJson["scene"]["backgroundcolor"][0],
+        sceneJson["scene"]["backgroundcolor"][1],
+        sceneJson["scene"]["backgroundcolor"][2]
+    );
+
+    Scene scene(backgroundColor);
+    scene.bvhWidth = sceneJson.value("bvhwidth", scene.bvhWidth);
+    scene.bvhQuantization = sceneJson.value("bvhquantization", scene.bvhQuantization);
+    scene.bvhSpatialSplits = sceneJson.value("bvhspatialsplits", scene.bvhSpatialSplits);
+    scene.bvhSplitBudget = sceneJson.value("bvhsplitbudget", scene.bvhSplitBudget);
+    return scene;
+}
+
+/*
+* Function to apply the render settings from the JSON file to a ray tracer.
+*/
+RayTracer::RenderMode configureRayTracer(RayTracer& rayTracer, const json& sceneJson, const std::string& renderMode, int maxDepth, double exposure) {
+    RayTracer::RenderMode renderModeEnum;
+    if (renderMode == "phong")
+        renderModeEnum = RayTracer::PHONG;
+    else if (renderMode == "binary")
+        renderModeEnum = RayTracer::BINARY;
+    else if (renderMode == "pathtrace")
+        renderModeEnum = RayTracer::PATH_TRACE;
+    else{
+        std::cerr << "Error: Unsupported rendermode '" << renderMode << "'. Defaulting to 'phong'." << std::endl;
+        renderModeEnum = RayTracer::PHONG;
+    }
+
+    rayTracer.setRenderMode(renderModeEnum);
+    rayTracer.setExposure(exposure);
+    rayTracer.setMaxDepth(maxDepth);
+    rayTracer.setRaySorting(sceneJson.value("raysorting", false));
+    rayTracer.setOccluderCache(sceneJson.value("occludercache", true));
+    rayTracer.setDeferredShading(sceneJson.value("deferred", false));
+    rayTracer.setTileSize(sceneJson.value("tilesize", 16));
+    rayTracer.setDenoise(sceneJson.value("denoise", false) ? sceneJson.value("denoiseiterations", 5) : 0);
+
+    // Optional crop window [x, y, width, height] in pixels, origin top left
+    if (sceneJson.contains("crop")) {
+        const json& crop = sceneJson["crop"];
+        if (!crop.is_array() || crop.size() != 4 || !std::all_of(crop.begin(), crop.end(), [](const json& value) { return value.is_number_integer(); }))
+            throw std::invalid_argument("\"crop\" must be [x, y, width, height]");
+        if (!rayTracer.isValidRegion(crop[0], crop[1], crop[2], crop[3]))
+            throw std::invalid_argument("\"crop\" " + crop.dump() + " must have a positive size and overlap the " +
+                                        std::to_string(rayTracer.getImageWidth()) + "x" +
+                                        std::to_string(rayTracer.getImageHeight()) + " frame");
+        rayTracer.setRegion(crop[0], crop[1], crop[2], crop[3]);
+    }
+    std::string cropOutput = sceneJson.value("cropoutput", "cropped");
+    if (cropOutput != "cropped" && cropOutput != "full")
+        std::cerr << "Error: Unsupported cropoutput '" << cropOutput << "'. Defaulting to 'cropped'." << std::endl;
+    rayTracer.setCropOutput(cropOutput != "full");
+
+    if (renderModeEnum == RayTracer::PATH_TRACE) {
+        int nspp = sceneJson.value("pixelsample", 16);
+
+        int nspal = sceneJson.value("lightsample", 4);
+
+        rayTracer.setLightSample(nspp);
+        rayTracer.setPixelSample(nspal);
+    }
+    return renderModeEnum;
+}
+
+/*
+* Function to parse a tone mapping operator name.
+*/
+RayTracer::ToneMapping parseToneMapping(const std::string& name) {
+    if (name == "reinhard")
+        return RayTracer::REINHARD;
+    if (name == "ward")
+        return RayTracer::WARD;
+    if (name == "uncharted2")
+        return RayTracer::UNCHARTED2;
+    if (name != "none")
+        std::cerr << "Error: Unsupported tonemapping '" << name << "'. Defaulting to 'none'." << std::endl;
+    return RayTracer::NONE;
+}
+
+/*
+* Function to parse the camera settings from the JSON file.
+*/
+Camera parseCamera(const json& cameraJson, int& imageWidth, int& imageHeight, double& exposure) {
+    imageWidth = cameraJson["width"];
+    imageHeight = cameraJson["height"];
+    double aspectRatio = static_cast<double>(imageWidth) / imageHeight;
+
+    Vector3 cameraPosition(
+        cameraJson["position"][0],
+        cameraJson["position"][1],
+        cameraJson["position"][2]
+    );
+
+    Vector3 cameraLookAt(
+        cameraJson["lookAt"][0],
+        cameraJson["lookAt"][1],
+        cameraJson["lookAt"][2]
+    );
+
+    Vector3 cameraUp(
+        cameraJson["upVector"][0],
+        cameraJson["upVector"][1],
+        cameraJson["upVector"][2]
+    );
+
+    double fov = cameraJson["fov"];
+    exposure = cameraJson.value("exposure", 1.0);
+
+    // Read aperture and focus distance
+    double aperture = cameraJson.value("aperture", 0.0);
+    double focusDist = cameraJson.value("focusDistance", (cameraLookAt - cameraPosition).length());
+
+    return Camera(cameraPosition, cameraLookAt, cameraUp, fov, aspectRatio, aperture, focusDist);
+}
+
+
+/*
+* Function to parse the light sources from the JSON file.
+*/
+void parseLights(const json& lightsJson, Scene& scene) {
+    for (const auto& lightJson : lightsJson) {
+        std::string lightType = lightJson["type"];
+        if (lightType == "pointlight") {
+            Vector3 position(
+                lightJson["position"][0],
+                lightJson["position"][1],
+                lightJson["position"][2]
+            );
+            Vector3 intensity(
+                lightJson["intensity"][0],
+                lightJson["intensity"][1],
+                lightJson["intensity"][2]
+            );
+            auto light = std::make_shared<PointLight>(position, intensity);
+            scene.addLight(light);
+        } else if (lightType == "arealight") {
+            Vector3 position(
+                lightJson["position"][0],
+                lightJson["position"][1],
+                lightJson["position"][2]
+            );
+            Vector3 normal(
+                lightJson["normal"][0],
+                lightJson["normal"][1],
+                lightJson["normal"][2]
+            );
+            Vector3 uVec(
+                lightJson["u"][0],
+                lightJson["u"][1],
+                lightJson["u"][2]
+            );
+            Vector3 vVec(
+                lightJson["v"][0],
+                lightJson["v"][1],
+                lightJson["v"][2]
+            );
+
+            double width = lightJson["width"];
+            double height = lightJson["height"];
+            Vector3 intensity(
+                lightJson["intensity"][0],
+                lightJson["intensity"][1],
+                lightJson["intensity"][2]
+            );
+            auto light = std::make_shared<AreaLight>(position, normal, uVec, vVec, width, height, intensity);
+            scene.addLight(light);
+        } else {
+            std::cerr << "Error: Unsupported light type '" << lightType << "'" << std::endl;
+        }
+    }
+}
@@ -0,0 +1,277 @@
+// Socket.cpp
+#include "Socket.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#ifndef _WIN32
+#include <csignal>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+bool isTcpAddress(const std::string& address) {
+    size_t colon = address.rfind(':');
+    return colon != std::string::npos && colon + 1 < address.size() && address.find('/') == std::string::npos &&
+           address.find_first_not_of("0123456789", colon + 1) == std::string::npos;
+}
+
+#ifdef _WIN32
+
+SocketConnection::SocketConnection(int fd) : fd(fd) {}
+SocketConnection::~SocketConnection() {}
+
+std::unique_ptr<SocketConnection> SocketConnection::connect(const std::string&) {
+    std::cerr << "Error: Sockets are not supported by this build" << std::endl;
+    return nullptr;
+}
+
+bool SocketConnection::sendAll(const char*, size_t) { return false; }
+bool SocketConnection::sendLine(const json&) { return false; }
+bool SocketConnection::readLine(std::string&) { return false; }
+bool SocketConnection::readExact(char*, size_t) { return false; }
+
+SocketListener::SocketListener() : fd(-1) {}
+SocketListener::~SocketListener() {}
+
+bool SocketListener::open(const std::string&) {
+    std::cerr << "Error: Sockets are not supported by this build" << std::endl;
+    return false;
+}
+
+std::unique_ptr<SocketConnection> SocketListener::accept() { return nullptr; }
+
+#else
+
+namespace {
+
+// Messages are short JSON lines (binary data follows them separately), so a
+// longer line means a broken or hostile peer
+const size_t maxLineLength = 1 << 20;
+
+/*
+* Function to resolve a host:port address for a TCP socket.
+* An empty host resolves to the loopback addresses; the protocol has no
+* authentication, so listening on other interfaces must be asked for explicitly.
+*/
+addrinfo* resolveTcpAddress(const std::string& address) {
+    size_t colon = address.rfind(':');
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* result = nullptr;
+    int status = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result);
+    if (status != 0) {
+        std::cerr << "Error: Could not resolve " << address << ": " << gai_strerror(status) << std::endl;
+        return nullptr;
+    }
+    return result;
+}
+
+bool makeUnixAddress(const std::string& path, sockaddr_un& unixAddress) {
+    unixAddress = {};
+    unixAddress.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(unixAddress.sun_path)) {
+        std::cerr << "Error: Socket path too long: " << path << std::endl;
+        return false;
+    }
+    path.copy(unixAddress.sun_path, path.size());
+    return true;
+}
+
+// Only sockets are removed, so a mistyped path can never delete a user's file
+bool isSocketPath(const std::string& path) {
+    struct stat pathStat;
+    return lstat(path.c_str(), &pathStat) == 0 && S_ISSOCK(pathStat.st_mode);
+}
+
+// Tiles are small messages followed by large payloads, so Nagle only adds latency
+void disableNagle(int fd) {
+    int enabled = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enabled, sizeof(enabled));
+}
+
+}
+
+SocketConnection::SocketConnection(int fd) : fd(fd) {}
+
+SocketConnection::~SocketConnection() {
+    if (fd >= 0)
+        close(fd);
+}
+
+std::unique_ptr<SocketConnection> SocketConnection::connect(const std::string& address) {
+    // A peer hanging up must surface as a failed send, not kill the process
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (!isTcpAddress(address)) {
+        sockaddr_un unixAddress;
+        if (!makeUnixAddress(address, unixAddress))
+            return nullptr;
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&unixAddress), sizeof(unixAddress)) == 0)
+            return std::make_unique<SocketConnection>(fd);
+        std::cerr << "Error: Could not connect to " << address << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0)
+            close(fd);
+        return nullptr;
+    }
+
+    addrinfo* addresses = resolveTcpAddress(address);
+    if (!addresses)
+        return nullptr;
+    int fd = -1;
+    for (addrinfo* candidate = addresses; candidate; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+        if (fd < 0)
+            continue;
+        if (::connect(fd, candidate->ai_addr, candidate->ai_addrlen) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        std::cerr << "Error: Could not connect to " << address << std::endl;
+        return nullptr;
+    }
+    disableNagle(fd);
+    return std::make_unique<SocketConnection>(fd);
+}
+
+bool SocketConnection::sendAll(const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, 0);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+        data += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+bool SocketConnection::sendLine(const json& message) {
+    std::string line = message.dump() + "\n";
+    return sendAll(line.data(), line.size());
+}
+
+bool SocketConnection::readLine(std::string& line) {
+    char chunk[65536];
+    size_t newline;
+    while ((newline = pending.find('\n')) == std::string::npos) {
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        pending.append(chunk, static_cast<size_t>(received));
+        if (pending.size() > maxLineLength && pending.find('\n') == std::string::npos) {
+            std::cerr << "Error: Message longer than " << maxLineLength << " bytes, closing the connection" << std::endl;
+            return false;
+        }
+    }
+    line = pending.substr(0, newline);
+    pending.erase(0, newline + 1);
+    return true;
+}
+
+bool SocketConnection::readExact(char* data, size_t size) {
+    size_t buffered = std::min(size, pending.size());
+    std::memcpy(data, pending.data(), buffered);
+    pending.erase(0, buffered);
+    data += buffered;
+    size -= buffered;
+
+    while (size > 0) {
+        ssize_t received = recv(fd, data, size, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+        data += received;
+        size -= static_cast<size_t>(received);
+    }
+    return true;
+}
+
+SocketListener::SocketListener() : fd(-1) {}
+
+SocketListener::~SocketListener() {
+    if (fd >= 0)
+        close(fd);
+    if (!unixPath.empty() && isSocketPath(unixPath))
+        unlink(unixPath.c_str());
+}
+
+bool SocketListener::open(const std::string& address) {
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (!isTcpAddress(address)) {
+        sockaddr_un unixAddress;
+        if (!makeUnixAddress(address, unixAddress))
+            return false;
+        // Remove a stale socket left by a previous server, but nothing else
+        if (isSocketPath(address)) {
+            unlink(address.c_str());
+        } else if (access(address.c_str(), F_OK) == 0) {
+            std::cerr << "Error: Could not listen on " << address << ": the path exists and is not a socket" << std::endl;
+            return false;
+        }
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, reinterpret_cast<sockaddr*>(&unixAddress), sizeof(unixAddress)) != 0 || listen(fd, 16) != 0) {
+            std::cerr << "Error: Could not listen on " << address << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        unixPath = address;
+        return true;
+    }
+
+    addrinfo* addresses = resolveTcpAddress(address);
+    if (!addresses)
+        return false;
+    for (addrinfo* candidate = addresses; candidate; candidate = candidate->ai_next) {
+        fd = socket(candidate->ai_family, candidate->ai_socktype, candidate->ai_protocol);
+        if (fd < 0)
+            continue;
+        int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(fd, candidate->ai_addr, candidate->ai_addrlen) == 0 && listen(fd, 16) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addresses);
+    if (fd < 0) {
+        std::cerr << "Error: Could not listen on " << address << std::endl;
+        return false;
+    }
+    return true;
+}
+
+std::unique_ptr<SocketConnection> SocketListener::accept() {
+    while (true) {
+        int clientFd = ::accept(fd, nullptr, nullptr);
+        if (clientFd >= 0) {
+            if (unixPath.empty())
+                disableNagle(clientFd);
+            return std::make_unique<SocketConnection>(clientFd);
+        }
+        if (errno != EINTR && errno != ECONNABORTED) {
+            std::cerr << "Error: accept failed: " << std::strerror(errno) << std::endl;
+            return nullptr;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,280 @@
+// SpatialSplitBVH.cpp
+#include "SpatialSplitBVH.h"
+#include <algorithm>
+#include <limits>
+
+namespace {
+
+// Planes tried per axis by the spatial split
+const int spatialBins = 32;
+
+// Spatial splits are searched for when the children of the best object split
+// overlap by more than this fraction of the node's surface area. The SBVH paper
+// takes 1e-5 of the root's, which never triggers below a ground plane thousands
+// of units wide; relative to the node, a larger fraction keeps the touching
+// boxes of neighbouring mesh triangles from triggering a search everywhere.
+const Real overlapThreshold = 1e-3;
+
+// From this depth on nodes are halved at the median, which bounds the tree depth
+const int maxDepth = 64;
+
+// Box with the extent on one axis replaced
+BoundingBox slab(const BoundingBox& box, int axis, Real low, Real high) {
+    BoundingBox result = box;
+    result.min[axis] = low;
+    result.max[axis] = high;
+    return result;
+}
+
+}
+
+SpatialSplitBVH::SpatialSplitBVH(const std::vector<std::shared_ptr<Intersectable>>& objects, Real duplicationBudget)
+    : objects(objects), remainingDuplicates(static_cast<size_t>(objects.size() * std::max(Real(0), duplicationBudget))) {}
+
+std::shared_ptr<BVHNode> SpatialSplitBVH::build() {
+    referenceCount = 0;
+    if (objects.empty())
+        return nullptr;
+
+    std::vector<Reference> references;
+    references.reserve(objects.size());
+    for (size_t i = 0; i < objects.size(); ++i) {
+        references.push_back({static_cast<uint32_t>(i), objects[i]->getBoundingBox()});
+    }
+    return buildNode(references, 0);
+}
+
+std::shared_ptr<BVHNode> SpatialSplitBVH::buildNode(std::vector<Reference>& references, int depth) {
+    auto node = std::make_shared<BVHNode>();
+    BoundingBox bounds = BoundingBox::empty();
+    for (const Reference& reference : references) {
+        bounds = bounds.merge(reference.box);
+    }
+    node->boundingBox = bounds;
+
+    if (references.size() == 1) {
+        node->object = objects[references[0].object];
+        node->isLeaf = true;
+        ++referenceCount;
+        return node;
+    }
+
+    std::vector<Reference> left, right;
+    Split objectSplit;
+    if (depth >= maxDepth) {
+        Vector3 extent = bounds.max - bounds.min;
+        int axis = extent.y > extent.x ? 1 : 0;
+        if (extent.z > extent[axis])
+            axis = 2;
+        objectSplit = {0, axis, references.size() / 2, 0, false};
+    } else {
+        BoundingBox leftBox, rightBox;
+        objectSplit = findObjectSplit(references, leftBox, rightBox);
+
+        // Spatial splits only pay off where the object split leaves the children overlapping
+        if (remainingDuplicates > 0 && leftBox.overlap(rightBox).getSurfaceArea() > overlapThreshold * bounds.getSurfaceArea()) {
+            Split spatialSplit = findSpatialSplit(references, bounds);
+            if (spatialSplit.cost < objectSplit.cost) {
+                size_t budget = remainingDuplicates;
+                splitSpatially(references, spatialSplit, left, right);
+                if (left.empty() || right.empty()) {
+                    remainingDuplicates = budget;
+                    left.clear();
+                    right.clear();
+                }
+            }
+        }
+    }
+    if (left.empty())
+        splitObjects(references, objectSplit, left, right);
+
+    // Release this level's references before descending
+    std::vector<Reference>().swap(references);
+    node->left = buildNode(left, depth + 1);
+    node->right = buildNode(right, depth + 1);
+    node->isLeaf = false;
+    return node;
+}
+
+/*
+* Function to find the object partition of lowest SAH cost: on each axis the
+* references are sorted by centroid and every split position is evaluated with
+* the boxes of the prefix and suffix. leftBox and rightBox receive the boxes of
+* the two sides of the best split.
+*/
+SpatialSplitBVH::Split SpatialSplitBVH::findObjectSplit(std::vector<Reference>& references, BoundingBox& leftBox, BoundingBox& rightBox) const {
+    size_t count = references.size();
+    Split best = {std::numeric_limits<Real>::infinity(), 0, count / 2, 0, false};
+    std::vector<BoundingBox> suffix(count);
+
+    for (int axis = 0; axis < 3; ++axis) {
+        std::sort(references.begin(), references.end(), [axis](const Reference& a, const Reference& b) {
+            Real ca = a.box.min[axis] + a.box.max[axis];
+            Real cb = b.box.min[axis] + b.box.max[axis];
+            return ca < cb || (ca == cb && a.object < b.object);
+        });
+
+        suffix[count - 1] = references[count - 1].box;
+        for (size_t i = count - 1; i-- > 0;) {
+            suffix[i] = suffix[i + 1].merge(references[i].box);
+        }
+
+        BoundingBox prefix = BoundingBox::empty();
+        for (size_t i = 1; i < count; ++i) {
+            prefix = prefix.merge(references[i - 1].box);
+            Real cost = prefix.getSurfaceArea() * i + suffix[i].getSurfaceArea() * (count - i);
+            if (cost < best.cost) {
+                best = {cost, axis, i, 0, false};
+                leftBox = prefix;
+                rightBox = suffix[i];
+            }
+        }
+    }
+    return best;
+}
+
+/*
+* Function to find the spatial split of lowest SAH cost. The node is cut into
+* spatialBins slabs per axis; each reference is clipped to every slab it
+* overlaps and counted as entering its first slab and leaving its last. A
+* plane between slabs then has the entering references on its left and the
+* leaving ones on its right, straddling references on both.
+*/
+SpatialSplitBVH::Split SpatialSplitBVH::findSpatialSplit(const std::vector<Reference>& references, const BoundingBox& bounds) const {
+    size_t count = references.size();
+    Split best = {std::numeric_limits<Real>::infinity(), 0, 0, 0, true};
+
+    for (int axis = 0; axis < 3; ++axis) {
+        Real origin = bounds.min[axis];
+        Real extent = bounds.max[axis] - origin;
+        if (extent <= 0)
+            continue;
+        auto plane = [&](int bin) { return origin + extent * bin / spatialBins; };
+        auto binOf = [&](Real value) {
+            return std::clamp(static_cast<int>((value - origin) / extent * spatialBins), 0, spatialBins - 1);
+        };
+
+        BoundingBox binBox[spatialBins];
+        size_t entries[spatialBins] = {};
+        size_t exits[spatialBins] = {};
+        std::fill(binBox, binBox + spatialBins, BoundingBox::empty());
+
+        for (const Reference& reference : references) {
+            int first = binOf(reference.box.min[axis]);
+            int last = std::max(first, binOf(reference.box.max[axis]));
+            if (first == last) {
+                binBox[first] = binBox[first].merge(reference.box);
+            } else {
+                const Intersectable& object = *objects[reference.object];
+                for (int bin = first; bin <= last; ++bin) {
+                    Real low = std::max(reference.box.min[axis], plane(bin));
+                    Real high = std::min(reference.box.max[axis], plane(bin + 1));
+                    BoundingBox part = object.getClippedBoundingBox(slab(reference.box, axis, low, high));
+                    binBox[bin] = binBox[bin].merge(part);
+                }
+            }
+            entries[first]++;
+            exits[last]++;
+        }
+
+        BoundingBox suffix[spatialBins];
+        size_t suffixCount[spatialBins];
+        suffix[spatialBins - 1] = binBox[spatialBins - 1];
+        suffixCount[spatialBins - 1] = exits[spatialBins - 1];
+        for (int bin = spatialBins - 1; bin-- > 0;) {
+            suffix[bin] = suffix[bin + 1].merge(binBox[bin]);
+            suffixCount[bin] = suffixCount[bin + 1] + exits[bin];
+        }
+
+        BoundingBox prefix = BoundingBox::empty();
+        size_t prefixCount = 0;
+        for (int bin = 1; bin < spatialBins; ++bin) {
+            prefix = prefix.merge(binBox[bin - 1]);
+            prefixCount += entries[bin - 1];
+            size_t rightCount = suffixCount[bin];
+            // Each side has to lose something, or the split would recurse forever
+            if (prefixCount == 0 || rightCount == 0 || prefixCount == count || rightCount == count)
+                continue;
+            if (prefixCount + rightCount - count > remainingDuplicates)
+                continue;
+            Real cost = prefix.getSurfaceArea() * prefixCount + suffix[bin].getSurfaceArea() * rightCount;
+            if (cost < best.cost)
+                best = {cost, axis, 0, plane(bin), true};
+        }
+    }
+    return best;
+}
+
+void SpatialSplitBVH::splitObjects(std::vector<Reference>& references, const Split& split, std::vector<Reference>& left, std::vector<Reference>& right) const {
+    int axis = split.axis;
+    std::sort(references.begin(), references.end(), [axis](const Reference& a, const Reference& b) {
+        Real ca = a.box.min[axis] + a.box.max[axis];
+        Real cb = b.box.min[axis] + b.box.max[axis];
+        return ca < cb || (ca == cb && a.object < b.object);
+    });
+    left.assign(references.begin(), references.begin() + split.index);
+    right.assign(references.begin() + split.index, references.end());
+}
+
+/*
+* Function to distribute the references over the two sides of a spatial split.
+* A straddling reference is split in two unless moving it whole to one side is
+* cheaper ("reference unsplitting"), which also keeps it whole once the
+* duplication budget is used up.
+*/
+void SpatialSplitBVH::splitSpatially(std::vector<Reference>& references, const Split& split, std::vector<Reference>& left, std::vector<Reference>& right) {
+    int axis = split.axis;
+    Real position = split.position;
+    BoundingBox leftBox = BoundingBox::empty();
+    BoundingBox rightBox = BoundingBox::empty();
+    std::vector<Reference> straddling;
+
+    for (const Reference& reference : references) {
+        if (reference.box.max[axis] <= position) {
+            left.push_back(reference);
+            leftBox = leftBox.merge(reference.box);
+        } else if (reference.box.min[axis] >= position) {
+            right.push_back(reference);
+            rightBox = rightBox.merge(reference.box);
+        } else {
+            straddling.push_back(reference);
+        }
+    }
+
+    size_t leftCount = left.size() + straddling.size();
+    size_t rightCount = right.size() + straddling.size();
+    for (const Reference& reference : straddling) {
+        const Intersectable& object = *objects[reference.object];
+        BoundingBox leftPart = object.getClippedBoundingBox(slab(reference.box, axis, reference.box.min[axis], position));
+        BoundingBox rightPart = object.getClippedBoundingBox(slab(reference.box, axis, position, reference.box.max[axis]));
+
+        Real splitCost = std::numeric_limits<Real>::infinity();
+        if (remainingDuplicates > 0 && !leftPart.isEmpty() && !rightPart.isEmpty())
+            splitCost = leftBox.merge(leftPart).getSurfaceArea() * leftCount + rightBox.merge(rightPart).getSurfaceArea() * rightCount;
+        Real leftCost = leftBox.merge(reference.box).getSurfaceArea() * leftCount + rightBox.getSurfaceArea() * (rightCount - 1);
+        Real rightCost = leftBox.getSurfaceArea() * (leftCount - 1) + rightBox.merge(reference.box).getSurfaceArea() * rightCount;
+        // Only the part on its side is kept when the object misses the other one
+        if (rightPart.isEmpty())
+            leftCost = -1;
+        else if (leftPart.isEmpty())
+            rightCost = -1;
+
+        if (splitCost < leftCost && splitCost < rightCost) {
+            left.push_back({reference.object, leftPart});
+            right.push_back({reference.object, rightPart});
+            leftBox = leftBox.merge(leftPart);
+            rightBox = rightBox.merge(rightPart);
+            remainingDuplicates--;
+        } else if (leftCost <= rightCost) {
+            BoundingBox box = rightPart.isEmpty() && !leftPart.isEmpty() ? leftPart : reference.box;
+            left.push_back({reference.object, box});
+            leftBox = leftBox.merge(box);
+            rightCount--;
+        } else {
+            BoundingBox box = leftPart.isEmpty() && !rightPart.isEmpty() ? rightPart : reference.box;
+            right.push_back({reference.object, box});
+            rightBox = rightBox.merge(box);
+            leftCount--;
+        }
+    }
+}
@@ -1,32 +1,44 @@
 // Sphere.cpp
 #include "Sphere.h"
+#include "RenderStats.h"
+#include <cmath>
+#include <utility>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
 // Initialize sphere with center, radius, and material
-Sphere::Sphere(const Vector3& center, double radius, const Material& material)
+Sphere::Sphere(const Vector3& center, Real radius, const Material& material)
     : center(center), radius(radius), material(material) {}
 
 // Ray-sphere intersection test
 // Sphere.cpp (Update the intersect method) 
 bool Sphere::intersect(const Ray& ray, HitRecord& hitRecord) const {
+    RT_STAT(primitiveTests);
     Vector3 oc = ray.origin - center;
-    double a = ray.direction.dot(ray.direction);
-    double b = 2.0 * oc.dot(ray.direction);
-    double c = oc.dot(oc) - radius * radius;
-    double discriminant = b * b - 4 * a * c;
+    Real a = ray.direction.lengthSquared();
+    Real halfB = oc.dot(ray.direction);
+    Real c = oc.lengthSquared() - radius * radius;
+
+    // The discriminant is taken from the ray's closest approach to the centre,
+    // a * (r^2 - |l|^2), rather than b^2 - 4ac, which cancels catastrophically
+    // in single precision when the sphere is large or far away
+    Vector3 l = oc - ray.direction * (halfB / a);
+    Real discriminant = a * (radius * radius - l.lengthSquared());
 
     if (discriminant < 0) {
         return false;
     } else {
-        double sqrtDiscriminant = std::sqrt(discriminant);
-        double t0 = (-b - sqrtDiscriminant) / (2.0 * a);
-        double t1 = (-b + sqrtDiscriminant) / (2.0 * a);
+        // Stable roots: q never subtracts nearly equal values
+        Real q = -halfB - std::copysign(std::sqrt(discriminant), halfB);
+        Real t0 = c / q;
+        Real t1 = q / a;
+        if (t0 > t1)
+            std::swap(t0, t1);
 
         // Find the nearest positive t
-        double t = t0;
+        Real t = t0;
         if (t < 0) {
             t = t1;
             if (t < 0) {
@@ -36,10 +48,12 @@ bool Sphere::intersect(const Ray& ray, HitRecord& hitRecord) const {
 
         // Fill the hit record
         hitRecord.t = t;
-        hitRecord.point = ray.at(t);
-        hitRecord.normal = (hitRecord.point - center).normalize();
+        // Project the hit back onto the surface, so its error does not grow with t
+        hitRecord.normal = (ray.at(t) - center).normalize();
+        hitRecord.point = center + hitRecord.normal * radius;
         hitRecord.material = material;
-        hitRecord.getUV = [this](const Vector3& point, double& u, double& v) {
+        hitRecord.object = this;
+        hitRecord.getUV = [this](const Vector3& point, Real& u, Real& v) {
             getUV(point, u, v);
         };
 
@@ -47,10 +61,10 @@ bool Sphere::intersect(const Ray& ray, HitRecord& hitRecord) const {
     }
 }
 
-void Sphere::getUV(const Vector3& point, double& u, double& v) const {
+void Sphere::getUV(const Vector3& point, Real& u, Real& v) const {
     Vector3 p = (point - center).normalize();
-    double phi = atan2(p.z, p.x);
-    double theta = acos(p.y);
+    Real phi = atan2(p.z, p.x);
+    Real theta = acos(p.y);
 
     u = (phi + M_PI) / (2 * M_PI);
     v = theta / M_PI;
@@ -1,5 +1,6 @@
 // Triangle.cpp
 #include "Triangle.h"
+#include "RenderStats.h"
 
 // Initialize triangle with vertices and material
 Triangle::Triangle(const Vector3& v0, const Vector3& v1, const Vector3& v2, const Material& material)
@@ -12,71 +13,92 @@ Triangle::Triangle(const Vector3& v0, const Vector3& v1, const Vector3& v2, cons
             }
 }
 
-void Triangle::getUV(const Vector3& point, double& u, double& v) const {
+void Triangle::getUV(const Vector3& point, Real& u, Real& v) const {
     // Compute vectors
     Vector3 edge1 = v1 - v0;
     Vector3 edge2 = v2 - v0;
     Vector3 pVec = point - v0;
 
     // Compute dot products
-    double d00 = edge1.dot(edge1);
-    double d01 = edge1.dot(edge2);
-    double d11 = edge2.dot(edge2);
-    double d20 = pVec.dot(edge1);
-    double d21 = pVec.dot(edge2);
+    Real d00 = edge1.dot(edge1);
+    Real d01 = edge1.dot(edge2);
+    Real d11 = edge2.dot(edge2);
+    Real d20 = pVec.dot(edge1);
+    Real d21 = pVec.dot(edge2);
 
     // Compute denominators
-    double denom = d00 * d11 - d01 * d01;
+    Real denom = d00 * d11 - d01 * d01;
 
     // Compute barycentric coordinates
-    double v_coord = (d11 * d20 - d01 * d21) / denom;
-    double w_coord = (d00 * d21 - d01 * d20) / denom;
-    double u_coord = 1.0 - v_coord - w_coord;
+    Real v_coord = (d11 * d20 - d01 * d21) / denom;
+    Real w_coord = (d00 * d21 - d01 * d20) / denom;
+    uvFromBarycentrics(v_coord, w_coord, u, v);
+}
+
+void Triangle::uvFromBarycentrics(Real b1, Real b2, Real& u, Real& v) {
+    Real b0 = 1.0 - b1 - b2;
 
     // Adjust UV coordinates to map to the diagonal of the image
-    u = (u_coord + v_coord) / 2.0;
-    v = (v_coord + w_coord) / 2.0;
+    u = (b0 + b1) / 2.0;
+    v = (b1 + b2) / 2.0;
 }
 
-// Ray-triangle intersection using Möller–Trumbore algorithm
+// Watertight ray-triangle intersection (Woop, Benthin and Wald 2013): the
+// vertices are sheared into the ray's frame and the hit is decided by the signs
+// of three edge functions, so a ray through a shared edge or vertex always hits
+// at least one of the triangles meeting there
 bool Triangle::intersect(const Ray& ray, HitRecord& hitRecord) const {
-    const double EPSILON = 1e-8;
-    Vector3 edge1 = v1 - v0;
-    Vector3 edge2 = v2 - v0;
-    Vector3 h = ray.direction.cross(edge2);
-    double a = edge1.dot(h);
+    RT_STAT(primitiveTests);
+    Vector3 a = v0 - ray.origin;
+    Vector3 b = v1 - ray.origin;
+    Vector3 c = v2 - ray.origin;
+
+    Real ax = a[ray.kx] + ray.shear.x * a[ray.kz];
+    Real ay = a[ray.ky] + ray.shear.y * a[ray.kz];
+    Real bx = b[ray.kx] + ray.shear.x * b[ray.kz];
+    Real by = b[ray.ky] + ray.shear.y * b[ray.kz];
+    Real cx = c[ray.kx] + ray.shear.x * c[ray.kz];
+    Real cy = c[ray.ky] + ray.shear.y * c[ray.kz];
+
+    // Scaled barycentric coordinates of v0, v1 and v2
+    Real u = cx * by - cy * bx;
+    Real v = ax * cy - ay * cx;
+    Real w = bx * ay - by * ax;
+
+    // Exactly on an edge the products may have cancelled; decide in double precision
+    if (u == 0 || v == 0 || w == 0) {
+        u = static_cast<Real>(static_cast<double>(cx) * by - static_cast<double>(cy) * bx);
+        v = static_cast<Real>(static_cast<double>(ax) * cy - static_cast<double>(ay) * cx);
+        w = static_cast<Real>(static_cast<double>(bx) * ay - static_cast<double>(by) * ax);
+    }
 
-    if (std::abs(a) < EPSILON)
+    if ((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0))
         return false;
 
-    double f = 1.0 / a;
-    Vector3 s = ray.origin - v0;
-    double u = f * s.dot(h);
-
-    if (u < 0.0 || u > 1.0)
+    Real det = u + v + w;
+    if (det == 0)
         return false;
 
-    Vector3 q = s.cross(edge1);
-    double v = f * ray.direction.dot(q);
-
-    if (v < 0.0 || u + v > 1.0)
+    Real t = (u * ray.shear.z * a[ray.kz] + v * ray.shear.z * b[ray.kz] + w * ray.shear.z * c[ray.kz]) / det;
+    if (!(t > 0))
         return false;
 
-    double t = f * edge2.dot(q);
-
-    if (t > EPSILON) {
-        hitRecord.t = t;
-        hitRecord.point = ray.at(t);
-        hitRecord.normal = normal;
-        hitRecord.material = material;
-        hitRecord.getUV = [this](const Vector3& point, double& u, double& v) {
-            getUV(point, u, v);
-        };
-        
-        return true;
-    } else {
-        return false;
-    }
+    Real b0 = u / det;
+    Real b1 = v / det;
+    Real b2 = w / det;
+
+    hitRecord.t = t;
+    // Interpolating the vertices keeps the point as accurate as the vertices themselves
+    hitRecord.point = v0 * b0 + v1 * b1 + v2 * b2;
+    hitRecord.normal = normal;
+    hitRecord.material = material;
+    hitRecord.object = this;
+    // The barycentrics of the hit already give the texture coordinates
+    hitRecord.getUV = [b1, b2](const Vector3&, Real& textureU, Real& textureV) {
+        uvFromBarycentrics(b1, b2, textureU, textureV);
+    };
+
+    return true;
 }
 
 BoundingBox Triangle::getBoundingBox() const {
@@ -92,3 +114,8 @@ BoundingBox Triangle::getBoundingBox() const {
     );
     return BoundingBox(minVec, maxVec);
 }
+
+BoundingBox Triangle::getClippedBoundingBox(const BoundingBox& clip) const {
+    Vector3 vertices[3] = {v0, v1, v2};
+    return BoundingBox::ofClippedPolygon(vertices, 3, clip);
+}
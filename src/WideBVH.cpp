@@ -0,0 +1,323 @@
+// WideBVH.cpp
+#include "WideBVH.h"
+#include "CpuDispatch.h"
+#include "RenderStats.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// 2^exponent for the exponents of quantized nodes, built from the float bit pattern
+Real powerOfTwo(int exponent) {
+    uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// A child of a wide node with the box it is tested against
+struct Lane {
+    std::shared_ptr<Intersectable> child;
+    BoundingBox box;
+};
+
+// Leaves holding a single object are replaced by the object itself. The lane
+// keeps the leaf's box, which a spatial split may have clipped tighter than the
+// object's own.
+Lane makeLane(const std::shared_ptr<Intersectable>& child) {
+    Lane lane = {child, child->getBoundingBox()};
+    while (auto node = std::dynamic_pointer_cast<BVHNode>(lane.child)) {
+        if (!node->object)
+            break;
+        lane.child = node->object;
+    }
+    return lane;
+}
+}
+
+template <int Width, int QuantizationBits>
+WideBVH<Width, QuantizationBits>::WideBVH(const BVHNode& root) : bounds(root.boundingBox) {
+    std::vector<Node> built;
+    collapse(root, built, 0);
+    if constexpr (QuantizationBits == 0) {
+        nodes = std::move(built);
+    } else {
+        nodes.reserve(built.size());
+        for (const Node& node : built) {
+            nodes.push_back(quantize(node));
+        }
+    }
+}
+
+/*
+* Function to turn a binary node and as many of its descendants as fit into one
+* wide node: the child with the largest surface area is opened until Width
+* children are collected or only primitives are left. Nodes at maxDepth - 1
+* keep their inner children as binary subtrees, intersected like primitives.
+*/
+template <int Width, int QuantizationBits>
+int32_t WideBVH<Width, QuantizationBits>::collapse(const BVHNode& node, std::vector<Node>& built, int depth) {
+    std::vector<Lane> children;
+    if (node.object) {
+        children.push_back({node.object, node.boundingBox});
+    } else {
+        for (const auto& child : {node.left, node.right}) {
+            if (child)
+                children.push_back(makeLane(child));
+        }
+    }
+
+    while (static_cast<int>(children.size()) < Width) {
+        int widest = -1;
+        Real widestArea = -1;
+        for (size_t c = 0; c < children.size(); ++c) {
+            auto inner = std::dynamic_pointer_cast<BVHNode>(children[c].child);
+            if (inner && inner->boundingBox.getSurfaceArea() > widestArea) {
+                widest = static_cast<int>(c);
+                widestArea = inner->boundingBox.getSurfaceArea();
+            }
+        }
+        if (widest < 0)
+            break;
+
+        auto inner = std::static_pointer_cast<BVHNode>(children[widest].child);
+        children.erase(children.begin() + widest);
+        for (const auto& grandchild : {inner->left, inner->right}) {
+            if (grandchild)
+                children.push_back(makeLane(grandchild));
+        }
+    }
+
+    int32_t index = static_cast<int32_t>(built.size());
+    built.emplace_back();
+    Node record;
+    record.hasPrimitives = false;
+    for (int lane = 0; lane < Width; ++lane) {
+        // Empty lanes are skipped by their child index; the box only has to be finite
+        record.minX[lane] = record.minY[lane] = record.minZ[lane] = 0;
+        record.maxX[lane] = record.maxY[lane] = record.maxZ[lane] = 0;
+        record.child[lane] = emptyChild;
+    }
+
+    for (size_t lane = 0; lane < children.size(); ++lane) {
+        const BoundingBox& box = children[lane].box;
+        record.minX[lane] = box.min.x;
+        record.minY[lane] = box.min.y;
+        record.minZ[lane] = box.min.z;
+        record.maxX[lane] = box.max.x;
+        record.maxY[lane] = box.max.y;
+        record.maxZ[lane] = box.max.z;
+
+        auto inner = std::dynamic_pointer_cast<BVHNode>(children[lane].child);
+        if (inner && depth + 1 < maxDepth) {
+            record.child[lane] = collapse(*inner, built, depth + 1);
+        } else {
+            record.child[lane] = ~static_cast<int32_t>(primitives.size());
+            primitives.push_back(children[lane].child);
+            record.hasPrimitives = true;
+        }
+    }
+    built[index] = record;
+    return index;
+}
+
+/*
+* Function to compress the child bounds of a node. Per axis, the origin is the
+* smallest child minimum rounded down to float, and the step is the smallest
+* power of two that spans the node in (2^bits - 2) steps. Offsets are rounded
+* outwards and then checked against the decoded value, so the decoded box can
+* only be larger than the child's.
+*/
+template <int Width, int QuantizationBits>
+typename WideBVH<Width, QuantizationBits>::QuantizedNode WideBVH<Width, QuantizationBits>::quantize(const Node& node) {
+    constexpr Real levels = static_cast<Real>((1 << QuantizationBits) - 1);
+    QuantizedNode compressed;
+    std::memset(&compressed, 0, sizeof(compressed));
+    compressed.hasPrimitives = node.hasPrimitives;
+
+    const Real* childMin[3] = {node.minX, node.minY, node.minZ};
+    const Real* childMax[3] = {node.maxX, node.maxY, node.maxZ};
+    Quantum* offsetMin[3] = {compressed.minX, compressed.minY, compressed.minZ};
+    Quantum* offsetMax[3] = {compressed.maxX, compressed.maxY, compressed.maxZ};
+
+    for (int lane = 0; lane < Width; ++lane) {
+        compressed.child[lane] = node.child[lane];
+    }
+
+    for (int axis = 0; axis < 3; ++axis) {
+        Real low = std::numeric_limits<Real>::infinity();
+        Real high = -std::numeric_limits<Real>::infinity();
+        for (int lane = 0; lane < Width; ++lane) {
+            if (node.child[lane] == emptyChild)
+                continue;
+            low = std::min(low, childMin[axis][lane]);
+            high = std::max(high, childMax[axis][lane]);
+        }
+
+        float origin = static_cast<float>(low);
+        if (origin > low)
+            origin = std::nextafter(origin, -std::numeric_limits<float>::infinity());
+
+        int exponent = -126;
+        Real extent = high - origin;
+        if (extent > 0)
+            std::frexp(extent / (levels - 1), &exponent);
+        exponent = std::clamp(exponent, -126, 127);
+        Real scale = powerOfTwo(exponent);
+
+        compressed.origin[axis] = origin;
+        compressed.exponent[axis] = static_cast<int8_t>(exponent);
+
+        for (int lane = 0; lane < Width; ++lane) {
+            if (node.child[lane] == emptyChild)
+                continue;
+            Real lowOffset = std::clamp(std::floor((childMin[axis][lane] - origin) / scale), Real(0), levels);
+            while (lowOffset > 0 && Real(origin) + lowOffset * scale > childMin[axis][lane])
+                --lowOffset;
+            Real highOffset = std::clamp(std::ceil((childMax[axis][lane] - origin) / scale), Real(0), levels);
+            while (highOffset < levels && Real(origin) + highOffset * scale < childMax[axis][lane])
+                ++highOffset;
+            offsetMin[axis][lane] = static_cast<Quantum>(lowOffset);
+            offsetMax[axis][lane] = static_cast<Quantum>(highOffset);
+        }
+    }
+    return compressed;
+}
+
+template <int Width, int QuantizationBits>
+bool WideBVH<Width, QuantizationBits>::intersect(const Ray& ray, HitRecord& hitRecord) const {
+    return traverse(ray, hitRecord, std::numeric_limits<Real>::infinity(), nullptr);
+}
+
+template <int Width, int QuantizationBits>
+bool WideBVH<Width, QuantizationBits>::occluded(const Ray& ray, Real maxDistance, const Intersectable*& occluder) const {
+    HitRecord unused;
+    return traverse(ray, unused, maxDistance, &occluder);
+}
+
+/*
+* Function to find the closest hit before maxDistance with an explicit stack of
+* children still to visit, each with the distance at which the ray enters its
+* box. Given an occluder it is an any-hit query instead: the first primitive
+* hit before maxDistance ends the traversal and is stored there.
+*/
+template <int Width, int QuantizationBits>
+RT_DISPATCH bool WideBVH<Width, QuantizationBits>::traverse(const Ray& ray, HitRecord& hitRecord, Real maxDistance, const Intersectable** occluder) const {
+    struct Entry {
+        int32_t child;
+        Real tNear;
+    };
+
+    const Real originX = ray.origin.x, originY = ray.origin.y, originZ = ray.origin.z;
+    const Real inverseX = Real(1) / ray.direction.x;
+    const Real inverseY = Real(1) / ray.direction.y;
+    const Real inverseZ = Real(1) / ray.direction.z;
+
+    // Widening the exit distance by a few ulps keeps rounding in the slab test
+    // from missing boxes the ray only grazes (Ize, "Robust BVH Ray Traversal")
+    const Real exitScale = Real(1) + 4 * std::numeric_limits<Real>::epsilon();
+
+    Real closest = maxDistance;
+    bool hit = false;
+    HitRecord candidate;
+
+    Entry stack[stackSize];
+    int top = 0;
+    stack[top++] = {0, 0};
+
+    while (top > 0) {
+        Entry entry = stack[--top];
+        if (entry.tNear > closest)
+            continue;
+
+        if (entry.child < 0) {
+            const Intersectable& primitive = *primitives[~entry.child];
+            if (primitive.intersect(ray, candidate) && candidate.t < closest) {
+                if (occluder) {
+                    *occluder = &primitive;
+                    return true;
+                }
+                closest = candidate.t;
+                std::swap(hitRecord, candidate);
+                hit = true;
+            }
+            continue;
+        }
+
+        const StoredNode& node = nodes[entry.child];
+        RT_STAT(bvhNodeVisits);
+        if (node.hasPrimitives)
+            RT_STAT(bvhLeafVisits);
+
+        const Real *minX, *minY, *minZ, *maxX, *maxY, *maxZ;
+        Real decoded[6][Width];
+        if constexpr (QuantizationBits == 0) {
+            minX = node.minX, minY = node.minY, minZ = node.minZ;
+            maxX = node.maxX, maxY = node.maxY, maxZ = node.maxZ;
+        } else {
+            const Real baseX = node.origin[0], baseY = node.origin[1], baseZ = node.origin[2];
+            const Real scaleX = powerOfTwo(node.exponent[0]);
+            const Real scaleY = powerOfTwo(node.exponent[1]);
+            const Real scaleZ = powerOfTwo(node.exponent[2]);
+            for (int lane = 0; lane < Width; ++lane) {
+                decoded[0][lane] = baseX + Real(node.minX[lane]) * scaleX;
+                decoded[1][lane] = baseY + Real(node.minY[lane]) * scaleY;
+                decoded[2][lane] = baseZ + Real(node.minZ[lane]) * scaleZ;
+                decoded[3][lane] = baseX + Real(node.maxX[lane]) * scaleX;
+                decoded[4][lane] = baseY + Real(node.maxY[lane]) * scaleY;
+                decoded[5][lane] = baseZ + Real(node.maxZ[lane]) * scaleZ;
+            }
+            minX = decoded[0], minY = decoded[1], minZ = decoded[2];
+            maxX = decoded[3], maxY = decoded[4], maxZ = decoded[5];
+        }
+
+        // Slab test against every lane; the loop has no branches so it vectorises
+        Real tNear[Width];
+        bool laneHit[Width];
+        for (int lane = 0; lane < Width; ++lane) {
+            Real tx0 = (minX[lane] - originX) * inverseX;
+            Real tx1 = (maxX[lane] - originX) * inverseX;
+            Real ty0 = (minY[lane] - originY) * inverseY;
+            Real ty1 = (maxY[lane] - originY) * inverseY;
+            Real tz0 = (minZ[lane] - originZ) * inverseZ;
+            Real tz1 = (maxZ[lane] - originZ) * inverseZ;
+            Real enter = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), Real(0)));
+            Real exit = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::min(std::max(tz0, tz1), closest)) * exitScale;
+            tNear[lane] = enter;
+            laneHit[lane] = enter <= exit;
+        }
+
+        // Push the hit children farthest first, so the nearest is visited next
+        Entry hits[Width];
+        int hitCount = 0;
+        for (int lane = 0; lane < Width; ++lane) {
+            if (!laneHit[lane] || node.child[lane] == emptyChild)
+                continue;
+            Entry child = {node.child[lane], tNear[lane]};
+            int position = hitCount++;
+            while (position > 0 && hits[position - 1].tNear < child.tNear) {
+                hits[position] = hits[position - 1];
+                --position;
+            }
+            hits[position] = child;
+        }
+        for (int h = 0; h < hitCount; ++h) {
+            stack[top++] = hits[h];
+        }
+    }
+    return hit;
+}
+
+template <int Width, int QuantizationBits>
+BoundingBox WideBVH<Width, QuantizationBits>::getBoundingBox() const {
+    return bounds;
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
+template class WideBVH<4, 8>;
+template class WideBVH<8, 8>;
+template class WideBVH<4, 16>;
+template class WideBVH<8, 16>;